@@ -0,0 +1,259 @@
+/*
+
+  Copyright 2012-2021 Jochen Topf <jochen@topf.org>.
+
+  This file is part of OSMCoastline.
+
+  OSMCoastline is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  OSMCoastline is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with OSMCoastline.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include "coastline_cache.hpp"
+#include "location_map.hpp"
+
+#include <osmium/builder/osm_object_builder.hpp>
+#include <osmium/osm/node_ref.hpp>
+#include <osmium/osm/way.hpp>
+#include <osmium/util/memory_mapping.hpp>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <string>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <system_error>
+#include <vector>
+
+#ifndef _MSC_VER
+# include <unistd.h>
+#else
+# include <io.h>
+#endif
+
+static_assert(sizeof(osmium::NodeRef) == 16, "Unexpected size of osmium::NodeRef");
+static_assert(sizeof(coastline_cache_header) == 32, "Unexpected size of coastline_cache_header");
+static_assert(sizeof(coastline_cache_way) == 16, "Unexpected size of coastline_cache_way");
+
+namespace {
+
+    /**
+     * Collects data in a buffer and writes it out to a file in large
+     * chunks.
+     */
+    class CacheWriter {
+
+        static constexpr const std::size_t buffer_size = 1024 * 1024;
+
+        std::string m_filename;
+        std::vector<char> m_buffer;
+        int m_fd;
+
+    public:
+
+        explicit CacheWriter(const std::string& filename) :
+            m_filename(filename),
+            m_fd(::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666)) { // NOLINT(hicpp-signed-bitwise)
+            if (m_fd == -1) {
+                throw std::system_error{errno, std::system_category(), std::string{"Opening cache file '"} + filename + "' failed"};
+            }
+            m_buffer.reserve(buffer_size);
+        }
+
+        CacheWriter(const CacheWriter&) = delete;
+        CacheWriter& operator=(const CacheWriter&) = delete;
+
+        CacheWriter(CacheWriter&&) = delete;
+        CacheWriter& operator=(CacheWriter&&) = delete;
+
+        ~CacheWriter() noexcept {
+            if (m_fd != -1) {
+                ::close(m_fd);
+            }
+        }
+
+        void write(const void* data, std::size_t length) {
+            const char* ptr = static_cast<const char*>(data);
+            if (m_buffer.size() + length > buffer_size) {
+                flush();
+            }
+            m_buffer.insert(m_buffer.end(), ptr, ptr + length);
+        }
+
+        void flush() {
+            std::size_t offset = 0;
+            while (offset < m_buffer.size()) {
+#ifndef _MSC_VER
+                const auto written = ::write(m_fd, m_buffer.data() + offset, m_buffer.size() - offset);
+#else
+                const auto written = _write(m_fd, m_buffer.data() + offset, static_cast<unsigned int>(m_buffer.size() - offset));
+#endif
+                if (written <= 0) {
+                    throw std::system_error{errno, std::system_category(), std::string{"Writing cache file '"} + m_filename + "' failed"};
+                }
+                offset += static_cast<std::size_t>(written);
+            }
+            m_buffer.clear();
+        }
+
+        void close() {
+            flush();
+            if (::close(m_fd) != 0) {
+                m_fd = -1;
+                throw std::system_error{errno, std::system_category(), std::string{"Closing cache file '"} + m_filename + "' failed"};
+            }
+            m_fd = -1;
+        }
+
+    }; // class CacheWriter
+
+} // anonymous namespace
+
+void add_way_locations_to_locmap(osmium::memory::Buffer& ways, LocationMap& locmap) {
+    for (auto& way : ways.select<osmium::Way>()) {
+        for (auto& node_ref : way.nodes()) {
+            locmap.add(node_ref.ref(), &node_ref.location());
+        }
+    }
+}
+
+std::size_t add_missing_way_locations_to_locmap(osmium::memory::Buffer& ways, LocationMap& locmap) {
+    std::size_t count = 0;
+    for (auto& way : ways.select<osmium::Way>()) {
+        for (auto& node_ref : way.nodes()) {
+            if (!node_ref.location().valid()) {
+                locmap.add(node_ref.ref(), &node_ref.location());
+                ++count;
+            }
+        }
+    }
+    return count;
+}
+
+void write_coastline_cache(const std::string& filename, const osmium::memory::Buffer& ways) {
+    coastline_cache_header header; // NOLINT(cppcoreguidelines-pro-type-member-init, hicpp-member-init)
+    std::memcpy(header.magic, coastline_cache_magic, sizeof(header.magic));
+    header.version = coastline_cache_version;
+    header.reserved = 0;
+    header.num_ways = 0;
+    header.num_nodes = 0;
+
+    for (const auto& way : ways.select<osmium::Way>()) {
+        ++header.num_ways;
+        header.num_nodes += way.nodes().size();
+    }
+
+    // The data is written to a temporary file which is renamed at the end,
+    // so there is never a half-written cache file under the final name and
+    // the cache file we are reading from can be replaced.
+    const std::string tmp_filename = filename + ".tmp";
+    try {
+        CacheWriter writer{tmp_filename};
+        writer.write(&header, sizeof(header));
+
+        for (const auto& way : ways.select<osmium::Way>()) {
+            const coastline_cache_way cache_way{way.id(), static_cast<uint64_t>(way.nodes().size())};
+            writer.write(&cache_way, sizeof(cache_way));
+        }
+
+        for (const auto& way : ways.select<osmium::Way>()) {
+            for (const auto& node_ref : way.nodes()) {
+                writer.write(&node_ref, sizeof(osmium::NodeRef));
+            }
+        }
+
+        writer.close();
+    } catch (...) {
+        ::unlink(tmp_filename.c_str());
+        throw;
+    }
+
+    if (std::rename(tmp_filename.c_str(), filename.c_str()) != 0) {
+        const int error = errno;
+        ::unlink(tmp_filename.c_str());
+        throw std::system_error{error, std::system_category(), std::string{"Renaming cache file '"} + tmp_filename + "' to '" + filename + "' failed"};
+    }
+}
+
+osmium::memory::Buffer read_coastline_cache(const std::string& filename) {
+    const int fd = ::open(filename.c_str(), O_RDONLY); // NOLINT(hicpp-signed-bitwise)
+    if (fd == -1) {
+        throw std::system_error{errno, std::system_category(), std::string{"Opening cache file '"} + filename + "' failed"};
+    }
+
+    struct stat s; // NOLINT(cppcoreguidelines-pro-type-member-init, hicpp-member-init)
+    if (::fstat(fd, &s) != 0) {
+        ::close(fd);
+        throw std::system_error{errno, std::system_category(), std::string{"Can't get file size for '"} + filename + "'"};
+    }
+    const auto file_size = static_cast<std::size_t>(s.st_size);
+
+    if (file_size < sizeof(coastline_cache_header)) {
+        ::close(fd);
+        throw std::runtime_error{std::string{"File '"} + filename + "' is not a coastline cache file"};
+    }
+
+    osmium::util::MemoryMapping mapping{file_size, osmium::util::MemoryMapping::mapping_mode::readonly, fd};
+    ::close(fd);
+
+    const auto* header = mapping.get_addr<coastline_cache_header>();
+    if (std::memcmp(header->magic, coastline_cache_magic, sizeof(header->magic)) != 0) {
+        throw std::runtime_error{std::string{"File '"} + filename + "' is not a coastline cache file"};
+    }
+    if (header->version != coastline_cache_version) {
+        throw std::runtime_error{std::string{"Coastline cache file '"} + filename + "' has unsupported version " + std::to_string(header->version)};
+    }
+
+    // The counts come from the file, check them against the file size
+    // before multiplying, so large values can't overflow.
+    const std::size_t data_size = file_size - sizeof(coastline_cache_header);
+    if (header->num_ways > data_size / sizeof(coastline_cache_way)) {
+        throw std::runtime_error{std::string{"Coastline cache file '"} + filename + "' is truncated or corrupt"};
+    }
+    const std::size_t nodes_size = data_size - header->num_ways * sizeof(coastline_cache_way);
+    if (header->num_nodes != nodes_size / sizeof(osmium::NodeRef) ||
+        nodes_size % sizeof(osmium::NodeRef) != 0) {
+        throw std::runtime_error{std::string{"Coastline cache file '"} + filename + "' is truncated or corrupt"};
+    }
+
+    const auto* cache_ways = reinterpret_cast<const coastline_cache_way*>(header + 1);
+    const auto* node_refs = reinterpret_cast<const osmium::NodeRef*>(cache_ways + header->num_ways);
+
+    osmium::memory::Buffer buffer{sizeof(osmium::Way) * header->num_ways +
+                                  sizeof(osmium::NodeRef) * header->num_nodes +
+                                  1024,
+                                  osmium::memory::Buffer::auto_grow::yes};
+
+    uint64_t nodes_seen = 0;
+    for (uint64_t i = 0; i < header->num_ways; ++i) {
+        if (cache_ways[i].num_nodes == 0 || cache_ways[i].num_nodes > header->num_nodes - nodes_seen) {
+            throw std::runtime_error{std::string{"Coastline cache file '"} + filename + "' is corrupt"};
+        }
+        {
+            osmium::builder::WayBuilder builder{buffer};
+            builder.set_id(cache_ways[i].id);
+            osmium::builder::WayNodeListBuilder wnl_builder{builder};
+            for (uint64_t n = 0; n < cache_ways[i].num_nodes; ++n) {
+                wnl_builder.add_node_ref(node_refs[nodes_seen + n]);
+            }
+        }
+        buffer.commit();
+        nodes_seen += cache_ways[i].num_nodes;
+    }
+
+    return buffer;
+}
@@ -0,0 +1,96 @@
+#ifndef COASTLINE_CACHE_HPP
+#define COASTLINE_CACHE_HPP
+
+/*
+
+  Copyright 2012-2021 Jochen Topf <jochen@topf.org>.
+
+  This file is part of OSMCoastline.
+
+  OSMCoastline is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  OSMCoastline is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with OSMCoastline.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include <osmium/memory/buffer.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+class LocationMap;
+
+/**
+ * The coastline cache file contains all coastline ways with their node
+ * IDs and node locations. It allows running osmcoastline again without
+ * reading the OSM input file.
+ *
+ * The file is written in native byte order and can be memory mapped. It
+ * has the following layout:
+ *
+ * - The header (struct coastline_cache_header).
+ * - One struct coastline_cache_way for each way.
+ * - One osmium::NodeRef (node ID and location) for each node of each way
+ *   in the same order as the ways.
+ */
+struct coastline_cache_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t num_ways;
+    uint64_t num_nodes;
+};
+
+struct coastline_cache_way {
+    int64_t id;
+    uint64_t num_nodes;
+};
+
+/// Magic bytes at the beginning of a coastline cache file.
+constexpr const char* coastline_cache_magic = "OSMCOAST";
+
+/// Version of the coastline cache file format.
+constexpr const uint32_t coastline_cache_version = 1;
+
+/**
+ * Add the slots for the locations of all nodes of all ways in the buffer
+ * to the locmap. This is used to fill in the locations of ways we keep
+ * around for writing into the cache.
+ */
+void add_way_locations_to_locmap(osmium::memory::Buffer& ways, LocationMap& locmap);
+
+/**
+ * Add the slots for the locations of the nodes of all ways in the buffer
+ * which don't have a valid location yet to the locmap. Returns the number
+ * of slots added.
+ */
+std::size_t add_missing_way_locations_to_locmap(osmium::memory::Buffer& ways, LocationMap& locmap);
+
+/**
+ * Write all ways in the buffer to a coastline cache file. The data goes
+ * into a temporary file first which is renamed to the filename when it is
+ * complete.
+ *
+ * @throws std::system_error If the file can not be written.
+ */
+void write_coastline_cache(const std::string& filename, const osmium::memory::Buffer& ways);
+
+/**
+ * Read all ways from a coastline cache file into a buffer.
+ *
+ * @throws std::system_error If the file can not be read.
+ * @throws std::runtime_error If the file is not a valid cache file.
+ */
+osmium::memory::Buffer read_coastline_cache(const std::string& filename);
+
+#endif // COASTLINE_CACHE_HPP
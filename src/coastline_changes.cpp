@@ -0,0 +1,170 @@
+/*
+
+  Copyright 2012-2021 Jochen Topf <jochen@topf.org>.
+
+  This file is part of OSMCoastline.
+
+  OSMCoastline is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  OSMCoastline is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with OSMCoastline.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include "coastline_changes.hpp"
+
+#include <osmium/osm/node_ref.hpp>
+
+#include <algorithm>
+#include <utility>
+
+namespace {
+
+    template <typename T>
+    bool compare_id_version(const T& lhs, const T& rhs) noexcept {
+        return std::make_pair(lhs.id, lhs.version) < std::make_pair(rhs.id, rhs.version);
+    }
+
+    template <typename T>
+    bool compare_id(const T& lhs, osmium::object_id_type id) noexcept {
+        return lhs.id < id;
+    }
+
+    /**
+     * Sort the changes by ID and version and only keep the last (newest)
+     * change for each ID.
+     */
+    template <typename T>
+    void keep_newest(std::vector<T>& changes) {
+        std::stable_sort(changes.begin(), changes.end(), compare_id_version<T>);
+        const auto last = std::unique(changes.rbegin(), changes.rend(), [](const T& lhs, const T& rhs) {
+            return lhs.id == rhs.id;
+        });
+        changes.erase(changes.begin(), last.base());
+    }
+
+    template <typename T>
+    const T* find_change(const std::vector<T>& changes, osmium::object_id_type id) noexcept {
+        const auto it = std::lower_bound(changes.cbegin(), changes.cend(), id, compare_id<T>);
+        if (it == changes.cend() || it->id != id) {
+            return nullptr;
+        }
+        return &*it;
+    }
+
+    using location_index_type = std::vector<std::pair<osmium::object_id_type, osmium::Location>>;
+
+    location_index_type create_location_index(const osmium::memory::Buffer& ways) {
+        location_index_type index;
+
+        for (const auto& way : ways.select<osmium::Way>()) {
+            for (const auto& node_ref : way.nodes()) {
+                index.emplace_back(node_ref.ref(), node_ref.location());
+            }
+        }
+
+        std::sort(index.begin(), index.end(), [](const location_index_type::value_type& lhs, const location_index_type::value_type& rhs) {
+            return lhs.first < rhs.first;
+        });
+
+        return index;
+    }
+
+    osmium::Location find_location(const location_index_type& index, osmium::object_id_type id) noexcept {
+        const auto it = std::lower_bound(index.cbegin(), index.cend(), id, [](const location_index_type::value_type& lhs, osmium::object_id_type rhs) {
+            return lhs.first < rhs;
+        });
+        if (it == index.cend() || it->first != id) {
+            return osmium::Location{};
+        }
+        return it->second;
+    }
+
+} // anonymous namespace
+
+void CoastlineChanges::add_node(const osmium::Node& node) {
+    if (node.visible()) {
+        m_nodes.push_back(node_change{node.id(), node.version(), node.location()});
+    }
+}
+
+void CoastlineChanges::add_way(const osmium::Way& way, bool is_coastline) {
+    const bool keep = is_coastline && way.visible() && !way.nodes().empty();
+    std::size_t offset = 0;
+    if (keep) {
+        offset = m_buffer.committed();
+        m_buffer.add_item(way);
+        m_buffer.commit();
+    }
+    m_ways.push_back(way_change{way.id(), way.version(), offset, keep});
+}
+
+void CoastlineChanges::normalize() {
+    keep_newest(m_nodes);
+    keep_newest(m_ways);
+}
+
+osmium::memory::Buffer CoastlineChanges::apply(const osmium::memory::Buffer& ways) {
+    normalize();
+
+    osmium::memory::Buffer out{ways.committed() + m_buffer.committed() + 1024, osmium::memory::Buffer::auto_grow::yes};
+
+    for (const auto& way : ways.select<osmium::Way>()) {
+        if (find_change(m_ways, way.id())) {
+            ++m_ways_removed;
+            continue;
+        }
+
+        auto& new_way = out.add_item(way);
+        out.commit();
+
+        bool moved = false;
+        for (auto& node_ref : new_way.nodes()) {
+            const auto* change = find_change(m_nodes, node_ref.ref());
+            if (change && change->location != node_ref.location()) {
+                node_ref.set_location(change->location);
+                moved = true;
+            }
+        }
+        if (moved) {
+            ++m_ways_with_moved_nodes;
+        }
+    }
+
+    // Only build the index of old locations if we need it for new ways.
+    location_index_type old_locations;
+    if (std::any_of(m_ways.cbegin(), m_ways.cend(), [](const way_change& change) {
+        return change.is_coastline;
+    })) {
+        old_locations = create_location_index(ways);
+    }
+
+    for (const auto& change : m_ways) {
+        if (!change.is_coastline) {
+            continue;
+        }
+
+        auto& new_way = out.add_item(m_buffer.get<osmium::Way>(change.offset));
+        out.commit();
+        ++m_ways_added;
+
+        for (auto& node_ref : new_way.nodes()) {
+            const auto* node = find_change(m_nodes, node_ref.ref());
+            if (node) {
+                node_ref.set_location(node->location);
+            } else if (!node_ref.location().valid()) {
+                node_ref.set_location(find_location(old_locations, node_ref.ref()));
+            }
+        }
+    }
+
+    return out;
+}
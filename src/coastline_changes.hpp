@@ -0,0 +1,123 @@
+#ifndef COASTLINE_CHANGES_HPP
+#define COASTLINE_CHANGES_HPP
+
+/*
+
+  Copyright 2012-2021 Jochen Topf <jochen@topf.org>.
+
+  This file is part of OSMCoastline.
+
+  OSMCoastline is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  OSMCoastline is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with OSMCoastline.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include <osmium/memory/buffer.hpp>
+#include <osmium/osm/location.hpp>
+#include <osmium/osm/node.hpp>
+#include <osmium/osm/types.hpp>
+#include <osmium/osm/way.hpp>
+
+#include <cstddef>
+#include <vector>
+
+/**
+ * Collects the changes from an OSM change file that are relevant for the
+ * coastline and applies them to a buffer with coastline ways (usually read
+ * from a cache file).
+ *
+ * Changes are first collected with add_node() and add_way(). If an object
+ * is in the change file several times, only the version with the highest
+ * version number is used. Then apply() creates the updated set of coastline
+ * ways.
+ */
+class CoastlineChanges {
+
+    struct node_change {
+        osmium::object_id_type id;
+        osmium::object_version_type version;
+        osmium::Location location;
+    };
+
+    struct way_change {
+        osmium::object_id_type id;
+        osmium::object_version_type version;
+
+        // Offset of the way in m_buffer, only valid if is_coastline is set.
+        std::size_t offset;
+
+        // Is this way (still) a coastline way after this change?
+        bool is_coastline;
+    };
+
+    // Copies of all changed ways that are coastline ways after the change.
+    osmium::memory::Buffer m_buffer{1024 * 1024, osmium::memory::Buffer::auto_grow::yes};
+
+    std::vector<node_change> m_nodes;
+    std::vector<way_change> m_ways;
+
+    std::size_t m_ways_added = 0;
+    std::size_t m_ways_removed = 0;
+    std::size_t m_ways_with_moved_nodes = 0;
+
+    void normalize();
+
+public:
+
+    /**
+     * Add a node from the change file. Deleted nodes are ignored, they
+     * must have been removed from all ways that reference them anyway.
+     */
+    void add_node(const osmium::Node& node);
+
+    /**
+     * Add a way from the change file. The is_coastline parameter tells us
+     * whether the way is a coastline way. Deleted ways are always treated
+     * as non-coastline ways.
+     */
+    void add_way(const osmium::Way& way, bool is_coastline);
+
+    /**
+     * Apply the changes to the coastline ways in the buffer and return a
+     * new buffer with the updated coastline ways:
+     *
+     * - Ways that are not in the change file are copied over, the locations
+     *   of their nodes are updated if the change file contains those nodes.
+     * - Ways that are in the change file and are no coastline ways any
+     *   more (because they were deleted or retagged) are removed.
+     * - Ways that are in the change file and are coastline ways are added
+     *   (or replace the old version). The locations of their nodes are
+     *   taken from the change file or, if the node is not in there, from
+     *   the old coastline ways. If a location can not be found, it stays
+     *   undefined.
+     */
+    osmium::memory::Buffer apply(const osmium::memory::Buffer& ways);
+
+    /// The number of new or modified coastline ways.
+    std::size_t ways_added() const noexcept {
+        return m_ways_added;
+    }
+
+    /// The number of coastline ways removed or replaced by a new version.
+    std::size_t ways_removed() const noexcept {
+        return m_ways_removed;
+    }
+
+    /// The number of unchanged ways which have nodes that were moved.
+    std::size_t ways_with_moved_nodes() const noexcept {
+        return m_ways_with_moved_nodes;
+    }
+
+}; // class CoastlineChanges
+
+#endif // COASTLINE_CHANGES_HPP
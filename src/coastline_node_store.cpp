@@ -0,0 +1,85 @@
+/*
+
+  Copyright 2012-2021 Jochen Topf <jochen@topf.org>.
+
+  This file is part of OSMCoastline.
+
+  OSMCoastline is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  OSMCoastline is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with OSMCoastline.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include "coastline_node_store.hpp"
+#include "location_map.hpp"
+
+#include <algorithm>
+
+constexpr const std::size_t CoastlineNodeStore::default_chunk_size;
+
+CoastlineNodeStore::chunk& CoastlineNodeStore::space_for(std::size_t count) {
+    if (m_chunks.empty() || m_chunks.back().capacity - m_chunks.back().size < count) {
+        m_chunks.emplace_back(std::max(count, default_chunk_size), m_has_ids);
+    }
+    return m_chunks.back();
+}
+
+CoastlineNodeStore::range CoastlineNodeStore::append(const osmium::NodeRef* begin, const osmium::NodeRef* end, osmium::object_id_type way_id) {
+    const auto count = static_cast<std::size_t>(end - begin);
+    chunk& c = space_for(count);
+
+    const range r{static_cast<uint32_t>(m_chunks.size() - 1),
+                  static_cast<uint32_t>(c.size),
+                  static_cast<uint32_t>(c.size + count),
+                  false,
+                  way_id};
+
+    for (std::size_t n = c.size; begin != end; ++begin, ++n) {
+        if (m_has_ids) {
+            c.ids[n] = begin->ref();
+        }
+        c.locations[n] = begin->location();
+    }
+    c.size += count;
+
+    return r;
+}
+
+CoastlineNodeStore::range CoastlineNodeStore::append(osmium::object_id_type id, const osmium::Location& location) {
+    const osmium::NodeRef node_ref{id, location};
+    return append(&node_ref, &node_ref + 1, 0);
+}
+
+std::size_t CoastlineNodeStore::size() const noexcept {
+    std::size_t count = 0;
+    for (const auto& c : m_chunks) {
+        count += c.size;
+    }
+    return count;
+}
+
+void CoastlineNodeStore::setup_locations(LocationMap& locmap) {
+    assert(m_has_ids);
+    locmap.reserve(locmap.size() + size());
+    for (auto& c : m_chunks) {
+        for (std::size_t n = 0; n < c.size; ++n) {
+            locmap.add(c.ids[n], &c.locations[n]);
+        }
+    }
+}
+
+void CoastlineNodeStore::drop_ids() noexcept {
+    for (auto& c : m_chunks) {
+        c.ids.reset();
+    }
+    m_has_ids = false;
+}
@@ -0,0 +1,151 @@
+#ifndef COASTLINE_NODE_STORE_HPP
+#define COASTLINE_NODE_STORE_HPP
+
+/*
+
+  Copyright 2012-2021 Jochen Topf <jochen@topf.org>.
+
+  This file is part of OSMCoastline.
+
+  OSMCoastline is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  OSMCoastline is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with OSMCoastline.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include <osmium/osm/location.hpp>
+#include <osmium/osm/node_ref.hpp>
+#include <osmium/osm/types.hpp>
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class LocationMap;
+
+/**
+ * Storage for the node IDs and locations of all nodes in all coastline
+ * rings. This is an arena shared by all rings, the rings themselves only
+ * keep a list of ranges of nodes in this store.
+ *
+ * The store is made up of chunks, each chunk has an array of node IDs and
+ * a separate array of locations. The node IDs are only needed until all
+ * locations have been found, they can be released with drop_ids()
+ * afterwards to save memory.
+ *
+ * Nodes are never moved once they are in the store. So pointers to the
+ * locations stay valid and can be put into a LocationMap.
+ */
+class CoastlineNodeStore {
+
+public:
+
+    /**
+     * A range of consecutive nodes in the store. A range never crosses
+     * a chunk boundary.
+     */
+    struct range {
+        uint32_t chunk;
+        uint32_t begin;
+        uint32_t end;
+
+        /**
+         * Does the segment from the last node of this range to the first
+         * node of the next range in a ring belong to the way of this range?
+         * Otherwise it belongs to the way of the next range.
+         */
+        bool owns_next_segment;
+
+        /// ID of the way the nodes are from (0 if they were added to fix a ring).
+        osmium::object_id_type way_id;
+
+        uint32_t size() const noexcept {
+            return end - begin;
+        }
+    };
+
+private:
+
+    static constexpr const std::size_t default_chunk_size = 64 * 1024;
+
+    struct chunk {
+        std::unique_ptr<osmium::object_id_type[]> ids;
+        std::unique_ptr<osmium::Location[]> locations;
+        std::size_t capacity;
+        std::size_t size = 0;
+
+        chunk(std::size_t cap, bool with_ids) :
+            ids(with_ids ? new osmium::object_id_type[cap] : nullptr),
+            locations(new osmium::Location[cap]),
+            capacity(cap) {
+        }
+    };
+
+    std::vector<chunk> m_chunks;
+
+    bool m_has_ids = true;
+
+    /// Make sure there is room for count nodes in the last chunk.
+    chunk& space_for(std::size_t count);
+
+public:
+
+    CoastlineNodeStore() = default;
+
+    CoastlineNodeStore(const CoastlineNodeStore&) = delete;
+    CoastlineNodeStore& operator=(const CoastlineNodeStore&) = delete;
+
+    CoastlineNodeStore(CoastlineNodeStore&&) = delete;
+    CoastlineNodeStore& operator=(CoastlineNodeStore&&) = delete;
+
+    ~CoastlineNodeStore() noexcept = default;
+
+    /// Append the node refs from the range (from way way_id) to the store.
+    range append(const osmium::NodeRef* begin, const osmium::NodeRef* end, osmium::object_id_type way_id);
+
+    /// Append a single node (not from any way) to the store.
+    range append(osmium::object_id_type id, const osmium::Location& location);
+
+    /// Are the node IDs still available?
+    bool has_ids() const noexcept {
+        return m_has_ids;
+    }
+
+    const osmium::object_id_type* ids(const range& r) const noexcept {
+        assert(m_has_ids);
+        return m_chunks[r.chunk].ids.get() + r.begin;
+    }
+
+    const osmium::Location* locations(const range& r) const noexcept {
+        return m_chunks[r.chunk].locations.get() + r.begin;
+    }
+
+    /// The total number of nodes in the store.
+    std::size_t size() const noexcept;
+
+    /**
+     * Add the slots for the locations of all nodes in the store to the
+     * locmap.
+     */
+    void setup_locations(LocationMap& locmap);
+
+    /**
+     * Release the memory used for the node IDs. After this IDs of newly
+     * added nodes are not stored any more.
+     */
+    void drop_ids() noexcept;
+
+}; // class CoastlineNodeStore
+
+#endif // COASTLINE_NODE_STORE_HPP
@@ -21,21 +21,36 @@
 
 #include "coastline_polygons.hpp"
 #include "output_database.hpp"
+#include "parallel.hpp"
+#include "polygon_clipping.hpp"
+#include "polygon_validation.hpp"
 #include "srs.hpp"
 #include "util.hpp"
 
+#include <osmium/thread/pool.hpp>
+
 #include <ogr_geometry.h>
 
 class OGRSpatialReference;
 
+#include <algorithm>
 #include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
 #include <iostream>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <numeric>
+#include <tuple>
+#include <utility>
 #include <vector>
 
 extern SRS srs;
 extern bool debug;
 
-static std::unique_ptr<OGRPolygon> create_rectangular_polygon(double x1, double y1, double x2, double y2, double expand) {
+static OGREnvelope expanded_envelope(double x1, double y1, double x2, double y2, double expand) {
     OGREnvelope e;
 
     e.MinX = x1 - expand;
@@ -46,6 +61,12 @@ static std::unique_ptr<OGRPolygon> create_rectangular_polygon(double x1, double
     // make sure we are inside the bounds for the output SRS
     e.Intersect(srs.max_extent());
 
+    return e;
+}
+
+static std::unique_ptr<OGRPolygon> create_rectangular_polygon(double x1, double y1, double x2, double y2, double expand) {
+    const OGREnvelope e = expanded_envelope(x1, y1, x2, y2, expand);
+
     std::unique_ptr<OGRLinearRing> ring{new OGRLinearRing()};
     ring->addPoint(e.MinX, e.MinY);
     ring->addPoint(e.MinX, e.MaxY);
@@ -60,49 +81,41 @@ static std::unique_ptr<OGRPolygon> create_rectangular_polygon(double x1, double
     return polygon;
 }
 
-static bool add_segment_to_line(OGRLineString* line, OGRPoint* point1, OGRPoint* point2) {
+static bool add_segment_to_line(OGRLineString* line, double x1, double y1, double x2, double y2) {
     // segments along southern edge of the map are not added to line output
-    if (point1->getY() < srs.min_y() && point2->getY() < srs.min_y()) {
+    if (y1 < srs.min_y() && y2 < srs.min_y()) {
         if (debug) {
-            std::cerr << "Suppressing segment (" << point1->getX() << " " << point1->getY() << ", " << point2->getX() << " " << point2->getY() << ") near southern edge of map.\n";
+            std::cerr << "Suppressing segment (" << x1 << " " << y1 << ", " << x2 << " " << y2 << ") near southern edge of map.\n";
         }
         return false;
     }
 
     // segments along antimeridian are not added to line output
-    if ((point1->getX() > srs.max_x() && point2->getX() > srs.max_x()) ||
-        (point1->getX() < srs.min_x() && point2->getX() < srs.min_x())) {
+    if ((x1 > srs.max_x() && x2 > srs.max_x()) ||
+        (x1 < srs.min_x() && x2 < srs.min_x())) {
         if (debug) {
-            std::cerr << "Suppressing segment (" << point1->getX() << " " << point1->getY() << ", " << point2->getX() << " " << point2->getY() << ") near antimeridian.\n";
+            std::cerr << "Suppressing segment (" << x1 << " " << y1 << ", " << x2 << " " << y2 << ") near antimeridian.\n";
         }
         return false;
     }
 
     if (line->getNumPoints() == 0) {
-        line->addPoint(point1);
+        line->addPoint(x1, y1);
     }
-    line->addPoint(point2);
+    line->addPoint(x2, y2);
     return true;
 }
 
 unsigned int CoastlinePolygons::fix_direction() {
     unsigned int warnings = 0;
 
-    for (const auto& polygon : m_polygons) {
-        OGRLinearRing* er = polygon->getExteriorRing();
-        assert(er);
-        if (!er->isClockwise()) {
-            er->reverseWindingOrder();
-            // Workaround for bug in OGR: reverseWindingOrder sets dimensions to 3
-            er->setCoordinateDimension(2);
-            for (int i = 0; i < polygon->getNumInteriorRings(); ++i) {
-                OGRLinearRing* ir = polygon->getInteriorRing(i);
-                assert(ir);
-                ir->reverseWindingOrder();
-                // Workaround for bug in OGR: reverseWindingOrder sets dimensions to 3
-                ir->setCoordinateDimension(2);
+    for (auto& polygon : m_polygons) {
+        assert(polygon.num_rings() > 0);
+        if (!polygon.is_clockwise(0)) {
+            for (std::size_t ring = 0; ring < polygon.num_rings(); ++ring) {
+                polygon.reverse_ring(ring);
             }
-            m_output.add_error_line(make_unique_ptr_clone<OGRLineString>(er), "direction");
+            m_output.add_error_line(polygon.ogr_linestring(0, srs.wgs84()), "direction");
             warnings++;
         }
     }
@@ -111,40 +124,215 @@ unsigned int CoastlinePolygons::fix_direction() {
 }
 
 void CoastlinePolygons::transform() {
-    for (const auto& polygon : m_polygons) {
-        srs.transform(polygon.get());
+    for (auto& polygon : m_polygons) {
+        srs.transform(polygon);
     }
 }
 
-void CoastlinePolygons::split_geometry(std::unique_ptr<OGRGeometry>&& geom, int level) {
-    if (geom->getGeometryType() == wkbPolygon) {
-        geom->assignSpatialReference(srs.out());
-        split_polygon(static_cast_unique_ptr<OGRPolygon>(std::move(geom)), level);
-    } else if (geom->getGeometryType() == wkbMultiPolygon) {
-        const auto mp = static_cast_unique_ptr<OGRMultiPolygon>(std::move(geom));
-        while (mp->getNumGeometries() > 0) {
-            std::unique_ptr<OGRPolygon> polygon{static_cast<OGRPolygon*>(mp->getGeometryRef(0))};
-            mp->removeGeometry(0, false);
-            polygon->assignSpatialReference(srs.out());
-            split_polygon(std::move(polygon), level);
+/**
+ * Add the parts of the polygon inside the rectangle (expanded by expand)
+ * to the parts vector. The rectangle must cover the polygon on the axis
+ * not given, so the polygon only has to be clipped on the given axis. This
+ * is done with the fast clipper, GEOS (through OGR) is only used if the
+ * clipper can't handle the polygon.
+ */
+static bool clip_to_rectangle(const Polygon& polygon, clip_axis axis, double x1, double y1, double x2, double y2, double expand, polygon_vector_type& parts) {
+    const OGREnvelope e = expanded_envelope(x1, y1, x2, y2, expand);
+    const OGREnvelope envelope = polygon.envelope();
+
+    const bool x_axis = axis == clip_axis::x;
+    if (x_axis ? (e.MinY <= envelope.MinY && envelope.MaxY <= e.MaxY)
+               : (e.MinX <= envelope.MinX && envelope.MaxX <= e.MaxX)) {
+        const double rect_min = x_axis ? e.MinX : e.MinY;
+        const double rect_max = x_axis ? e.MaxX : e.MaxY;
+
+        // Boundaries outside the polygon are left out, so points of the
+        // polygon on them are not a problem for the clipper.
+        constexpr const double inf = std::numeric_limits<double>::infinity();
+        const double min = rect_min <= (x_axis ? envelope.MinX : envelope.MinY) ? -inf : rect_min;
+        const double max = (x_axis ? envelope.MaxX : envelope.MaxY) <= rect_max ? inf : rect_max;
+
+        if (clip_polygon(polygon, axis, min, max, parts)) {
+            return true;
         }
-    } else {
-        assert(false);
+        if (debug) {
+            std::cerr << "DEBUG clipping polygon failed, using GEOS\n";
+        }
+    }
+
+    const auto rectangle = create_rectangular_polygon(x1, y1, x2, y2, expand);
+    std::unique_ptr<OGRGeometry> geom{polygon.ogr_polygon(srs.out())->Intersection(rectangle.get())};
+    if (geom && add_ogr_geometry(*geom, parts)) {
+        return true;
     }
+
+    if (debug) {
+        std::cerr << "DEBUG geom=" << geom.get() << "\n";
+        if (geom) {
+            std::cerr << "DEBUG geom type=" << geom->getGeometryName() << "\n";
+            if (geom->getGeometryType() == wkbGeometryCollection) {
+                std::cerr << "DEBUG   numGeometries=" << static_cast<OGRGeometryCollection*>(geom.get())->getNumGeometries() << "\n";
+            }
+        }
+    }
+
+    return false;
 }
 
-void CoastlinePolygons::split_polygon(std::unique_ptr<OGRPolygon>&& polygon, int level) {
-    if (level > m_max_split_depth) {
-        m_max_split_depth = level;
+namespace {
+
+    /**
+     * Find the positions where the coordinates have to be cut to
+     * get num parts with about the same number of coordinates. The cuts are
+     * halfway between neighbouring coordinates. Cuts less than min_distance
+     * away from the previous cut or from the ends are left out.
+     */
+    std::vector<double> find_cuts(std::vector<double>&& coords, std::size_t num, double min_distance) {
+        std::sort(coords.begin(), coords.end());
+
+        std::vector<double> cuts;
+        double last = coords.front();
+        for (std::size_t n = 1; n < num; ++n) {
+            auto index = coords.size() * n / num;
+            // Cuts can't be between the same coordinates, use the next
+            // larger one.
+            while (index < coords.size() && coords[index] == coords[index - 1]) {
+                ++index;
+            }
+            if (index == coords.size()) {
+                break;
+            }
+            const double cut = (coords[index - 1] + coords[index]) / 2;
+            if (cut - last > min_distance && coords.back() - cut > min_distance) {
+                cuts.push_back(cut);
+                last = cut;
+            }
+        }
+        return cuts;
     }
 
-    const int num_points = polygon->getExteriorRing()->getNumPoints();
-    if (num_points <= m_max_points_in_polygon) {
-        // do not split the polygon if it is small enough
-        m_polygons.push_back(std::move(polygon));
-    } else {
-        OGREnvelope envelope;
-        polygon->getEnvelope(&envelope);
+    /// The slabs between the cuts, expanded by expand on each side.
+    std::vector<std::pair<double, double>> slabs_between(const std::vector<double>& cuts, double expand) {
+        constexpr const double inf = std::numeric_limits<double>::infinity();
+        std::vector<std::pair<double, double>> slabs;
+        slabs.reserve(cuts.size() + 1);
+        for (std::size_t n = 0; n <= cuts.size(); ++n) {
+            slabs.emplace_back(n == 0 ? -inf : cuts[n - 1] - expand,
+                               n == cuts.size() ? inf : cuts[n] + expand);
+        }
+        return slabs;
+    }
+
+    /// The coordinates of the outer ring (without the closing point).
+    std::vector<double> outer_ring_coordinates(const Polygon& polygon, clip_axis axis) {
+        std::vector<double> coords;
+        coords.reserve(polygon.ring_size(0) - 1);
+        for (std::size_t n = polygon.ring_begin(0) + 1; n < polygon.ring_end(0); ++n) {
+            coords.push_back(axis == clip_axis::x ? polygon.x(n) : polygon.y(n));
+        }
+        return coords;
+    }
+
+    /**
+     * Find the position halfway between the median of the coordinates of
+     * the outer ring and the next larger coordinate. Returns false if there
+     * is no such position at least min_distance away from the ends, cut is
+     * not changed then.
+     */
+    bool find_median_cut(const Polygon& polygon, clip_axis axis, double min, double max, double min_distance, double& cut) {
+        auto coords = outer_ring_coordinates(polygon, axis);
+        const auto median = coords.begin() + coords.size() / 2;
+        std::nth_element(coords.begin(), median, coords.end());
+
+        // All coordinates after the median are at least as large.
+        double next = std::numeric_limits<double>::infinity();
+        for (auto it = median + 1; it != coords.end(); ++it) {
+            if (*it > *median && *it < next) {
+                next = *it;
+            }
+        }
+        if (next == std::numeric_limits<double>::infinity()) {
+            return false;
+        }
+
+        const double position = (*median + next) / 2;
+        if (position - min <= min_distance || max - position <= min_distance) {
+            return false;
+        }
+
+        cut = position;
+        return true;
+    }
+
+} // anonymous namespace
+
+bool CoastlinePolygons::split_polygon_into_cells(const Polygon& polygon, polygon_vector_type& parts) const {
+    // Aim for cells with half the maximum number of points, so that cells
+    // with more points than average and the points added at the cuts
+    // still fit.
+    const std::size_t points_per_cell = std::max(m_max_points_in_polygon / 2, 2);
+    const auto num_cells = [points_per_cell](const Polygon& p) {
+        return (p.ring_size(0) + points_per_cell - 1) / points_per_cell;
+    };
+
+    // Choose the number of columns so that the cells are roughly square.
+    const OGREnvelope envelope = polygon.envelope();
+    const auto cells = num_cells(polygon);
+    const double width = envelope.MaxX - envelope.MinX;
+    const double height = envelope.MaxY - envelope.MinY;
+    std::size_t num_columns = cells;
+    if (height > 0) {
+        const auto columns = static_cast<std::size_t>(std::lround(std::sqrt(static_cast<double>(cells) * width / height)));
+        num_columns = std::min(std::max(columns, static_cast<std::size_t>(1)), cells);
+    }
+
+    const auto column_cuts = find_cuts(outer_ring_coordinates(polygon, clip_axis::x), num_columns, 2 * m_expand);
+    std::vector<polygon_vector_type> columns;
+    if (!clip_polygon_to_slabs(polygon, clip_axis::x, slabs_between(column_cuts, m_expand), columns)) {
+        return false;
+    }
+
+    // The rows are placed in each column separately.
+    bool has_cuts = !column_cuts.empty();
+    polygon_vector_type result;
+    std::vector<polygon_vector_type> rows;
+    for (auto& column : columns) {
+        for (auto& piece : column) {
+            if (static_cast<int>(piece.ring_size(0)) <= m_max_points_in_polygon) {
+                result.push_back(std::move(piece));
+                continue;
+            }
+
+            const auto row_cuts = find_cuts(outer_ring_coordinates(piece, clip_axis::y), num_cells(piece), 2 * m_expand);
+            if (row_cuts.empty()) {
+                result.push_back(std::move(piece));
+                continue;
+            }
+
+            if (!clip_polygon_to_slabs(piece, clip_axis::y, slabs_between(row_cuts, m_expand), rows)) {
+                return false;
+            }
+            has_cuts = true;
+            for (auto& row : rows) {
+                std::move(row.begin(), row.end(), std::back_inserter(result));
+            }
+        }
+    }
+
+    if (!has_cuts) {
+        return false;
+    }
+
+    std::move(result.begin(), result.end(), std::back_inserter(parts));
+    return true;
+}
+
+polygon_vector_type CoastlinePolygons::split_polygon(const Polygon& polygon, int level) const {
+    polygon_vector_type parts;
+
+    const auto num_points = static_cast<int>(polygon.ring_size(0));
+    if (num_points > m_max_points_in_polygon) {
+        const OGREnvelope envelope = polygon.envelope();
         if (debug) {
             std::cerr << "DEBUG: split_polygon(): depth="
                       << level
@@ -157,138 +345,375 @@ void CoastlinePolygons::split_polygon(std::unique_ptr<OGRPolygon>&& polygon, int
                       << "\n";
         }
 
-        // These polygons will contain the bounding box of each half of the "polygon" polygon.
-        std::unique_ptr<OGRPolygon> b1;
-        std::unique_ptr<OGRPolygon> b2;
+        if (m_split_method == split_method_type::cells && split_polygon_into_cells(polygon, parts)) {
+            return parts;
+        }
 
+        bool success = true;
         if (envelope.MaxX - envelope.MinX < envelope.MaxY-envelope.MinY) {
             if (m_expand >= (envelope.MaxY - envelope.MinY) / 4) {
                 std::cerr << "Not splitting polygon with " << num_points << " points on outer ring. It would not get smaller because --bbox-overlap/-b is set to high.\n";
-                m_polygons.push_back(std::move(polygon));
-                return;
+                return parts;
             }
 
             // split vertically
-            const double MidY = (envelope.MaxY + envelope.MinY) / 2;
+            double MidY = (envelope.MaxY + envelope.MinY) / 2;
+            if (m_split_method == split_method_type::median) {
+                find_median_cut(polygon, clip_axis::y, envelope.MinY, envelope.MaxY, 2 * m_expand, MidY);
+            }
 
-            b1 = create_rectangular_polygon(envelope.MinX, envelope.MinY, envelope.MaxX, MidY, m_expand);
-            b2 = create_rectangular_polygon(envelope.MinX, MidY, envelope.MaxX, envelope.MaxY, m_expand);
+            success = clip_to_rectangle(polygon, clip_axis::y, envelope.MinX, envelope.MinY, envelope.MaxX, MidY, m_expand, parts) &&
+                      clip_to_rectangle(polygon, clip_axis::y, envelope.MinX, MidY, envelope.MaxX, envelope.MaxY, m_expand, parts);
         } else {
             if (m_expand >= (envelope.MaxX - envelope.MinX) / 4) {
                 std::cerr << "Not splitting polygon with " << num_points << " points on outer ring. It would not get smaller because --bbox-overlap/-b is set to high.\n";
-                m_polygons.push_back(std::move(polygon));
-                return;
+                return parts;
             }
 
             // split horizontally
-            const double MidX = (envelope.MaxX + envelope.MinX) / 2;
+            double MidX = (envelope.MaxX + envelope.MinX) / 2;
+            if (m_split_method == split_method_type::median) {
+                find_median_cut(polygon, clip_axis::x, envelope.MinX, envelope.MaxX, 2 * m_expand, MidX);
+            }
 
-            b1 = create_rectangular_polygon(envelope.MinX, envelope.MinY, MidX, envelope.MaxY, m_expand);
-            b2 = create_rectangular_polygon(MidX, envelope.MinY, envelope.MaxX, envelope.MaxY, m_expand);
+            success = clip_to_rectangle(polygon, clip_axis::x, envelope.MinX, envelope.MinY, MidX, envelope.MaxY, m_expand, parts) &&
+                      clip_to_rectangle(polygon, clip_axis::x, MidX, envelope.MinY, envelope.MaxX, envelope.MaxY, m_expand, parts);
         }
 
-        // Use intersection with bbox polygons to split polygon into two halfes
-        std::unique_ptr<OGRGeometry> geom1{polygon->Intersection(b1.get())};
-        std::unique_ptr<OGRGeometry> geom2{polygon->Intersection(b2.get())};
-
-        if (geom1 && (geom1->getGeometryType() == wkbPolygon || geom1->getGeometryType() == wkbMultiPolygon) &&
-            geom2 && (geom2->getGeometryType() == wkbPolygon || geom2->getGeometryType() == wkbMultiPolygon)) {
-            // split was successful, go on recursively
-            split_geometry(std::move(geom1), level + 1);
-            split_geometry(std::move(geom2), level + 1);
-        } else {
-            // split was not successful, output some debugging info and keep polygon before split
+        if (!success) {
+            // split was not successful, keep polygon before split
             std::cerr << "Polygon split at depth " << level << " was not successful. Keeping un-split polygon.\n";
-            m_polygons.push_back(std::move(polygon));
-            if (debug) {
-                std::cerr << "DEBUG geom1=" << geom1.get() << " geom2=" << geom2.get() << "\n";
-                if (geom1) {
-                    std::cerr << "DEBUG geom1 type=" << geom1->getGeometryName() << "\n";
-                    if (geom1->getGeometryType() == wkbGeometryCollection) {
-                        std::cerr << "DEBUG   numGeometries=" << static_cast<OGRGeometryCollection*>(geom1.get())->getNumGeometries() << "\n";
-                    }
-                }
-                if (geom2) {
-                    std::cerr << "DEBUG geom2 type=" << geom2->getGeometryName() << "\n";
-                    if (geom2->getGeometryType() == wkbGeometryCollection) {
-                        std::cerr << "DEBUG   numGeometries=" << static_cast<OGRGeometryCollection*>(geom2.get())->getNumGeometries() << "\n";
-                    }
-                }
-            }
+            parts.clear();
         }
     }
+
+    return parts;
 }
 
+namespace {
+
+    /**
+     * A polygon to be split. The path contains the index of the original
+     * polygon and the index of the part on each level of the splitting.
+     * Sorting finished parts by path gives the same order as splitting
+     * them recursively one after the other.
+     */
+    struct split_task {
+        Polygon polygon;
+        std::vector<uint32_t> path;
+    };
+
+    struct split_output {
+        std::vector<split_task> parts;
+        int max_depth = 0;
+    };
+
+} // anonymous namespace
+
 void CoastlinePolygons::split() {
-    polygon_vector_type v;
-    using std::swap;
-    swap(v, m_polygons);
-    m_polygons.reserve(v.size());
-    for (auto& polygon : v) {
-        split_polygon(std::move(polygon), 0);
+    WorkStealingScheduler<split_task> scheduler{m_num_threads};
+    std::vector<split_output> outputs(scheduler.num_workers());
+
+    for (std::size_t n = 0; n < m_polygons.size(); ++n) {
+        scheduler.spawn(n % scheduler.num_workers(), split_task{std::move(m_polygons[n]), {static_cast<uint32_t>(n)}});
+    }
+    m_polygons.clear();
+
+    scheduler.run([&](std::size_t worker, split_task&& task) {
+        auto& output = outputs[worker];
+        const int level = static_cast<int>(task.path.size()) - 1;
+        output.max_depth = std::max(output.max_depth, level);
+
+        auto parts = split_polygon(task.polygon, level);
+        if (parts.empty()) {
+            output.parts.push_back(std::move(task));
+            return;
+        }
+
+        for (std::size_t n = 0; n < parts.size(); ++n) {
+            split_task subtask{std::move(parts[n]), task.path};
+            subtask.path.push_back(static_cast<uint32_t>(n));
+            scheduler.spawn(worker, std::move(subtask));
+        }
+    });
+
+    std::vector<split_task> parts;
+    for (auto& output : outputs) {
+        m_max_split_depth = std::max(m_max_split_depth, output.max_depth);
+        std::move(output.parts.begin(), output.parts.end(), std::back_inserter(parts));
+    }
+
+    std::sort(parts.begin(), parts.end(), [](const split_task& a, const split_task& b) {
+        return a.path < b.path;
+    });
+
+    m_polygons.reserve(parts.size());
+    for (auto& part : parts) {
+        m_polygons.push_back(std::move(part.polygon));
     }
 }
 
-void CoastlinePolygons::output_land_polygons(bool make_copy) {
-    if (make_copy) {
-        // because adding to a layer destroys the geometry, we need to copy it if it is needed later
-        for (const auto& polygon : m_polygons) {
-            m_output.add_land_polygon(make_unique_ptr_clone<OGRPolygon>(polygon.get()));
+namespace {
+
+    /**
+     * The tiles of a zoom level in Web Mercator. Tile x is counted from
+     * the west, tile y from the north as usual for map tiles.
+     */
+    class TileGrid {
+
+        double m_extent;
+        uint32_t m_num_tiles;
+        double m_tile_size;
+
+        uint32_t clamp(double value) const noexcept {
+            if (value < 0) {
+                return 0;
+            }
+            if (value >= m_num_tiles) {
+                return m_num_tiles - 1;
+            }
+            return static_cast<uint32_t>(value);
         }
-    } else {
-        for (auto& polygon : m_polygons) {
-            m_output.add_land_polygon(std::move(polygon));
+
+    public:
+
+        TileGrid(int zoom, const OGREnvelope& extent) :
+            m_extent(extent.MaxX),
+            m_num_tiles(1U << static_cast<uint32_t>(zoom)),
+            m_tile_size(2 * m_extent / m_num_tiles) {
+        }
+
+        /// The number of tiles in each direction.
+        uint32_t num_tiles() const noexcept {
+            return m_num_tiles;
+        }
+
+        double min_x(uint32_t x) const noexcept {
+            return x * m_tile_size - m_extent;
+        }
+
+        double max_x(uint32_t x) const noexcept {
+            return min_x(x + 1);
+        }
+
+        double min_y(uint32_t y) const noexcept {
+            return max_y(y + 1);
+        }
+
+        double max_y(uint32_t y) const noexcept {
+            return m_extent - y * m_tile_size;
+        }
+
+        /// The x of the tile containing the coordinate.
+        uint32_t tile_x(double x) const noexcept {
+            return clamp(std::floor((x + m_extent) / m_tile_size));
+        }
+
+        /// The y of the tile containing the coordinate.
+        uint32_t tile_y(double y) const noexcept {
+            return clamp(std::floor((m_extent - y) / m_tile_size));
+        }
+
+    }; // class TileGrid
+
+    /**
+     * A polygon to be clipped to the tiles. The column is -1 before the
+     * polygon is clipped to the columns of tiles. The path contains the
+     * index of the original polygon and the index of the part after each
+     * clipping step.
+     */
+    struct tile_task {
+        Polygon polygon;
+        int64_t column;
+        std::vector<uint32_t> path;
+    };
+
+    struct tile_part {
+        Polygon polygon;
+        uint32_t x;
+        uint32_t y;
+        std::vector<uint32_t> path;
+    };
+
+    struct tile_output {
+        std::vector<tile_part> parts;
+        unsigned int errors = 0;
+    };
+
+    /**
+     * Clip the polygon to the given ranges of tiles along the axis, each
+     * expanded by expand. The ranges must be sorted. The parts in range n
+     * are returned in element n. Ranges the polygon could not be clipped
+     * to are counted in errors.
+     */
+    std::vector<polygon_vector_type> clip_to_tile_ranges(const Polygon& polygon, clip_axis axis, const std::vector<std::pair<double, double>>& ranges, double expand, unsigned int& errors) {
+        const OGREnvelope envelope = polygon.envelope();
+        const bool x_axis = axis == clip_axis::x;
+        const double min = x_axis ? envelope.MinX : envelope.MinY;
+        const double max = x_axis ? envelope.MaxX : envelope.MaxY;
+
+        // Boundaries outside the polygon are left out, so points of the
+        // polygon on the edge of the map are not a problem for the clipper.
+        constexpr const double inf = std::numeric_limits<double>::infinity();
+        std::vector<std::pair<double, double>> slabs;
+        slabs.reserve(ranges.size());
+        for (const auto& range : ranges) {
+            const double slab_min = range.first - expand;
+            const double slab_max = range.second + expand;
+            slabs.emplace_back(slab_min <= min ? -inf : slab_min, max <= slab_max ? inf : slab_max);
+        }
+
+        std::vector<polygon_vector_type> parts;
+        if (clip_polygon_to_slabs(polygon, axis, slabs, parts)) {
+            return parts;
+        }
+        if (debug) {
+            std::cerr << "DEBUG clipping polygon to tiles failed, clipping tiles one by one\n";
+        }
+
+        parts.assign(ranges.size(), polygon_vector_type{});
+        for (std::size_t n = 0; n < ranges.size(); ++n) {
+            const bool success = x_axis ? clip_to_rectangle(polygon, axis, ranges[n].first, envelope.MinY, ranges[n].second, envelope.MaxY, expand, parts[n])
+                                        : clip_to_rectangle(polygon, axis, envelope.MinX, ranges[n].first, envelope.MaxX, ranges[n].second, expand, parts[n]);
+            if (!success) {
+                std::cerr << "Clipping polygon to tile was not successful. Output data might be incomplete!\n";
+                parts[n].clear();
+                ++errors;
+            }
+        }
+
+        return parts;
+    }
+
+} // anonymous namespace
+
+unsigned int CoastlinePolygons::split_grid(int zoom) {
+    const TileGrid grid{zoom, srs.max_extent()};
+    WorkStealingScheduler<tile_task> scheduler{m_num_threads};
+    std::vector<tile_output> outputs(scheduler.num_workers());
+
+    for (std::size_t n = 0; n < m_polygons.size(); ++n) {
+        scheduler.spawn(n % scheduler.num_workers(), tile_task{std::move(m_polygons[n]), -1, {static_cast<uint32_t>(n)}});
+    }
+    m_polygons.clear();
+
+    // Polygons are first clipped to the columns of the grid, then each
+    // piece is clipped to the tiles in its column as a new task.
+    scheduler.run([&](std::size_t worker, tile_task&& task) {
+        const OGREnvelope envelope = task.polygon.envelope();
+        std::vector<std::pair<double, double>> ranges;
+
+        if (task.column < 0) {
+            const uint32_t first = grid.tile_x(envelope.MinX - m_expand);
+            const uint32_t last = grid.tile_x(envelope.MaxX + m_expand);
+            for (uint32_t x = first; x <= last; ++x) {
+                ranges.emplace_back(grid.min_x(x), grid.max_x(x));
+            }
+
+            auto columns = clip_to_tile_ranges(task.polygon, clip_axis::x, ranges, m_expand, outputs[worker].errors);
+            for (std::size_t c = 0; c < columns.size(); ++c) {
+                for (std::size_t n = 0; n < columns[c].size(); ++n) {
+                    tile_task subtask{std::move(columns[c][n]), static_cast<int64_t>(first + c), task.path};
+                    subtask.path.push_back(static_cast<uint32_t>(n));
+                    scheduler.spawn(worker, std::move(subtask));
+                }
+            }
+            return;
+        }
+
+        // The tile y grows to the south, the ranges have to be sorted
+        // from south to north.
+        const uint32_t first = grid.tile_y(envelope.MaxY + m_expand);
+        const uint32_t last = grid.tile_y(envelope.MinY - m_expand);
+        for (uint32_t y = last + 1; y > first; --y) {
+            ranges.emplace_back(grid.min_y(y - 1), grid.max_y(y - 1));
         }
+
+        auto rows = clip_to_tile_ranges(task.polygon, clip_axis::y, ranges, m_expand, outputs[worker].errors);
+        for (std::size_t r = 0; r < rows.size(); ++r) {
+            for (std::size_t n = 0; n < rows[r].size(); ++n) {
+                tile_part part{std::move(rows[r][n]), static_cast<uint32_t>(task.column), last - static_cast<uint32_t>(r), task.path};
+                part.path.push_back(static_cast<uint32_t>(n));
+                outputs[worker].parts.push_back(std::move(part));
+            }
+        }
+    });
+
+    unsigned int errors = 0;
+    std::vector<tile_part> parts;
+    for (auto& output : outputs) {
+        errors += output.errors;
+        std::move(output.parts.begin(), output.parts.end(), std::back_inserter(parts));
+    }
+
+    std::sort(parts.begin(), parts.end(), [](const tile_part& a, const tile_part& b) {
+        return std::tie(a.x, a.y, a.path) < std::tie(b.x, b.y, b.path);
+    });
+
+    m_zoom = zoom;
+    m_polygons.reserve(parts.size());
+    m_tiles.reserve(parts.size());
+    for (auto& part : parts) {
+        m_polygons.push_back(std::move(part.polygon));
+        m_tiles.emplace_back(part.x, part.y);
+    }
+
+    return errors;
+}
+
+void CoastlinePolygons::output_land_polygons(bool make_copy) {
+    for (std::size_t n = 0; n < m_polygons.size(); ++n) {
+        if (m_zoom < 0) {
+            m_output.add_land_polygon(m_polygons[n].ogr_polygon(srs.out()));
+        } else {
+            m_output.add_land_polygon(m_polygons[n].ogr_polygon(srs.out()), m_tiles[n].first, m_tiles[n].second);
+        }
+    }
+
+    // the polygons are only kept if they are needed later
+    if (!make_copy) {
         m_polygons.clear();
+        m_tiles.clear();
     }
 }
 
-void CoastlinePolygons::add_line_to_output(std::unique_ptr<OGRLineString> line, OGRSpatialReference* srs) const {
+void CoastlinePolygons::add_line_to_output(std::unique_ptr<OGRLineString> line) const {
     line->setCoordinateDimension(2);
-    line->assignSpatialReference(srs);
+    line->assignSpatialReference(srs.out());
     m_output.add_line(std::move(line));
 }
 
 // Add a coastline ring as LineString to output. Segments in this line that are
 // near the southern edge of the map or near the antimeridian are suppressed.
-void CoastlinePolygons::output_polygon_ring_as_lines(int max_points, const OGRLinearRing* ring) const {
-    assert(ring);
-    const int num = ring->getNumPoints();
-    assert(num > 2);
+void CoastlinePolygons::output_polygon_ring_as_lines(int max_points, const Polygon& polygon, std::size_t ring) const {
+    const auto begin = polygon.ring_begin(ring);
+    const auto end = polygon.ring_end(ring);
+    assert(end - begin > 2);
 
-    std::unique_ptr<OGRPoint> point1{new OGRPoint};
-    std::unique_ptr<OGRPoint> point2{new OGRPoint};
     std::unique_ptr<OGRLineString> line{new OGRLineString};
 
-    ring->getPoint(0, point1.get());
-    for (int i = 1; i < num; ++i) {
-        ring->getPoint(i, point2.get());
-
-        const bool added = add_segment_to_line(line.get(), point1.get(), point2.get());
+    for (auto i = begin + 1; i < end; ++i) {
+        const bool added = add_segment_to_line(line.get(), polygon.x(i - 1), polygon.y(i - 1), polygon.x(i), polygon.y(i));
 
         if (line->getNumPoints() >= max_points || !added) {
             if (line->getNumPoints() >= 2) {
                 std::unique_ptr<OGRLineString> new_line{new OGRLineString};
                 using std::swap;
                 swap(line, new_line);
-                add_line_to_output(std::move(new_line), ring->getSpatialReference());
+                add_line_to_output(std::move(new_line));
             }
         }
-
-        point1->setX(point2->getX());
-        point1->setY(point2->getY());
     }
 
     if (line->getNumPoints() >= 2) {
-        add_line_to_output(std::move(line), ring->getSpatialReference());
+        add_line_to_output(std::move(line));
     }
 }
 
 void CoastlinePolygons::output_lines(int max_points) const {
     for (const auto& polygon : m_polygons) {
-        output_polygon_ring_as_lines(max_points, polygon->getExteriorRing());
-        for (int i = 0; i < polygon->getNumInteriorRings(); ++i) {
-            output_polygon_ring_as_lines(max_points, polygon->getInteriorRing(i));
+        for (std::size_t ring = 0; ring < polygon.num_rings(); ++ring) {
+            output_polygon_ring_as_lines(max_points, polygon, ring);
         }
     }
 }
@@ -299,10 +724,14 @@ OGREnvelope env_east;
 // Without this check there will be a very narrow sliver of water at the
 // antimeridian "cutting" into Antarctica. If this returns true, the geometry
 // is the polygon with this sliver and we don't add it to the output.
+static bool antarctica_bogus(const OGREnvelope& envelope) noexcept {
+    return env_east.Contains(envelope) || env_west.Contains(envelope);
+}
+
 static bool antarctica_bogus(const OGRGeometry* geom) noexcept {
     OGREnvelope envelope;
     geom->getEnvelope(&envelope);
-    return env_east.Contains(envelope) || env_west.Contains(envelope);
+    return antarctica_bogus(envelope);
 }
 
 void CoastlinePolygons::split_bbox(const OGREnvelope& envelope, polygon_vector_type&& v) {
@@ -314,7 +743,7 @@ void CoastlinePolygons::split_bbox(const OGREnvelope& envelope, polygon_vector_t
             std::unique_ptr<OGRGeometry> geom{create_rectangular_polygon(envelope.MinX, envelope.MinY, envelope.MaxX, envelope.MaxY, m_expand)};
             assert(geom->getSpatialReference() != nullptr);
             for (const auto& polygon : v) {
-                std::unique_ptr<OGRGeometry> diff{geom->Difference(polygon.get())};
+                std::unique_ptr<OGRGeometry> diff{geom->Difference(polygon.ogr_polygon(srs.out()).get())};
                 assert(diff);
                 // for some reason there is sometimes no srs on the geometries, so we add them on
                 diff->assignSpatialReference(srs.out());
@@ -404,14 +833,13 @@ void CoastlinePolygons::split_bbox(const OGREnvelope& envelope, polygon_vector_t
             /* You might think re-computing the envelope of all those polygons
             again and again might take a lot of time, but I benchmarked it and
             it has no measurable impact. */
-            OGREnvelope polygon_envelope;
-            polygon->getEnvelope(&polygon_envelope);
+            const OGREnvelope polygon_envelope = polygon.envelope();
 
             const bool e1_intersects_e = e1.Intersects(polygon_envelope);
             const bool e2_intersects_e = e2.Intersects(polygon_envelope);
 
             if (e1_intersects_e && e2_intersects_e) {
-                v1.emplace_back(static_cast<OGRPolygon*>(polygon->clone()));
+                v1.push_back(polygon);
                 v2.push_back(std::move(polygon));
             } else if (e1_intersects_e) {
                 v1.push_back(std::move(polygon));
@@ -427,29 +855,36 @@ void CoastlinePolygons::split_bbox(const OGREnvelope& envelope, polygon_vector_t
 unsigned int CoastlinePolygons::check_polygons() {
     unsigned int warnings = 0;
     polygon_vector_type v;
+    std::vector<std::pair<uint32_t, uint32_t>> tiles;
 
-    for (auto& polygon : m_polygons) {
-        if (polygon->IsValid()) {
-            v.push_back(std::move(polygon));
+    auto results = validate_polygons(m_polygons, true, m_num_threads);
+
+    for (std::size_t n = 0; n < m_polygons.size(); ++n) {
+        if (results[n].valid) {
+            v.push_back(std::move(m_polygons[n]));
         } else {
             std::cerr << "Invalid polygon, trying buffer(0).\n";
             ++warnings;
-            OGRGeometry* buffered_polygon = polygon->Buffer(0);
-            if (buffered_polygon && buffered_polygon->getGeometryType() == wkbPolygon) {
-                v.emplace_back(static_cast<OGRPolygon*>(buffered_polygon));
+            if (results[n].repaired) {
+                v.push_back(std::move(results[n].repaired_polygon));
             } else {
                 std::cerr << "Buffer(0) failed, ignoring this polygon. Output data might be invalid!\n";
+                continue;
             }
         }
+        if (m_zoom >= 0) {
+            tiles.push_back(m_tiles[n]);
+        }
     }
 
     using std::swap;
     swap(m_polygons, v);
+    swap(m_tiles, tiles);
 
     return warnings;
 }
 
-void CoastlinePolygons::output_water_polygons() {
+unsigned int CoastlinePolygons::output_water_polygons() {
     if (srs.is_wgs84()) {
         env_west.MinX = -180.0;
         env_west.MinY =  -90.0;
@@ -472,6 +907,70 @@ void CoastlinePolygons::output_water_polygons() {
         env_east.MaxY =  14230080.0;
     }
 
+    if (m_zoom >= 0) {
+        return output_water_tiles();
+    }
+
     split_bbox(srs.max_extent(), std::move(m_polygons));
+    return 0;
+}
+
+unsigned int CoastlinePolygons::output_water_tiles() {
+    const TileGrid grid{m_zoom, srs.max_extent()};
+
+    // The land polygons are sorted by tile, so the polygons in each tile
+    // with land are next to each other.
+    std::vector<std::size_t> tile_begin;
+    for (std::size_t n = 0; n < m_tiles.size(); ++n) {
+        if (n == 0 || m_tiles[n] != m_tiles[n - 1]) {
+            tile_begin.push_back(n);
+        }
+    }
+    tile_begin.push_back(m_tiles.size());
+    const std::size_t num_land_tiles = tile_begin.size() - 1;
+
+    std::unique_ptr<osmium::thread::Pool> pool;
+    if (m_num_threads > 1) {
+        pool.reset(new osmium::thread::Pool{m_num_threads});
+    }
+
+    // The water in tiles with land is the tile minus all land in it.
+    std::vector<polygon_vector_type> water(num_land_tiles);
+    std::vector<unsigned int> failed(num_land_tiles, 0);
+    run_tasks(pool.get(), num_land_tiles, [&](std::size_t t) {
+        const auto& tile = m_tiles[tile_begin[t]];
+        std::unique_ptr<OGRGeometry> geom{create_rectangular_polygon(grid.min_x(tile.first), grid.min_y(tile.second),
+                                                                     grid.max_x(tile.first), grid.max_y(tile.second), m_expand)};
+        for (std::size_t n = tile_begin[t]; n < tile_begin[t + 1] && geom; ++n) {
+            geom.reset(geom->Difference(m_polygons[n].ogr_polygon(srs.out()).get()));
+        }
+        // Tiles completely covered by land have an empty geometry here.
+        if (!geom || !(geom->IsEmpty() || add_ogr_geometry(*geom, water[t]))) {
+            std::cerr << "Creating water polygon for tile " << tile.first << "/" << tile.second << " was not successful. Output data might be incomplete!\n";
+            water[t].clear();
+            failed[t] = 1;
+        }
+    });
+
+    std::size_t t = 0;
+    for (uint32_t x = 0; x < grid.num_tiles(); ++x) {
+        for (uint32_t y = 0; y < grid.num_tiles(); ++y) {
+            if (t < num_land_tiles && m_tiles[tile_begin[t]] == std::make_pair(x, y)) {
+                for (const auto& polygon : water[t]) {
+                    if (!antarctica_bogus(polygon.envelope())) {
+                        m_output.add_water_polygon(polygon.ogr_polygon(srs.out()), x, y);
+                    }
+                }
+                ++t;
+            } else {
+                m_output.add_water_polygon(create_rectangular_polygon(grid.min_x(x), grid.min_y(y), grid.max_x(x), grid.max_y(y), m_expand), x, y);
+            }
+        }
+    }
+
+    m_polygons.clear();
+    m_tiles.clear();
+
+    return std::accumulate(failed.begin(), failed.end(), 0U);
 }
 
@@ -22,17 +22,19 @@
 
 */
 
+#include "options.hpp"
+#include "polygon.hpp"
+
 #include <ogr_geometry.h>
 
+#include <cstddef>
+#include <cstdint>
 #include <memory>
 #include <utility>
 #include <vector>
 
-class OGRSpatialReference;
 class OutputDatabase;
 
-using polygon_vector_type = std::vector<std::unique_ptr<OGRPolygon>>;
-
 /**
  * A collection of land polygons created out of coastlines.
  * Contains operations for SRS transformation, splitting up of large polygons
@@ -56,6 +58,12 @@ class CoastlinePolygons {
      */
     int m_max_points_in_polygon;
 
+    /// Number of threads used for the expensive geometry operations.
+    int m_num_threads;
+
+    /// How large polygons are split.
+    split_method_type m_split_method;
+
     /**
      * Vector of polygons we want to operate on. This is initialized in
      * the constructor from the polygons created from coastline rings.
@@ -69,19 +77,43 @@ class CoastlinePolygons {
      */
     int m_max_split_depth = 0;
 
-    void split_geometry(std::unique_ptr<OGRGeometry>&& geom, int level);
-    void split_polygon(std::unique_ptr<OGRPolygon>&& polygon, int level);
+    /**
+     * Zoom level of the tiles the polygons were split into by split_grid()
+     * or -1 if they were not split into tiles.
+     */
+    int m_zoom = -1;
+
+    /**
+     * The x and y of the tile each polygon in m_polygons is in. Only used
+     * after split_grid().
+     */
+    std::vector<std::pair<uint32_t, uint32_t>> m_tiles;
+
+    /**
+     * Split the polygon into two halves if it has too many points. Returns
+     * the parts or an empty vector if the polygon should not be split.
+     */
+    polygon_vector_type split_polygon(const Polygon& polygon, int level) const;
+
+    /**
+     * Split the polygon into a grid of cells in one go. Returns false if
+     * this is not possible.
+     */
+    bool split_polygon_into_cells(const Polygon& polygon, polygon_vector_type& parts) const;
     void split_bbox(const OGREnvelope& envelope, polygon_vector_type&& v);
+    unsigned int output_water_tiles();
 
-    void add_line_to_output(std::unique_ptr<OGRLineString> line, OGRSpatialReference* srs) const;
-    void output_polygon_ring_as_lines(int max_points, const OGRLinearRing* ring) const;
+    void add_line_to_output(std::unique_ptr<OGRLineString> line) const;
+    void output_polygon_ring_as_lines(int max_points, const Polygon& polygon, std::size_t ring) const;
 
 public:
 
-    CoastlinePolygons(polygon_vector_type&& polygons, OutputDatabase& output, double expand, int max_points_in_polygon) :
+    CoastlinePolygons(polygon_vector_type&& polygons, OutputDatabase& output, double expand, int max_points_in_polygon, int num_threads, split_method_type split_method) :
         m_output(output),
         m_expand(expand),
         m_max_points_in_polygon(max_points_in_polygon),
+        m_num_threads(num_threads),
+        m_split_method(split_method),
         m_polygons(std::move(polygons)) {
     }
 
@@ -104,17 +136,31 @@ public:
     /// Transform all polygons to output SRS.
     void transform();
 
-    /// Split up all polygons.
+    /**
+     * Split up all polygons. This is done in parallel on the threads set
+     * with --threads, the result is always in the same order.
+     */
     void split();
 
+    /**
+     * Split all polygons into the tiles of the given zoom level (in Web
+     * Mercator) instead of splitting them by number of points. This is
+     * done in parallel, the result is always in the same order. Returns
+     * the number of polygon parts that could not be clipped to the tiles.
+     */
+    unsigned int split_grid(int zoom);
+
     /// Check polygons for validity and try to make them valid if needed
     unsigned int check_polygons();
 
     /// Write all land polygons to the output database.
     void output_land_polygons(bool make_copy);
 
-    /// Write all water polygons to the output database.
-    void output_water_polygons();
+    /**
+     * Write all water polygons to the output database. Returns the number
+     * of tiles for which the water polygons could not be created.
+     */
+    unsigned int output_water_polygons();
 
     /// Write all coastlines to the output database (as lines).
     void output_lines(int max_points) const;
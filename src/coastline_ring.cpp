@@ -20,67 +20,113 @@
 */
 
 #include "coastline_ring.hpp"
+#include "segment_intersections.hpp"
 
-#include <osmium/geom/ogr.hpp>
+#include <osmium/geom/factory.hpp>
+#include <osmium/osm/node_ref.hpp>
 #include <osmium/osm/undirected_segment.hpp>
 
 #include <ogr_geometry.h>
 
+#include <algorithm>
 #include <cassert>
+#include <cstddef>
+#include <cstdint>
 #include <iostream>
 #include <utility>
-
-void CoastlineRing::setup_locations(locmap_type& locmap) {
-    for (auto& wn : m_way_node_list) {
-        locmap.insert(std::make_pair(wn.ref(), &(wn.location())));
-    }
+#include <vector>
+
+CoastlineRing::CoastlineRing(const osmium::Way& way, CoastlineNodeStore& store) :
+    m_store(&store),
+    m_first_node_id(way.nodes().front().ref()),
+    m_last_node_id(way.nodes().back().ref()),
+    m_npoints(way.nodes().size()),
+    m_ring_id(way.id()) {
+    assert(!way.nodes().empty());
+    const osmium::NodeRef* nodes = &way.nodes().front();
+    m_back.push_back(m_store->append(nodes, nodes + way.nodes().size(), way.id()));
 }
 
-unsigned int CoastlineRing::check_locations(bool output_missing) {
+unsigned int CoastlineRing::check_locations(bool output_missing) const {
     unsigned int missing_locations = 0;
 
-    for (const auto& wn : m_way_node_list) {
-        if (!wn.location()) {
-            ++missing_locations;
-            if (output_missing) {
-                std::cerr << "Missing location of node " << wn.ref() << "\n";
+    for_each_range([&](const range& r) {
+        const osmium::Location* locations = m_store->locations(r);
+        for (uint32_t n = 0; n < r.size(); ++n) {
+            if (!locations[n]) {
+                ++missing_locations;
+                if (output_missing && m_store->has_ids()) {
+                    std::cerr << "Missing location of node " << m_store->ids(r)[n] << "\n";
+                }
             }
         }
-    }
+    });
 
     return missing_locations;
 }
 
 void CoastlineRing::add_at_front(const osmium::Way& way) {
     assert(first_node_id() == way.nodes().back().ref());
-    m_way_node_list.insert(m_way_node_list.begin(), way.nodes().begin(), way.nodes().end()-1);
+    const osmium::NodeRef* nodes = &way.nodes().front();
+    const auto size = way.nodes().size();
+    if (size > 1) {
+        // The last node of the way is the first node of the ring, so the
+        // segment leading to it is part of this way.
+        range r = m_store->append(nodes, nodes + size - 1, way.id());
+        r.owns_next_segment = true;
+        m_front.push_back(r);
+        m_npoints += size - 1;
+    }
+    m_first_node_id = way.nodes().front().ref();
 
     update_ring_id(way.id());
     m_nways++;
+    m_clean = false;
 }
 
 void CoastlineRing::add_at_end(const osmium::Way& way) {
     assert(last_node_id() == way.nodes().front().ref());
-    m_way_node_list.insert(m_way_node_list.end(), way.nodes().begin()+1, way.nodes().end());
+    const osmium::NodeRef* nodes = &way.nodes().front();
+    const auto size = way.nodes().size();
+    if (size > 1) {
+        m_back.push_back(m_store->append(nodes + 1, nodes + size, way.id()));
+        m_npoints += size - 1;
+    }
+    m_last_node_id = way.nodes().back().ref();
 
     update_ring_id(way.id());
     m_nways++;
+    m_clean = false;
+}
+
+void CoastlineRing::append_ranges(const CoastlineRing& other, bool skip_first) {
+    assert(m_store == other.m_store);
+    other.for_each_range([this, &skip_first](range r) {
+        if (skip_first) {
+            ++r.begin;
+            skip_first = false;
+        }
+        // A range that became empty is still needed if it owns the
+        // segment to the next range, because that segment is from its way.
+        if (r.size() > 0 || r.owns_next_segment) {
+            m_back.push_back(r);
+            m_npoints += r.size();
+        }
+    });
+    m_last_node_id = other.m_last_node_id;
+    m_clean = false;
 }
 
 void CoastlineRing::join(const CoastlineRing& other) {
     assert(last_node_id() == other.first_node_id());
-    m_way_node_list.insert(m_way_node_list.end(), other.m_way_node_list.begin()+1, other.m_way_node_list.end());
+    append_ranges(other, true);
 
     update_ring_id(other.ring_id());
     m_nways += other.m_nways;
 }
 
 void CoastlineRing::join_over_gap(const CoastlineRing& other) {
-    if (last_location() != other.first_location()) {
-        m_way_node_list.push_back(other.m_way_node_list.front());
-    }
-
-    m_way_node_list.insert(m_way_node_list.end(), other.m_way_node_list.begin()+1, other.m_way_node_list.end());
+    append_ranges(other, last_location() == other.first_location());
 
     update_ring_id(other.ring_id());
     m_nways += other.m_nways;
@@ -89,83 +135,156 @@ void CoastlineRing::join_over_gap(const CoastlineRing& other) {
 
 void CoastlineRing::close_ring() {
     if (first_location() != last_location()) {
-        m_way_node_list.push_back(m_way_node_list.front());
+        m_back.push_back(m_store->append(m_first_node_id, first_location()));
+        m_last_node_id = m_first_node_id;
+        ++m_npoints;
     }
     m_fixed = true;
+    m_clean = false;
 }
 
 void CoastlineRing::close_antarctica_ring(int epsg) {
     const double min = epsg == 4326 ? -90.0 : -85.0511288;
 
+    std::vector<osmium::NodeRef> nodes;
+
     for (int lat = -78; lat > int(min); --lat) {
-        m_way_node_list.emplace_back(0, osmium::Location{-180.0, double(lat)});
+        nodes.emplace_back(0, osmium::Location{-180.0, double(lat)});
     }
 
     for (int lon = -180; lon < 180; ++lon) {
-        m_way_node_list.emplace_back(0, osmium::Location{double(lon), min});
+        nodes.emplace_back(0, osmium::Location{double(lon), min});
     }
 
     if (epsg == 3857) {
-        m_way_node_list.emplace_back(0, osmium::Location{180.0, min});
+        nodes.emplace_back(0, osmium::Location{180.0, min});
     }
 
     for (auto lat = static_cast<int>(min); lat < -78; ++lat) {
-        m_way_node_list.emplace_back(0, osmium::Location{180.0, double(lat)});
+        nodes.emplace_back(0, osmium::Location{180.0, double(lat)});
     }
 
-    m_way_node_list.push_back(m_way_node_list.front());
+    nodes.emplace_back(m_first_node_id, first_location());
+
+    m_back.push_back(m_store->append(nodes.data(), nodes.data() + nodes.size(), 0));
+    m_npoints += nodes.size();
+    m_last_node_id = m_first_node_id;
     m_fixed = true;
+    m_clean = false;
 }
 
-std::unique_ptr<OGRPolygon> CoastlineRing::ogr_polygon(osmium::geom::OGRFactory<>& geom_factory, bool reverse) const {
-    geom_factory.polygon_start();
-    std::size_t num_points = 0;
+Polygon CoastlineRing::polygon(bool reverse) const {
+    std::vector<osmium::Location> locations;
+    locations.reserve(m_npoints);
+    for_each_location([&locations](const osmium::Location& location) {
+        locations.push_back(location);
+    });
     if (reverse) {
-        num_points = geom_factory.fill_polygon(m_way_node_list.crbegin(), m_way_node_list.crend());
-    } else {
-        num_points = geom_factory.fill_polygon(m_way_node_list.cbegin(), m_way_node_list.cend());
+        std::reverse(locations.begin(), locations.end());
+    }
+
+    Polygon polygon;
+    polygon.reserve(locations.size());
+    for (const auto& location : locations) {
+        polygon.add_point(location.lon(), location.lat());
     }
-    return geom_factory.polygon_finish(num_points);
+    polygon.finish_ring();
+    return polygon;
+}
+
+std::unique_ptr<OGRLineString> CoastlineRing::ogr_linestring(bool reverse) const {
+    std::unique_ptr<OGRLineString> linestring{new OGRLineString};
+    fill_linestring(*linestring, reverse);
+    return linestring;
 }
 
-std::unique_ptr<OGRLineString> CoastlineRing::ogr_linestring(osmium::geom::OGRFactory<>& geom_factory, bool reverse) const {
-    geom_factory.linestring_start();
-    std::size_t num_points = 0;
+void CoastlineRing::fill_linestring(OGRLineString& linestring, bool reverse) const {
+    // Consecutive nodes at the same location are only added once, like the
+    // osmium geometry factory does.
+    std::vector<osmium::Location> locations;
+    locations.reserve(m_npoints);
+    for_each_location([&locations](const osmium::Location& location) {
+        if (locations.empty() || locations.back() != location) {
+            locations.push_back(location);
+        }
+    });
+
+    if (locations.size() < 2) {
+        throw osmium::geometry_error{"need at least two points for linestring", "way", m_ring_id};
+    }
+
     if (reverse) {
-        num_points = geom_factory.fill_linestring(m_way_node_list.crbegin(), m_way_node_list.crend());
-    } else {
-        num_points = geom_factory.fill_linestring(m_way_node_list.cbegin(), m_way_node_list.cend());
+        std::reverse(locations.begin(), locations.end());
+    }
+
+    linestring.setNumPoints(static_cast<int>(locations.size()), FALSE);
+    for (std::size_t n = 0; n < locations.size(); ++n) {
+        linestring.setPoint(static_cast<int>(n), locations[n].lon(), locations[n].lat());
     }
-    return geom_factory.linestring_finish(num_points);
 }
 
 std::unique_ptr<OGRPoint> CoastlineRing::ogr_first_point() const {
-    assert(!m_way_node_list.empty());
-    const osmium::NodeRef& node_ref = m_way_node_list.front();
-    return std::unique_ptr<OGRPoint>{new OGRPoint{node_ref.lon(), node_ref.lat()}};
+    const osmium::Location location = first_location();
+    return std::unique_ptr<OGRPoint>{new OGRPoint{location.lon(), location.lat()}};
 }
 
 std::unique_ptr<OGRPoint> CoastlineRing::ogr_last_point() const {
-    assert(!m_way_node_list.empty());
-    const osmium::NodeRef& node_ref = m_way_node_list.back();
-    return std::unique_ptr<OGRPoint>{new OGRPoint{node_ref.lon(), node_ref.lat()}};
+    const osmium::Location location = last_location();
+    return std::unique_ptr<OGRPoint>{new OGRPoint{location.lon(), location.lat()}};
 }
 
 // Pythagoras doesn't work on a round earth but that is ok here, we only need a
 // rough measure anyway
 double CoastlineRing::distance_to_start_location(osmium::Location pos) const {
-    assert(!m_way_node_list.empty());
-    const osmium::Location p = m_way_node_list.front().location();
+    const osmium::Location p = first_location();
     return (pos.lon() - p.lon()) * (pos.lon() - p.lon()) +
            (pos.lat() - p.lat()) * (pos.lat() - p.lat());
 }
 
 void CoastlineRing::add_segments_to_vector(std::vector<osmium::UndirectedSegment>& segments) const {
-    if (m_way_node_list.size() > 1) {
-        for (auto it = m_way_node_list.begin(); it != m_way_node_list.end() - 1; ++it) {
-            segments.emplace_back(it->location(), (it+1)->location());
+    for_each_segment([&segments](const osmium::UndirectedSegment& segment, osmium::object_id_type /*way_id*/) {
+        segments.push_back(segment);
+    });
+}
+
+bool CoastlineRing::has_repeated_locations_or_spikes() const {
+    std::vector<osmium::Location> locations;
+    locations.reserve(m_npoints);
+    for_each_location([&locations](const osmium::Location& location) {
+        locations.push_back(location);
+    });
+
+    const bool closed = locations.size() > 1 && locations.front() == locations.back();
+    if (closed) {
+        locations.pop_back();
+    }
+
+    // A spike is where the ring goes along a line and then back on
+    // (part of) the same line.
+    const auto is_spike = [](const osmium::Location& a, const osmium::Location& b, const osmium::Location& c) {
+        if (orientation(a, b, c) != 0) {
+            return false;
+        }
+        const int64_t dot = (int64_t(b.x()) - a.x()) * (int64_t(c.x()) - b.x()) +
+                            (int64_t(b.y()) - a.y()) * (int64_t(c.y()) - b.y());
+        return dot <= 0;
+    };
+
+    const std::size_t size = locations.size();
+    if (size >= 3) {
+        for (std::size_t n = 1; n + 1 < size; ++n) {
+            if (is_spike(locations[n - 1], locations[n], locations[n + 1])) {
+                return true;
+            }
+        }
+        if (closed && (is_spike(locations[size - 2], locations[size - 1], locations[0]) ||
+                       is_spike(locations[size - 1], locations[0], locations[1]))) {
+            return true;
         }
     }
+
+    std::sort(locations.begin(), locations.end());
+    return std::adjacent_find(locations.begin(), locations.end()) != locations.end();
 }
 
 std::ostream& operator<<(std::ostream& out, CoastlineRing& cp) {
@@ -22,21 +22,23 @@
 
 */
 
-#include <osmium/geom/ogr.hpp>
+#include "coastline_node_store.hpp"
+#include "polygon.hpp"
+
+#include <osmium/osm/location.hpp>
+#include <osmium/osm/types.hpp>
 #include <osmium/osm/undirected_segment.hpp>
 #include <osmium/osm/way.hpp>
 
 #include <cassert>
-#include <map>
+#include <cstddef>
 #include <memory>
 #include <ostream>
+#include <utility>
 #include <vector>
 
 class OGRPoint;
 class OGRLineString;
-class OGRPolygon;
-
-using locmap_type = std::multimap<osmium::object_id_type, osmium::Location*>;
 
 /**
  * The CoastlineRing class models a (possibly unfinished) ring of
@@ -47,7 +49,10 @@ using locmap_type = std::multimap<osmium::object_id_type, osmium::Location*>;
  * later until the ring is closed.
  *
  * The CoastlineRing keeps track of all the node IDs needed for
- * the ring.
+ * the ring. The nodes themselves are kept in a CoastlineNodeStore
+ * shared by all rings, the ring only has a list of ranges of nodes
+ * in that store. Adding nodes at the front or at the end of the
+ * ring only adds a range and never needs to move any nodes.
  *
  * To get a unique ID for the coastline ring, the minimum way
  * ID is also kept.
@@ -64,7 +69,24 @@ using locmap_type = std::multimap<osmium::object_id_type, osmium::Location*>;
  */
 class CoastlineRing {
 
-    std::vector<osmium::NodeRef> m_way_node_list{};
+    using range = CoastlineNodeStore::range;
+
+    CoastlineNodeStore* m_store;
+
+    /// Ranges of nodes added at the front of the ring (in reverse order).
+    std::vector<range> m_front{};
+
+    /// Ranges of nodes from the first way and added at the end of the ring.
+    std::vector<range> m_back{};
+
+    /// ID of first node in the ring.
+    osmium::object_id_type m_first_node_id;
+
+    /// ID of last node in the ring.
+    osmium::object_id_type m_last_node_id;
+
+    /// The number of nodes in the ring.
+    std::size_t m_npoints;
 
     /**
      * Smallest ID of all the ways making up the ring. Can be used as somewhat
@@ -84,16 +106,81 @@ class CoastlineRing {
     /// Is this an outer ring?
     bool m_outer = false;
 
+    /**
+     * The check for intersections found nothing wrong with this ring and
+     * the ring wasn't changed afterwards.
+     */
+    bool m_clean = false;
+
+    /**
+     * Append all ranges of the other ring to this ring, optionally
+     * skipping the first node of the other ring. Empty ranges are only
+     * kept if they own the segment to the next range.
+     */
+    void append_ranges(const CoastlineRing& other, bool skip_first);
+
+    /**
+     * Fill the linestring with the locations of this ring.
+     *
+     * @throws osmium::geometry_error If there are less than two different
+     *         locations.
+     */
+    void fill_linestring(OGRLineString& linestring, bool reverse) const;
+
 public:
 
     /**
-     * Create CoastlineRing from a way.
+     * Create CoastlineRing from a way. The nodes are added to the store.
+     */
+    CoastlineRing(const osmium::Way& way, CoastlineNodeStore& store);
+
+    /**
+     * Call func for each range of nodes in this ring in order.
+     */
+    template <typename TFunc>
+    void for_each_range(TFunc&& func) const {
+        for (auto it = m_front.crbegin(); it != m_front.crend(); ++it) {
+            std::forward<TFunc>(func)(*it);
+        }
+        for (const auto& r : m_back) {
+            std::forward<TFunc>(func)(r);
+        }
+    }
+
+    /// Call func for each location in this ring in order.
+    template <typename TFunc>
+    void for_each_location(TFunc&& func) const {
+        for_each_range([this, &func](const range& r) {
+            const osmium::Location* locations = m_store->locations(r);
+            for (uint32_t n = 0; n < r.size(); ++n) {
+                std::forward<TFunc>(func)(locations[n]);
+            }
+        });
+    }
+
+    /**
+     * Call func(segment, way_id) for each segment of this ring in order.
+     * The way_id is the ID of the way the segment is from, or 0 if the
+     * segment was added to fix the ring.
      */
-    explicit CoastlineRing(const osmium::Way& way) :
-        m_ring_id(way.id()) {
-        assert(!way.nodes().empty());
-        m_way_node_list.reserve(way.is_closed() ? way.nodes().size() : 1000);
-        m_way_node_list.insert(m_way_node_list.begin(), way.nodes().begin(), way.nodes().end());
+    template <typename TFunc>
+    void for_each_segment(TFunc&& func) const {
+        bool first = true;
+        osmium::Location previous;
+        const range* previous_range = nullptr;
+        for_each_range([&](const range& r) {
+            const osmium::Location* locations = m_store->locations(r);
+            for (uint32_t n = 0; n < r.size(); ++n) {
+                if (!first) {
+                    const bool from_previous = n == 0 && previous_range->owns_next_segment;
+                    std::forward<TFunc>(func)(osmium::UndirectedSegment{previous, locations[n]},
+                                              from_previous ? previous_range->way_id : r.way_id);
+                }
+                first = false;
+                previous = locations[n];
+            }
+            previous_range = &r;
+        });
     }
 
     bool is_outer() const noexcept {
@@ -106,26 +193,25 @@ public:
 
     /// ID of first node in the ring.
     osmium::object_id_type first_node_id() const noexcept {
-        assert(!m_way_node_list.empty());
-        return m_way_node_list.front().ref();
+        return m_first_node_id;
     }
 
     /// ID of last node in the ring.
     osmium::object_id_type last_node_id() const noexcept {
-        assert(!m_way_node_list.empty());
-        return m_way_node_list.back().ref();
+        return m_last_node_id;
     }
 
     /// Location of the first node in the ring.
     osmium::Location first_location() const noexcept {
-        assert(!m_way_node_list.empty());
-        return m_way_node_list.front().location();
+        const range& r = m_front.empty() ? m_back.front() : m_front.back();
+        return m_store->locations(r)[0];
     }
 
     /// Location of the last node in the ring.
     osmium::Location last_location() const noexcept {
-        assert(!m_way_node_list.empty());
-        return m_way_node_list.back().location();
+        assert(!m_back.empty());
+        const range& r = m_back.back();
+        return m_store->locations(r)[r.size() - 1];
     }
 
     /// Return ID of this ring (defined as smallest ID of the ways making up the ring).
@@ -150,7 +236,7 @@ public:
 
     /// Returns the number of points in this ring.
     unsigned int npoints() const noexcept {
-        return m_way_node_list.size();
+        return static_cast<unsigned int>(m_npoints);
     }
 
     /// Returns true if the ring is closed.
@@ -163,6 +249,31 @@ public:
         return m_fixed;
     }
 
+    /**
+     * Is the polygon made from this ring known to be valid without asking
+     * GEOS? See set_clean().
+     */
+    bool is_clean() const noexcept {
+        return m_clean;
+    }
+
+    /**
+     * Mark this ring as clean if the check for intersections found nothing
+     * wrong with it and it has no repeated locations or spikes. Any later
+     * change to the ring resets this.
+     */
+    void set_clean(bool clean) noexcept {
+        m_clean = clean;
+    }
+
+    /**
+     * Does this ring visit the same location twice (not counting the last
+     * location of a closed ring) or turn back on itself along a line? The
+     * check for intersections doesn't find those, but they make the ring
+     * invalid.
+     */
+    bool has_repeated_locations_or_spikes() const;
+
     /**
      * When there are two different nodes with the same location
      * a situation can arise where a CoastlineRing looks not closed
@@ -172,23 +283,16 @@ public:
      * method does this.
      */
     void fake_close() noexcept {
-        assert(!m_way_node_list.empty());
-        m_way_node_list.back().set_ref(first_node_id());
+        m_last_node_id = m_first_node_id;
     }
 
-    /**
-     * Add pointers to the node locations to the given locmap. The
-     * locmap can than later be used to directly put the locations
-     * into the right place.
-     */
-    void setup_locations(locmap_type& locmap);
-
     /**
      * Check whether all node locations for the ways are there. This
      * can happen if the input data is missing a node needed for a
      * way. The function returns the number of missing locations.
+     * Node IDs are only output if they are still in the node store.
      */
-    unsigned int check_locations(bool output_missing);
+    unsigned int check_locations(bool output_missing) const;
 
     /// Add a new way to the front of this ring.
     void add_at_front(const osmium::Way& way);
@@ -222,24 +326,22 @@ public:
     void close_antarctica_ring(int epsg);
 
     /**
-     * Create OGRPolygon for this ring.
+     * Create Polygon for this ring.
      *
-     * Caller takes ownership of the created object.
-     *
-     * @param geom_factory Geometry factory that should be used to build the geometry.
-     * @param reverse Reverse the ring when creating the geometry.
+     * @param reverse Reverse the ring when creating the polygon.
      */
-    std::unique_ptr<OGRPolygon> ogr_polygon(osmium::geom::OGRFactory<>& geom_factory, bool reverse) const;
+    Polygon polygon(bool reverse) const;
 
     /**
      * Create OGRLineString for this ring.
      *
      * Caller takes ownership of the created object.
      *
-     * @param geom_factory Geometry factory that should be used to build the geometry.
      * @param reverse Reverse the ring when creating the geometry.
+     * @throws osmium::geometry_error If there are less than two different
+     *         locations in this ring.
      */
-    std::unique_ptr<OGRLineString> ogr_linestring(osmium::geom::OGRFactory<>& geom_factory, bool reverse) const;
+    std::unique_ptr<OGRLineString> ogr_linestring(bool reverse) const;
 
     /**
      * Create OGRPoint for the first point in this ring.
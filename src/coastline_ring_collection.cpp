@@ -22,21 +22,44 @@
 #include "coastline_polygons.hpp"
 #include "coastline_ring_collection.hpp"
 #include "output_database.hpp"
+#include "parallel.hpp"
+#include "polygon.hpp"
+#include "polygon_validation.hpp"
+#include "segment_diff.hpp"
+#include "segment_file.hpp"
+#include "segment_intersections.hpp"
+#include "segment_runs.hpp"
+#include "segment_sort.hpp"
 #include "srs.hpp"
 
+#include <osmium/geom/factory.hpp>
+#include <osmium/osm/undirected_segment.hpp>
+#include <osmium/thread/pool.hpp>
+
 #include <ogr_geometry.h>
 
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
 #include <iostream>
+#include <limits>
 #include <memory>
-
-#ifdef _MSC_VER
-#include <io.h>
-#include <BaseTsd.h>
-#endif
+#include <tuple>
+#include <utility>
+#include <vector>
 
 extern SRS srs;
 extern bool debug;
 
+CoastlineRingCollection::ring_handle CoastlineRingCollection::add_ring(const osmium::Way& way) {
+    const auto handle = static_cast<ring_handle>(m_rings.size());
+    m_rings.emplace_back(way, m_node_store);
+    m_removed.push_back(false);
+    ++m_num_rings;
+    return handle;
+}
+
 /**
  * If a way is not closed adding it to the coastline collection is a bit
  * complicated.
@@ -46,192 +69,167 @@ extern bool debug;
  */
 void CoastlineRingCollection::add_partial_ring(const osmium::Way& way) {
     assert(!way.nodes().empty());
-    const auto mprev = m_end_nodes.find(way.nodes().front().ref());
-    const auto mnext = m_start_nodes.find(way.nodes().back().ref());
+    const osmium::object_id_type front_id = way.nodes().front().ref();
+    const osmium::object_id_type back_id = way.nodes().back().ref();
+    const auto prev = m_end_nodes.find(front_id);
+    const auto next = m_start_nodes.find(back_id);
 
     // There is no CoastlineRing yet where this way could fit. So we
     // create one and add it to the collection.
-    if (mprev == m_end_nodes.end() &&
-        mnext == m_start_nodes.end()) {
-        const auto added = m_list.insert(m_list.end(), std::make_shared<CoastlineRing>(way));
-        m_start_nodes[way.nodes().front().ref()] = added;
-        m_end_nodes[way.nodes().back().ref()] = added;
+    if (prev == NodeIdMap::not_found &&
+        next == NodeIdMap::not_found) {
+        const auto added = add_ring(way);
+        m_start_nodes.set(front_id, added);
+        m_end_nodes.set(back_id, added);
         return;
     }
 
     // We found a CoastlineRing where we can add the way at the end.
-    if (mprev != m_end_nodes.end()) {
-        const auto prev = mprev->second;
-        (*prev)->add_at_end(way);
-        m_end_nodes.erase(mprev);
-
-        if ((*prev)->is_closed()) {
-            const auto found = m_start_nodes.find((*prev)->first_node_id());
-            if (found != m_start_nodes.end()) {
-                m_start_nodes.erase(found);
-            }
+    if (prev != NodeIdMap::not_found) {
+        CoastlineRing& ring = m_rings[prev];
+        ring.add_at_end(way);
+        m_end_nodes.erase(front_id);
+
+        if (ring.is_closed()) {
+            m_start_nodes.erase(ring.first_node_id());
             return;
         }
 
         // We also found a CoastlineRing where we could have added the
         // way at the front. This means that the way together with the
         // ring at front and the ring at back are now a complete ring.
-        if (mnext != m_start_nodes.end()) {
-            const auto next = mnext->second;
-            (*prev)->join(**next);
-            m_start_nodes.erase(mnext);
-            if ((*prev)->is_closed()) {
-                auto x = m_start_nodes.find((*prev)->first_node_id());
-                if (x != m_start_nodes.end()) {
-                    m_start_nodes.erase(x);
-                }
-                x = m_end_nodes.find((*prev)->last_node_id());
-                if (x != m_end_nodes.end()) {
-                    m_end_nodes.erase(x);
-                }
+        if (next != NodeIdMap::not_found) {
+            ring.join(m_rings[next]);
+            m_start_nodes.erase(back_id);
+            if (ring.is_closed()) {
+                m_start_nodes.erase(ring.first_node_id());
+                m_end_nodes.erase(ring.last_node_id());
             }
-            m_list.erase(next);
+            remove_ring(next);
         }
 
-        m_end_nodes[(*prev)->last_node_id()] = prev;
+        m_end_nodes.set(ring.last_node_id(), prev);
         return;
     }
 
     // We found a CoastlineRing where we can add the way at the front.
-    if (mnext != m_start_nodes.end()) {
-        const auto next = mnext->second;
-        (*next)->add_at_front(way);
-        m_start_nodes.erase(mnext);
-        if ((*next)->is_closed()) {
-            const auto found = m_end_nodes.find((*next)->last_node_id());
-            if (found != m_end_nodes.end()) {
-                m_end_nodes.erase(found);
-            }
-            return;
-        }
-        m_start_nodes[(*next)->first_node_id()] = next;
+    CoastlineRing& ring = m_rings[next];
+    ring.add_at_front(way);
+    m_start_nodes.erase(back_id);
+    if (ring.is_closed()) {
+        m_end_nodes.erase(ring.last_node_id());
+        return;
     }
+    m_start_nodes.set(ring.first_node_id(), next);
 }
 
-void CoastlineRingCollection::setup_locations(locmap_type& locmap) {
-    for (const auto& ring : m_list) {
-        ring->setup_locations(locmap);
-    }
+void CoastlineRingCollection::setup_locations(LocationMap& locmap) {
+    m_node_store.setup_locations(locmap);
 }
 
 unsigned int CoastlineRingCollection::check_locations(bool output_missing) {
     unsigned int missing_locations = 0;
 
-    for (const auto& ring : m_list) {
-        missing_locations += ring->check_locations(output_missing);
-    }
+    for_each_ring([&](const CoastlineRing& ring) {
+        missing_locations += ring.check_locations(output_missing);
+    });
 
     return missing_locations;
 }
 
-bool is_valid_polygon(const OGRGeometry* geometry) {
-    if (geometry && geometry->getGeometryType() == wkbPolygon && !geometry->IsEmpty()) {
-        const auto *const polygon = static_cast<const OGRPolygon*>(geometry);
-        return (polygon->getExteriorRing()->getNumPoints() > 3) && (polygon->getNumInteriorRings() == 0) && geometry->IsValid();
-    }
-    return false;
+static bool is_polygon_without_holes(const Polygon& polygon) noexcept {
+    return polygon.num_rings() == 1 && polygon.ring_size(0) > 3;
 }
 
-std::vector<OGRGeometry*> CoastlineRingCollection::add_polygons_to_vector() {
-    std::vector<OGRGeometry*> vector;
-    vector.reserve(m_list.size());
+polygon_vector_type CoastlineRingCollection::add_polygons_to_vector(int num_threads) {
+    polygon_vector_type candidates;
+    std::vector<osmium::object_id_type> ring_ids;
+    std::vector<bool> known_valid;
+    candidates.reserve(size());
+
+    for_each_ring([&](const CoastlineRing& ring) {
+        if (ring.is_closed() && ring.npoints() > 3) { // everything that doesn't match here is bad beyond repair and reported elsewhere
+            candidates.push_back(ring.polygon(true));
+            ring_ids.push_back(ring.ring_id());
+            known_valid.push_back(ring.is_clean());
+        }
+    });
 
-    for (const auto& ring : m_list) {
-        if (ring->is_closed() && ring->npoints() > 3) { // everything that doesn't match here is bad beyond repair and reported elsewhere
-            std::unique_ptr<OGRPolygon> p = ring->ogr_polygon(m_factory, true);
-            if (p->IsValid()) {
-                p->assignSpatialReference(srs.wgs84());
-                vector.push_back(p.release());
-            } else {
-                std::unique_ptr<OGRGeometry> geom{p->Buffer(0)};
-                if (is_valid_polygon(geom.get())) {
-                    geom->assignSpatialReference(srs.wgs84());
-                    vector.push_back(geom.release());
-                } else {
-                    std::cerr << "Ignoring invalid polygon geometry (ring_id=" << ring->ring_id() << ").\n";
-                }
-            }
+    auto results = validate_polygons(candidates, true, num_threads, known_valid);
+
+    polygon_vector_type vector;
+    vector.reserve(candidates.size());
+
+    for (std::size_t n = 0; n < candidates.size(); ++n) {
+        auto& result = results[n];
+        if (result.valid) {
+            vector.push_back(std::move(candidates[n]));
+        } else if (result.repaired && result.repaired_valid && is_polygon_without_holes(result.repaired_polygon)) {
+            vector.push_back(std::move(result.repaired_polygon));
+        } else {
+            std::cerr << "Ignoring invalid polygon geometry (ring_id=" << ring_ids[n] << ").\n";
         }
     }
 
     return vector;
 }
 
-unsigned int CoastlineRingCollection::output_rings(OutputDatabase& output) {
+/**
+ * Add the ring as error line to the output. Rings with less than two
+ * different locations can't be written as lines, they are only reported
+ * on STDERR.
+ */
+static void add_ring_error_line(OutputDatabase& output, const CoastlineRing& ring, bool reverse, const char* error) {
+    try {
+        output.add_error_line(ring.ogr_linestring(reverse), error, ring.ring_id());
+    } catch (const osmium::geometry_error&) {
+        std::cerr << "Ignoring illegal geometry for ring " << ring.ring_id() << ".\n";
+    }
+}
+
+unsigned int CoastlineRingCollection::output_rings(OutputDatabase& output, int num_threads) {
     unsigned int warnings = 0;
 
-    for (const auto& ring : m_list) {
-        if (ring->is_closed()) {
-            if (ring->npoints() > 3) {
-                output.add_ring(ring->ogr_polygon(m_factory, true), ring->ring_id(), ring->nways(), ring->npoints(), ring->is_fixed());
-            } else if (ring->npoints() == 1) {
-                output.add_error_point(ring->ogr_first_point(), "single_point_in_ring", ring->first_node_id());
+    // The rings are transformed into the output SRS first, because that is
+    // what has to be valid. Then they are all validated at once.
+    polygon_vector_type polygons;
+    std::vector<bool> known_valid;
+    for_each_ring([&](const CoastlineRing& ring) {
+        if (ring.is_closed() && ring.npoints() > 3) {
+            polygons.push_back(ring.polygon(true));
+            srs.transform(polygons.back());
+            known_valid.push_back(ring.is_clean() && srs.is_wgs84());
+        }
+    });
+
+    const auto results = validate_polygons(polygons, false, num_threads, known_valid);
+    std::size_t n = 0;
+
+    for_each_ring([&](const CoastlineRing& ring) {
+        if (ring.is_closed()) {
+            if (ring.npoints() > 3) {
+                output.add_ring(polygons[n].ogr_polygon(srs.out()), results[n].valid, ring.ring_id(), ring.nways(), ring.npoints(), ring.is_fixed());
+                ++n;
+            } else if (ring.npoints() == 1) {
+                output.add_error_point(ring.ogr_first_point(), "single_point_in_ring", ring.first_node_id());
                 warnings++;
-            } else { // ring->npoints() == 2 or 3
-                output.add_error_line(ring->ogr_linestring(m_factory, true), "not_a_ring", ring->ring_id());
-                output.add_error_point(ring->ogr_first_point(), "not_a_ring", ring->first_node_id());
-                output.add_error_point(ring->ogr_last_point(), "not_a_ring", ring->last_node_id());
+            } else { // ring.npoints() == 2 or 3
+                add_ring_error_line(output, ring, true, "not_a_ring");
+                output.add_error_point(ring.ogr_first_point(), "not_a_ring", ring.first_node_id());
+                output.add_error_point(ring.ogr_last_point(), "not_a_ring", ring.last_node_id());
                 warnings++;
             }
         } else {
-            output.add_error_line(ring->ogr_linestring(m_factory, true), "not_closed", ring->ring_id());
-            output.add_error_point(ring->ogr_first_point(), "end_point", ring->first_node_id());
-            output.add_error_point(ring->ogr_last_point(), "end_point", ring->last_node_id());
+            add_ring_error_line(output, ring, true, "not_closed");
+            output.add_error_point(ring.ogr_first_point(), "end_point", ring.first_node_id());
+            output.add_error_point(ring.ogr_last_point(), "end_point", ring.last_node_id());
             warnings++;
         }
-    }
+    });
 
     return warnings;
 }
 
-osmium::Location intersection(const osmium::Segment& s1, const osmium::Segment&s2) {
-    if (s1.first()  == s2.first()  ||
-        s1.first()  == s2.second() ||
-        s1.second() == s2.first()  ||
-        s1.second() == s2.second()) {
-        return osmium::Location{};
-    }
-
-    const double denom = ((s2.second().lat() - s2.first().lat())*(s1.second().lon() - s1.first().lon())) -
-                         ((s2.second().lon() - s2.first().lon())*(s1.second().lat() - s1.first().lat()));
-
-    if (denom != 0) {
-        const double nume_a = ((s2.second().lon() - s2.first().lon())*(s1.first().lat() - s2.first().lat())) -
-                              ((s2.second().lat() - s2.first().lat())*(s1.first().lon() - s2.first().lon()));
-
-        const double nume_b = ((s1.second().lon() - s1.first().lon())*(s1.first().lat() - s2.first().lat())) -
-                              ((s1.second().lat() - s1.first().lat())*(s1.first().lon() - s2.first().lon()));
-
-        if ((denom > 0 && nume_a >= 0 && nume_a <= denom && nume_b >= 0 && nume_b <= denom) ||
-            (denom < 0 && nume_a <= 0 && nume_a >= denom && nume_b <= 0 && nume_b >= denom)) {
-            const double ua = nume_a / denom;
-            const double ix = s1.first().lon() + ua*(s1.second().lon() - s1.first().lon());
-            const double iy = s1.first().lat() + ua*(s1.second().lat() - s1.first().lat());
-            return {ix, iy};
-        }
-    }
-
-    return osmium::Location{};
-}
-
-bool outside_x_range(const osmium::UndirectedSegment& s1, const osmium::UndirectedSegment& s2) {
-    return s1.first().x() > s2.second().x();
-}
-
-bool y_range_overlap(const osmium::UndirectedSegment& s1, const osmium::UndirectedSegment& s2) {
-    const int tmin = s1.first().y() < s1.second().y() ? s1.first().y( ) : s1.second().y();
-    const int tmax = s1.first().y() < s1.second().y() ? s1.second().y() : s1.first().y();
-    const int omin = s2.first().y() < s2.second().y() ? s2.first().y()  : s2.second().y();
-    const int omax = s2.first().y() < s2.second().y() ? s2.second().y() : s2.first().y();
-
-    return !(tmin > omax || omin > tmax);
-}
-
 std::unique_ptr<OGRLineString> create_ogr_linestring(const osmium::Segment& segment) {
     std::unique_ptr<OGRLineString> line{new OGRLineString};
     line->setNumPoints(2);
@@ -246,68 +244,121 @@ std::unique_ptr<OGRLineString> create_ogr_linestring(const osmium::Segment& segm
  * Checks if there are intersections between any coastline segments.
  * Returns the number of intersections and overlaps.
  */
-unsigned int CoastlineRingCollection::check_for_intersections(OutputDatabase& output, int segments_fd) {
+unsigned int CoastlineRingCollection::check_for_intersections(OutputDatabase& output, int segments_fd, SegmentFileReader* previous, int num_threads, std::size_t memory_budget) {
+    assert(!previous || memory_budget == 0);
     unsigned int overlaps = 0;
 
-    std::vector<osmium::UndirectedSegment> segments;
-    if (debug) {
-        std::cerr << "Setting up segments...\n";
-    }
+    SegmentFileWriter segment_writer{segments_fd, segment_file::has_ring_ids | segment_file::has_way_ids | segment_file::has_findings};
+    std::vector<segment_finding> findings;
+
+    // The ring and way IDs of the segments are only needed for the
+    // segments file. They are kept in a table with one entry for each
+    // run of segments from the same way, each segment only stores the
+    // position in this table.
+    std::vector<segment_ids> sources;
+    const auto source = [&sources](const CoastlineRing& ring, osmium::object_id_type way_id) {
+        if (sources.empty() || sources.back().ring_id != ring.ring_id() || sources.back().way_id != way_id) {
+            sources.emplace_back(ring.ring_id(), way_id);
+        }
+        return static_cast<uint32_t>(sources.size() - 1);
+    };
 
-    for (const auto& ring : m_list) {
-        ring->add_segments_to_vector(segments);
-    }
+    if (memory_budget == 0) {
+        std::vector<osmium::UndirectedSegment> segments;
+        std::vector<uint32_t> segment_sources;
+        if (debug) {
+            std::cerr << "Setting up segments...\n";
+        }
 
-    if (debug) {
-        std::cerr << "Sorting...\n";
-    }
+        if (segments_fd >= 0) {
+            for_each_ring([&](const CoastlineRing& ring) {
+                ring.for_each_segment([&](const osmium::UndirectedSegment& segment, osmium::object_id_type way_id) {
+                    segments.push_back(segment);
+                    segment_sources.push_back(source(ring, way_id));
+                });
+            });
+        } else {
+            for_each_ring([&segments](const CoastlineRing& ring) {
+                ring.add_segments_to_vector(segments);
+            });
+        }
+
+        if (debug) {
+            std::cerr << "Sorting...\n";
+        }
 
-    std::sort(segments.begin(), segments.end());
+        if (segments_fd >= 0) {
+            sort_segments(segments, segment_sources, num_threads);
 
-    if (segments_fd >= 0) {
+            if (debug) {
+                std::cerr << "Writing segments to file...\n";
+            }
+            for (std::size_t n = 0; n < segments.size(); ++n) {
+                segment_writer.add(segments[n], sources[segment_sources[n]]);
+            }
+        } else {
+            sort_segments(segments, num_threads);
+        }
+
+        std::size_t num_changed = 0;
+        if (previous && find_intersections_incremental(segments, *previous, findings, num_changed)) {
+            if (debug) {
+                std::cerr << "Checked " << num_changed << " changed segments for intersections...\n";
+            }
+        } else if (segments.size() >= 2) { // There can be no intersections if there are less than two segments
+            if (debug) {
+                std::cerr << "Finding intersections...\n";
+            }
+
+            findings = find_intersections(segments, num_threads);
+        }
+    } else {
+        SegmentRuns runs{memory_budget, num_threads};
         if (debug) {
-            std::cerr << "Writing segments to file...\n";
+            std::cerr << "Setting up segments in sorted runs...\n";
         }
 
-        const auto length = segments.size() * sizeof(osmium::UndirectedSegment);
-#ifndef _MSC_VER
-        if (::write(segments_fd, segments.data(), length) != static_cast<ssize_t>(length)) {
-#else
-        if (_write(segments_fd, segments.data(), length) != static_cast<int>(length)) {
-#endif
-            throw std::runtime_error{"Write error"};
+        for_each_ring([&](const CoastlineRing& ring) {
+            ring.for_each_segment([&](const osmium::UndirectedSegment& segment, osmium::object_id_type way_id) {
+                runs.add(segment, segments_fd >= 0 ? source(ring, way_id) : 0);
+            });
+        });
+
+        if (debug) {
+            std::cerr << "Merging " << runs.num_runs() << " runs and finding intersections...\n";
         }
-    }
 
-    // There can be no intersections if there are less than two segments
-    if (segments.size() < 2) {
-        return 0;
+        // The merged segments are written to the segments file and checked
+        // for intersections on the fly, so they are never all in memory.
+        IntersectionSweep sweep;
+        std::size_t index = 0;
+        runs.merge([&](const osmium::UndirectedSegment& segment, uint32_t segment_source) {
+            if (segments_fd >= 0) {
+                segment_writer.add(segment, sources[segment_source]);
+            }
+            sweep.add(index++, segment);
+        });
+
+        findings = std::move(sweep.findings());
+        std::sort(findings.begin(), findings.end());
     }
 
-    if (debug) {
-        std::cerr << "Finding intersections...\n";
+    // The findings are written to the segments file, so the next run can
+    // use them for an incremental check.
+    for (const auto& finding : findings) {
+        segment_writer.add_finding(finding_record{finding.segment, finding.second_segment, finding.location,
+                                                  finding.type == segment_finding::kind::overlap});
     }
+    segment_writer.close();
 
     std::vector<osmium::Location> intersections;
-    for (auto it1 = segments.cbegin(); it1 != segments.cend() - 1; ++it1) {
-        const osmium::UndirectedSegment& s1 = *it1;
-        for (auto it2 = it1 + 1; it2 != segments.cend(); ++it2) {
-            const osmium::UndirectedSegment& s2 = *it2;
-            if (s1 == s2) {
-                std::unique_ptr<OGRLineString> line = create_ogr_linestring(s1);
-                output.add_error_line(std::move(line), "overlap");
-                overlaps++;
-            } else {
-                if (outside_x_range(s2, s1)) {
-                    break;
-                }
-                if (y_range_overlap(s1, s2)) {
-                    osmium::Location i = intersection(s1, s2);
-                    if (i) {
-                        intersections.push_back(i);
-                    }
-                }
-            }
+    for (const auto& finding : findings) {
+        if (finding.type == segment_finding::kind::overlap) {
+            std::unique_ptr<OGRLineString> line = create_ogr_linestring(finding.segment);
+            output.add_error_line(std::move(line), "overlap");
+            overlaps++;
+        } else {
+            intersections.push_back(finding.location);
         }
     }
 
@@ -316,63 +367,187 @@ unsigned int CoastlineRingCollection::check_for_intersections(OutputDatabase& ou
         output.add_error_point(std::move(point), "intersection");
     }
 
+    if (debug) {
+        std::cerr << "Marking clean rings...\n";
+    }
+    mark_clean_rings(findings, num_threads);
+
     return intersections.size() + overlaps;
 }
 
+void CoastlineRingCollection::mark_clean_rings(const std::vector<segment_finding>& findings, int num_threads) {
+    std::vector<osmium::UndirectedSegment> flagged;
+    flagged.reserve(findings.size() * 2);
+    for (const auto& finding : findings) {
+        flagged.push_back(finding.segment);
+        flagged.push_back(finding.second_segment);
+    }
+    std::sort(flagged.begin(), flagged.end());
+    flagged.erase(std::unique(flagged.begin(), flagged.end()), flagged.end());
+
+    std::unique_ptr<osmium::thread::Pool> pool;
+    if (num_threads > 1) {
+        pool.reset(new osmium::thread::Pool{num_threads});
+    }
+
+    run_chunked(pool.get(), m_rings.size(), [&](std::size_t n) {
+        if (m_removed[n]) {
+            return;
+        }
+        CoastlineRing& ring = m_rings[n];
+        bool clean = !ring.has_repeated_locations_or_spikes();
+        if (clean && !flagged.empty()) {
+            ring.for_each_segment([&](const osmium::UndirectedSegment& segment, osmium::object_id_type /*way_id*/) {
+                if (std::binary_search(flagged.begin(), flagged.end(), segment)) {
+                    clean = false;
+                }
+            });
+        }
+        ring.set_clean(clean);
+    });
+}
+
 bool CoastlineRingCollection::close_antarctica_ring(int epsg) {
-    for (const auto& ring : m_list) {
-        const osmium::Location fpos = ring->first_location();
-        const osmium::Location lpos = ring->last_location();
+    for (std::size_t i = 0; i < m_rings.size(); ++i) {
+        if (m_removed[i]) {
+            continue;
+        }
+        CoastlineRing& ring = m_rings[i];
+        const osmium::Location fpos = ring.first_location();
+        const osmium::Location lpos = ring.last_location();
         if (fpos.lon() > 179.99 && lpos.lon() < -179.99 &&
             fpos.lat() <  -77.0 && fpos.lat() >  -78.0 &&
             lpos.lat() <  -77.0 && lpos.lat() >  -78.0) {
 
-            m_end_nodes.erase(ring->last_node_id());
-            m_start_nodes.erase(ring->first_node_id());
-            ring->close_antarctica_ring(epsg);
+            m_end_nodes.erase(ring.last_node_id());
+            m_start_nodes.erase(ring.first_node_id());
+            ring.close_antarctica_ring(epsg);
             return true;
         }
     }
     return false;
 }
 
-void CoastlineRingCollection::close_rings(OutputDatabase& output, bool debug, double max_distance) {
-    std::vector<Connection> connections;
+namespace {
 
-    // Create vector with all possible combinations of connections between rings.
-    for (const auto& end_node : m_end_nodes) {
-        for (const auto& start_node : m_start_nodes) {
-            const double distance = (*start_node.second)->distance_to_start_location((*end_node.second)->last_location());
-            if (distance < max_distance) {
-                connections.emplace_back(distance, end_node.first, start_node.first);
+    // Locations have a resolution of 1e-7 degrees, smaller grid cells
+    // don't help. With this minimum the cell numbers of all valid
+    // locations fit easily into an int64_t.
+    constexpr const double min_cell_size = 1e-7;
+
+    /**
+     * Start nodes of rings sorted into the cells of a regular grid so
+     * we can quickly find all start nodes near some location.
+     */
+    class StartNodeGrid {
+
+        struct entry {
+            int64_t cx;
+            int64_t cy;
+            osmium::object_id_type id;
+            uint32_t handle;
+
+            friend bool operator<(const entry& a, const entry& b) noexcept {
+                return std::tie(a.cx, a.cy, a.id) < std::tie(b.cx, b.cy, b.id);
             }
+        };
+
+        std::vector<entry> m_entries;
+        double m_cell_size;
+
+        int64_t cell(double coordinate) const noexcept {
+            return static_cast<int64_t>(std::floor(coordinate / m_cell_size));
         }
-    }
 
-    // Sort vector by distance, shortest at end.
-    std::sort(connections.begin(), connections.end(), Connection::sort_by_distance);
+    public:
 
-    // Go through vector starting with the shortest connections and close rings
-    // using the connections in turn.
-    while (!connections.empty()) {
-        Connection conn = connections.back();
-        connections.pop_back();
+        explicit StartNodeGrid(double cell_size) :
+            m_cell_size(std::max(cell_size, min_cell_size)) {
+        }
 
-        // Invalidate all other connections using one of the same end points.
-        connections.erase(remove_if(connections.begin(), connections.end(), conn), connections.end());
+        void add(osmium::Location location, osmium::object_id_type id, uint32_t handle) {
+            m_entries.push_back(entry{cell(location.lon()), cell(location.lat()), id, handle});
+        }
 
-        const auto eit = m_end_nodes.find(conn.start_id);
-        const auto sit = m_start_nodes.find(conn.end_id);
+        void sort() {
+            std::sort(m_entries.begin(), m_entries.end());
+        }
 
-        if (eit != m_end_nodes.end() && sit != m_start_nodes.end()) {
+        /**
+         * Call func(id, handle) for all start nodes in the grid cell
+         * of the location and all neighbouring grid cells.
+         */
+        template <typename TFunc>
+        void for_each_near(osmium::Location location, TFunc&& func) const {
+            const int64_t cx = cell(location.lon());
+            const int64_t cy = cell(location.lat());
+            for (int64_t x = cx - 1; x <= cx + 1; ++x) {
+                const auto begin = std::lower_bound(m_entries.cbegin(), m_entries.cend(), entry{x, cy - 1, std::numeric_limits<osmium::object_id_type>::min(), 0});
+                for (auto it = begin; it != m_entries.cend() && it->cx == x && it->cy <= cy + 1; ++it) {
+                    std::forward<TFunc>(func)(it->id, it->handle);
+                }
+            }
+        }
+
+    }; // class StartNodeGrid
+
+} // anonymous namespace
+
+void CoastlineRingCollection::close_rings(OutputDatabase& output, bool debug, double max_distance) {
+    if (max_distance <= 0) {
+        return;
+    }
+
+    // Put all start nodes into a grid with cells large enough that all
+    // start nodes closer than max_distance to an end node are in the same
+    // or a neighbouring cell. (The distance is squared.)
+    StartNodeGrid grid{std::sqrt(max_distance) * (1.0 + 1e-9)};
+    m_start_nodes.for_each([&](osmium::object_id_type id, ring_handle handle) {
+        grid.add(m_rings[handle].first_location(), id, handle);
+    });
+    grid.sort();
+
+    // Create vector with all possible connections between end nodes and
+    // start nodes nearby.
+    std::vector<Connection> connections;
+    m_end_nodes.for_each([&](osmium::object_id_type end_id, ring_handle end_handle) {
+        const osmium::Location end_location = m_rings[end_handle].last_location();
+        grid.for_each_near(end_location, [&](osmium::object_id_type start_id, ring_handle start_handle) {
+            const double distance = m_rings[start_handle].distance_to_start_location(end_location);
+            if (distance < max_distance) {
+                connections.emplace_back(distance, end_id, start_id);
+            }
+        });
+    });
+
+    // Sort vector by distance, shortest first.
+    std::sort(connections.begin(), connections.end());
+
+    // Go through vector starting with the shortest connections and close
+    // rings using the connections in turn. Once a node was used in a
+    // connection, all other connections using the same node are skipped.
+    NodeIdMap used_end_nodes;
+    NodeIdMap used_start_nodes;
+    for (const auto& conn : connections) {
+        if (used_end_nodes.find(conn.start_id) != NodeIdMap::not_found ||
+            used_start_nodes.find(conn.end_id) != NodeIdMap::not_found) {
+            continue;
+        }
+        used_end_nodes.set(conn.start_id, 0);
+        used_start_nodes.set(conn.end_id, 0);
+
+        const auto ehandle = m_end_nodes.find(conn.start_id);
+        const auto shandle = m_start_nodes.find(conn.end_id);
+
+        if (ehandle != NodeIdMap::not_found && shandle != NodeIdMap::not_found) {
             if (debug) {
                 std::cerr << "Closing ring between node " << conn.end_id << " and node " << conn.start_id << "\n";
             }
 
             m_fixed_rings++;
 
-            CoastlineRing* e = eit->second->get();
-            CoastlineRing* s = sit->second->get();
+            CoastlineRing* e = &m_rings[ehandle];
+            CoastlineRing* s = &m_rings[shandle];
 
             output.add_error_point(e->ogr_last_point(), "fixed_end_point", e->last_node_id());
             output.add_error_point(s->ogr_first_point(), "fixed_end_point", s->first_node_id());
@@ -388,24 +563,24 @@ void CoastlineRingCollection::close_rings(OutputDatabase& output, bool debug, do
                 // connect to itself by closing ring
                 e->close_ring();
 
-                m_end_nodes.erase(eit);
-                m_start_nodes.erase(sit);
+                m_end_nodes.erase(conn.start_id);
+                m_start_nodes.erase(conn.end_id);
             } else {
                 // connect to other ring
                 e->join_over_gap(*s);
 
-                m_list.erase(sit->second);
+                remove_ring(shandle);
                 if (e->first_location() == e->last_location()) {
                     output.add_error_point(e->ogr_first_point(), "double_node", e->first_node_id());
                     m_start_nodes.erase(e->first_node_id());
-                    m_end_nodes.erase(eit);
-                    m_start_nodes.erase(sit);
+                    m_end_nodes.erase(conn.start_id);
+                    m_start_nodes.erase(conn.end_id);
                     m_end_nodes.erase(e->last_node_id());
                     e->fake_close();
                 } else {
-                    m_end_nodes[e->last_node_id()] = eit->second;
-                    m_end_nodes.erase(eit);
-                    m_start_nodes.erase(sit);
+                    m_end_nodes.set(e->last_node_id(), ehandle);
+                    m_end_nodes.erase(conn.start_id);
+                    m_start_nodes.erase(conn.end_id);
                 }
             }
         }
@@ -428,12 +603,12 @@ unsigned int CoastlineRingCollection::output_questionable(const CoastlinePolygon
     using lcrp_type = std::pair<osmium::Location, CoastlineRing*>;
 
     std::vector<lcrp_type> rings;
-    rings.reserve(m_list.size());
+    rings.reserve(size());
 
     // put all rings in a vector...
-    for (const auto& ring : m_list) {
-        rings.emplace_back(ring->first_location(), ring.get());
-    }
+    for_each_ring([&rings](CoastlineRing& ring) {
+        rings.emplace_back(ring.first_location(), &ring);
+    });
 
     // comparison function that ignores the second part of the pair
     const auto comp = [](const lcrp_type& a, const lcrp_type& b){
@@ -445,9 +620,8 @@ unsigned int CoastlineRingCollection::output_questionable(const CoastlinePolygon
 
     // go through all the polygons that have been created before and mark the outer rings
     for (const auto& polygon : polygons) {
-        const OGRLinearRing* exterior_ring = polygon->getExteriorRing();
-        assert(exterior_ring);
-        osmium::Location pos{exterior_ring->getX(0), exterior_ring->getY(0)};
+        assert(!polygon.empty());
+        osmium::Location pos{polygon.x(0), polygon.y(0)};
         const auto rings_it = lower_bound(rings.begin(), rings.end(), lcrp_type{pos, nullptr}, comp);
         if (rings_it != rings.end()) {
             rings_it->second->set_outer();
@@ -455,14 +629,14 @@ unsigned int CoastlineRingCollection::output_questionable(const CoastlinePolygon
     }
 
     // find all rings not marked as outer and output them to the error_lines table
-    for (const auto& ring : m_list) {
-        if (!ring->is_outer()) {
-            if (ring->is_closed() && ring->npoints() > 3 && ring->npoints() < max_nodes_to_be_considered_questionable) {
-                output.add_error_line(ring->ogr_linestring(m_factory, false), "questionable", ring->ring_id());
+    for_each_ring([&](const CoastlineRing& ring) {
+        if (!ring.is_outer()) {
+            if (ring.is_closed() && ring.npoints() > 3 && ring.npoints() < max_nodes_to_be_considered_questionable) {
+                add_ring_error_line(output, ring, false, "questionable");
                 warnings++;
             }
         }
-    }
+    });
 
     return warnings;
 }
@@ -22,54 +22,102 @@
 
 */
 
+#include "coastline_node_store.hpp"
 #include "coastline_ring.hpp"
+#include "node_id_map.hpp"
+#include "polygon.hpp"
 
-#include <osmium/geom/ogr.hpp>
 #include <osmium/osm/way.hpp>
 #include <osmium/osm/types.hpp>
 
+#include <cassert>
 #include <cstddef>
-#include <list>
-#include <map>
+#include <cstdint>
 #include <memory>
+#include <utility>
 #include <vector>
 
-class OGRGeometry;
 class OutputDatabase;
 class CoastlinePolygons;
-
-using coastline_rings_list_type = std::list<std::shared_ptr<CoastlineRing>>;
-using idmap_type = std::map<osmium::object_id_type, coastline_rings_list_type::iterator>;
+class SegmentFileReader;
+struct segment_finding;
 
 /**
  * A collection of CoastlineRing objects. Keeps a list of all start and end
  * nodes so it can efficiently join CoastlineRings.
+ *
+ * The rings are kept in a vector and referenced by their index in that
+ * vector (the ring handle). Rings that have been joined to other rings
+ * are not removed from the vector, but only marked as removed.
  */
 class CoastlineRingCollection {
 
-    coastline_rings_list_type m_list;
+    using ring_handle = NodeIdMap::mapped_type;
+
+    // Storage for the nodes of all rings.
+    CoastlineNodeStore m_node_store;
+
+    std::vector<CoastlineRing> m_rings;
+
+    // Marks rings that have been joined to other rings.
+    std::vector<bool> m_removed;
+
+    // Number of rings not marked as removed.
+    std::size_t m_num_rings = 0;
 
     // Mapping from node IDs to CoastlineRings.
-    idmap_type m_start_nodes;
-    idmap_type m_end_nodes;
+    NodeIdMap m_start_nodes;
+    NodeIdMap m_end_nodes;
 
     unsigned int m_ways = 0;
     unsigned int m_rings_from_single_way = 0;
     unsigned int m_fixed_rings = 0;
 
+    ring_handle add_ring(const osmium::Way& way);
+
+    void remove_ring(ring_handle handle) noexcept {
+        assert(!m_removed[handle]);
+        m_removed[handle] = true;
+        --m_num_rings;
+    }
+
     void add_partial_ring(const osmium::Way& way);
 
-    osmium::geom::OGRFactory<> m_factory;
+    /// Call func for each ring not marked as removed.
+    template <typename TFunc>
+    void for_each_ring(TFunc&& func) {
+        for (std::size_t i = 0; i < m_rings.size(); ++i) {
+            if (!m_removed[i]) {
+                std::forward<TFunc>(func)(m_rings[i]);
+            }
+        }
+    }
 
-public:
+    /**
+     * Mark all rings as clean which have none of their segments in the
+     * findings of the check for intersections and no repeated locations
+     * or spikes. The polygons created from those rings don't need to be
+     * checked for validity. This is done on num_threads threads.
+     */
+    void mark_clean_rings(const std::vector<segment_finding>& findings, int num_threads);
 
-    using const_iterator = coastline_rings_list_type::const_iterator;
+public:
 
     CoastlineRingCollection() = default;
 
+    // The rings keep pointers to the node store, so this can't be copied
+    // or moved.
+    CoastlineRingCollection(const CoastlineRingCollection&) = delete;
+    CoastlineRingCollection& operator=(const CoastlineRingCollection&) = delete;
+
+    CoastlineRingCollection(CoastlineRingCollection&&) = delete;
+    CoastlineRingCollection& operator=(CoastlineRingCollection&&) = delete;
+
+    ~CoastlineRingCollection() noexcept = default;
+
     /// Return the number of CoastlineRings in the collection.
     std::size_t size() const noexcept {
-        return m_list.size();
+        return m_num_rings;
     }
 
     /**
@@ -81,7 +129,7 @@ public:
         m_ways++;
         if (way.is_closed()) {
             m_rings_from_single_way++;
-            m_list.push_back(std::make_shared<CoastlineRing>(way));
+            add_ring(way);
         } else {
             add_partial_ring(way);
         }
@@ -103,18 +151,55 @@ public:
         return m_fixed_rings;
     }
 
-    void setup_locations(locmap_type& locmap);
+    /**
+     * Add the slots for the locations of all nodes in all rings to the
+     * locmap. Call sort() on the locmap before using it.
+     */
+    void setup_locations(LocationMap& locmap);
 
     unsigned int check_locations(bool output_missing);
 
-    std::vector<OGRGeometry*> add_polygons_to_vector();
+    /**
+     * Release the memory used for the node IDs of all nodes in all rings.
+     * Call this after all locations have been found. The IDs of the first
+     * and last nodes of all rings are still available afterwards.
+     */
+    void drop_node_ids() noexcept {
+        m_node_store.drop_ids();
+    }
+
+    /**
+     * Create polygons (without holes) from all closed rings with enough
+     * points. Invalid ones are repaired if possible, otherwise left out.
+     * The polygons are validated on num_threads threads.
+     */
+    polygon_vector_type add_polygons_to_vector(int num_threads);
 
-    unsigned int output_rings(OutputDatabase& output);
+    /**
+     * Write all rings to the output. Rings that are not closed or have too
+     * few points are written as errors. The rings are validated on
+     * num_threads threads.
+     */
+    unsigned int output_rings(OutputDatabase& output, int num_threads);
 
-    unsigned int check_for_intersections(OutputDatabase& output, int segments_fd);
+    /**
+     * Check all segments of all rings for intersections and overlaps and
+     * write them to the output. The check is done on num_threads threads.
+     * If memory_budget is not 0, the segments are sorted in runs on disk
+     * using only about this many bytes of memory. If previous is not
+     * nullptr, only the segments that changed since the run that wrote
+     * this segments file are checked (this needs memory_budget 0).
+     * Returns the number of intersections and overlaps found.
+     */
+    unsigned int check_for_intersections(OutputDatabase& output, int segments_fd, SegmentFileReader* previous, int num_threads, std::size_t memory_budget);
 
     bool close_antarctica_ring(int epsg);
 
+    /**
+     * Close rings by connecting end nodes to start nodes (of the same or
+     * other rings) nearby. Shorter connections are used first. The
+     * max_distance is compared to the squared distance in degrees.
+     */
     void close_rings(OutputDatabase& output, bool debug, double max_distance);
 
     unsigned int output_questionable(const CoastlinePolygons& polygons, OutputDatabase& output);
@@ -133,17 +218,16 @@ private:
             end_id(e) {
         }
 
-        /**
-        * Returns true if start or end ID of this connection is the same as the
-        * other connections start or end ID. Used as predicate in std::remove_if().
-        */
-        bool operator()(const Connection& other) const noexcept {
-            return start_id == other.start_id || end_id == other.end_id;
-        }
-
-        // Used in std::sort
-        static bool sort_by_distance(const Connection& a, const Connection& b) noexcept {
-            return a.distance > b.distance;
+        // Shortest connections first, node IDs break ties so the order is
+        // always the same.
+        friend bool operator<(const Connection& a, const Connection& b) noexcept {
+            if (a.distance != b.distance) {
+                return a.distance < b.distance;
+            }
+            if (a.start_id != b.start_id) {
+                return a.start_id < b.start_id;
+            }
+            return a.end_id < b.end_id;
         }
 
     }; // struct Connection
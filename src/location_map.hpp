@@ -0,0 +1,122 @@
+#ifndef LOCATION_MAP_HPP
+#define LOCATION_MAP_HPP
+
+/*
+
+  Copyright 2012-2021 Jochen Topf <jochen@topf.org>.
+
+  This file is part of OSMCoastline.
+
+  OSMCoastline is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  OSMCoastline is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with OSMCoastline.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include <osmium/osm/location.hpp>
+#include <osmium/osm/types.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+/**
+ * Maps node IDs to the places where the locations of those nodes have to
+ * be stored once they are known.
+ *
+ * This is a flat vector of (node ID, location pointer) pairs sorted by node
+ * ID. The same node ID can appear several times (for instance for the first
+ * and last node of a closed ring), those entries form a run in the vector.
+ *
+ * Nodes in OSM files are usually sorted by ID, so the locations are filled
+ * in using a cursor that only moves forward through the vector (a merge join
+ * between the nodes in the file and the IDs in this map). If a node comes
+ * along with an ID smaller than the one before, we fall back to a binary
+ * search, so unsorted input still works, it is just slower.
+ */
+class LocationMap {
+
+    using value_type = std::pair<osmium::object_id_type, osmium::Location*>;
+    using vector_type = std::vector<value_type>;
+
+    vector_type m_slots;
+
+    vector_type::const_iterator m_cursor;
+
+    osmium::object_id_type m_last_id = 0;
+
+    bool m_started = false;
+
+    static bool compare_id(const value_type& lhs, const value_type& rhs) noexcept {
+        return lhs.first < rhs.first;
+    }
+
+public:
+
+    LocationMap() :
+        m_slots(),
+        m_cursor(m_slots.cbegin()) {
+    }
+
+    void reserve(std::size_t size) {
+        m_slots.reserve(size);
+    }
+
+    /// The number of slots in this map.
+    std::size_t size() const noexcept {
+        return m_slots.size();
+    }
+
+    /**
+     * Add a slot for the location of the node with the specified ID.
+     * Call sort() after adding all slots.
+     */
+    void add(osmium::object_id_type id, osmium::Location* location) {
+        m_slots.emplace_back(id, location);
+    }
+
+    /**
+     * Sort the map by node ID. Must be called after all slots are added
+     * and before set_location() is called.
+     */
+    void sort() {
+        std::sort(m_slots.begin(), m_slots.end(), compare_id);
+        m_cursor = m_slots.cbegin();
+        m_started = false;
+    }
+
+    /**
+     * Set the location in all slots registered for the node ID. If there
+     * are no slots for this ID, nothing happens.
+     */
+    void set_location(osmium::object_id_type id, const osmium::Location& location) {
+        if (m_started && id <= m_last_id) {
+            m_cursor = std::lower_bound(m_slots.cbegin(), m_slots.cend(), value_type{id, nullptr}, compare_id);
+        } else {
+            while (m_cursor != m_slots.cend() && m_cursor->first < id) {
+                ++m_cursor;
+            }
+        }
+
+        m_started = true;
+        m_last_id = id;
+
+        while (m_cursor != m_slots.cend() && m_cursor->first == id) {
+            *(m_cursor->second) = location;
+            ++m_cursor;
+        }
+    }
+
+}; // class LocationMap
+
+#endif // LOCATION_MAP_HPP
@@ -0,0 +1,174 @@
+#ifndef NODE_ID_MAP_HPP
+#define NODE_ID_MAP_HPP
+
+/*
+
+  Copyright 2012-2021 Jochen Topf <jochen@topf.org>.
+
+  This file is part of OSMCoastline.
+
+  OSMCoastline is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  OSMCoastline is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with OSMCoastline.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include <osmium/osm/types.hpp>
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+/**
+ * Hash map from node IDs to 32bit values using open addressing with
+ * linear probing. Erasing entries uses backward shifting, so there are no
+ * tombstones and lookups stay fast even after many erases.
+ *
+ * The smallest possible node ID is used to mark empty slots, it can't be
+ * used as a key.
+ */
+class NodeIdMap {
+
+public:
+
+    using key_type = osmium::object_id_type;
+    using mapped_type = uint32_t;
+
+    /// Returned from find() if the key is not in the map.
+    static constexpr const mapped_type not_found = std::numeric_limits<mapped_type>::max();
+
+private:
+
+    static constexpr const key_type empty_key = std::numeric_limits<key_type>::min();
+
+    struct slot {
+        key_type key;
+        mapped_type value;
+    };
+
+    std::vector<slot> m_slots;
+    std::size_t m_size = 0;
+    std::size_t m_mask = 0;
+
+    std::size_t bucket(key_type key) const noexcept {
+        // Fibonacci hashing, spreads the (often sequential) node IDs
+        // evenly over the table.
+        return static_cast<std::size_t>((static_cast<uint64_t>(key) * 0x9e3779b97f4a7c15ULL) >> 32U) & m_mask;
+    }
+
+    std::size_t find_slot(key_type key) const noexcept {
+        std::size_t n = bucket(key);
+        while (m_slots[n].key != empty_key && m_slots[n].key != key) {
+            n = (n + 1) & m_mask;
+        }
+        return n;
+    }
+
+    void rehash(std::size_t new_capacity) {
+        std::vector<slot> old_slots(new_capacity, slot{empty_key, 0});
+        m_slots.swap(old_slots);
+        m_mask = new_capacity - 1;
+        for (const auto& s : old_slots) {
+            if (s.key != empty_key) {
+                m_slots[find_slot(s.key)] = s;
+            }
+        }
+    }
+
+public:
+
+    explicit NodeIdMap(std::size_t capacity = 1024) :
+        m_slots(capacity, slot{empty_key, 0}),
+        m_mask(capacity - 1) {
+        // capacity must be a power of two
+        assert(capacity > 0 && (capacity & (capacity - 1)) == 0);
+    }
+
+    std::size_t size() const noexcept {
+        return m_size;
+    }
+
+    bool empty() const noexcept {
+        return m_size == 0;
+    }
+
+    /// Find the value for the key or return not_found.
+    mapped_type find(key_type key) const noexcept {
+        const auto& s = m_slots[find_slot(key)];
+        if (s.key == key) {
+            return s.value;
+        }
+        return not_found;
+    }
+
+    /// Set the value for the key, replacing any existing value.
+    void set(key_type key, mapped_type value) {
+        assert(key != empty_key);
+        if ((m_size + 1) * 4 > m_slots.size() * 3) {
+            rehash(m_slots.size() * 2);
+        }
+        auto& s = m_slots[find_slot(key)];
+        if (s.key == empty_key) {
+            s.key = key;
+            ++m_size;
+        }
+        s.value = value;
+    }
+
+    /// Remove the key from the map. Returns true if it was in the map.
+    bool erase(key_type key) noexcept {
+        std::size_t n = find_slot(key);
+        if (m_slots[n].key == empty_key) {
+            return false;
+        }
+
+        // Move following entries of the same probe sequence back so there
+        // are no holes in it.
+        std::size_t next = n;
+        while (true) {
+            next = (next + 1) & m_mask;
+            if (m_slots[next].key == empty_key) {
+                break;
+            }
+            const std::size_t home = bucket(m_slots[next].key);
+            // Can the entry at next be moved to n? Only if its home bucket
+            // is not in the (cyclic) range (n, next].
+            if ((next > n && (home <= n || home > next)) ||
+                (next < n && (home <= n && home > next))) {
+                m_slots[n] = m_slots[next];
+                n = next;
+            }
+        }
+        m_slots[n].key = empty_key;
+        --m_size;
+        return true;
+    }
+
+    /**
+     * Call func(key, value) for each entry in the map. The order is
+     * unspecified.
+     */
+    template <typename TFunc>
+    void for_each(TFunc&& func) const {
+        for (const auto& s : m_slots) {
+            if (s.key != empty_key) {
+                std::forward<TFunc>(func)(s.key, s.value);
+            }
+        }
+    }
+
+}; // class NodeIdMap
+
+#endif // NODE_ID_MAP_HPP
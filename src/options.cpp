@@ -35,28 +35,50 @@
 
 #include <osmium/io/pbf.hpp>
 
+// Every tile without land gets a water polygon covering the whole tile, so
+// there are about 4^zoom features. Larger zoom levels would create far too
+// many of them.
+static constexpr const int max_split_grid_zoom = 10;
+
 static void print_help() {
     std::cout << "Usage: osmcoastline [OPTIONS] OSMFILE\n"
               << "\nOptions:\n"
               << "  -h, --help                 - This help message\n"
+              << "  -a, --apply-changes=FILE   - Apply OSM change file to ways from cache\n"
+              << "                               (needs -R/--read-cache, OSMFILE is optional\n"
+              << "                               and only used for missing node locations)\n"
+              << "  -C, --write-cache=FILE     - Write coastline ways to given cache file\n"
               << "  -c, --close-distance=DIST  - Distance between nodes under which open rings\n"
               << "                               are closed (0 - disable closing of rings)\n"
               << "  -b, --bbox-overlap=OVERLAP - Set overlap when splitting polygons\n"
               << "  -i, --no-index             - Do not create spatial indexes in output db\n"
               << "  -d, --debug                - Enable debugging output\n"
+              << "  -e, --split-method=bisect|median|cells\n"
+              << "                             - How large polygons are split (default: bisect)\n"
               << "  -f, --overwrite            - Overwrite output file if it already exists\n"
+              << "  -F, --input-format=FORMAT  - Format of input file (default: autodetect)\n"
               << "  -g, --gdal-driver=DRIVER   - GDAL driver (SQLite or ESRI Shapefile)\n"
               << "  -l, --output-lines         - Output coastlines as lines to database file\n"
               << "  -m, --max-points=NUM       - Split lines/polygons with more than this many\n"
               << "                               points (0 - disable splitting)\n"
+              << "  -M, --segments-memory=MB   - Sort segments on disk using about this much\n"
+              << "                               memory (0 - keep all in memory (default))\n"
               << "  -o, --output-database=FILE - Database file for output\n"
               << "  -p, --output-polygons=land|water|both|none\n"
               << "                             - Which polygons to write out (default: land)\n"
+              << "  -P, --previous-segments=FILE\n"
+              << "                             - Only check segments for intersections that\n"
+              << "                               changed since the run that wrote this file\n"
               << "  -r, --output-rings         - Output rings to database file\n"
+              << "  -R, --read-cache=FILE      - Read coastline ways from given cache file\n"
+              << "                               instead of OSMFILE\n"
               << "  -s, --srs=EPSGCODE         - Set SRS (4326 for WGS84 (default) or 3857)\n"
               << "  -S, --write-segments=FILE  - Write segments to given file\n"
+              << "  -t, --threads=NUM          - Number of threads to use (default: 1)\n"
               << "  -v, --verbose              - Verbose output\n"
               << "  -V, --version              - Show version and exit\n"
+              << "  -z, --split-grid=ZOOM      - Split polygons into the tiles of this zoom\n"
+              << "                               level (0 to 10, needs -s/--srs=3857)\n"
               << "\n";
 }
 
@@ -82,41 +104,60 @@ static int get_epsg(const char* text) {
 
 Options::Options(int argc, char* argv[]) {
     static struct option long_options[] = {
+        {"apply-changes",   required_argument, nullptr, 'a'},
         {"bbox-overlap",    required_argument, nullptr, 'b'},
         {"close-distance",  required_argument, nullptr, 'c'},
         {"no-index",              no_argument, nullptr, 'i'},
         {"debug",                 no_argument, nullptr, 'd'},
+        {"split-method",    required_argument, nullptr, 'e'},
         {"gdal-driver",     required_argument, nullptr, 'g'},
         {"help",                  no_argument, nullptr, 'h'},
+        {"input-format",    required_argument, nullptr, 'F'},
         {"output-lines",          no_argument, nullptr, 'l'},
         {"max-points",      required_argument, nullptr, 'm'},
+        {"segments-memory", required_argument, nullptr, 'M'},
         {"output-database", required_argument, nullptr, 'o'},
         {"output-polygons", required_argument, nullptr, 'p'},
+        {"previous-segments", required_argument, nullptr, 'P'},
         {"output-rings",          no_argument, nullptr, 'r'},
+        {"read-cache",      required_argument, nullptr, 'R'},
         {"overwrite",             no_argument, nullptr, 'f'},
         {"srs",             required_argument, nullptr, 's'},
         {"write-segments",  required_argument, nullptr, 'S'},
+        {"threads",         required_argument, nullptr, 't'},
+        {"write-cache",     required_argument, nullptr, 'C'},
         {"verbose",               no_argument, nullptr, 'v'},
         {"version",               no_argument, nullptr, 'V'},
+        {"split-grid",      required_argument, nullptr, 'z'},
         {nullptr,                           0, nullptr, 0}
     };
 
     while (true) {
-        const int c = getopt_long(argc, argv, "b:c:idg:hlm:o:p:rfs:S:vV", long_options, nullptr);
+        const int c = getopt_long(argc, argv, "a:b:c:C:ide:g:hF:lm:M:o:p:P:rR:fs:S:t:vVz:", long_options, nullptr);
         if (c == -1) {
             break;
         }
 
         switch (c) {
+            case 'a':
+                change_file = optarg;
+                break;
             case 'b':
                 bbox_overlap = std::atof(optarg); // NOLINT(cert-err34-c) atof is good enough for this use case
                 break;
             case 'c':
                 close_distance = std::atoi(optarg); // NOLINT(cert-err34-c) atoi is good enough for this use case
+                if (close_distance < 0) {
+                    std::cerr << "The -c/--close-distance option needs a number not smaller than 0\n";
+                    std::exit(return_code_cmdline);
+                }
                 if (close_distance == 0) {
                     close_rings = false;
                 }
                 break;
+            case 'C':
+                write_cache = optarg;
+                break;
             case 'i':
                 create_index = false;
                 break;
@@ -124,12 +165,27 @@ Options::Options(int argc, char* argv[]) {
                 debug = true;
                 std::cerr << "Enabled debug option\n";
                 break;
+            case 'e':
+                if (!std::strcmp(optarg, "bisect")) {
+                    split_method = split_method_type::bisect;
+                } else if (!std::strcmp(optarg, "cells")) {
+                    split_method = split_method_type::cells;
+                } else if (!std::strcmp(optarg, "median")) {
+                    split_method = split_method_type::median;
+                } else {
+                    std::cerr << "Unknown argument '" << optarg << "' for -e/--split-method option\n";
+                    std::exit(return_code_cmdline);
+                }
+                break;
             case 'h':
                 print_help();
                 std::exit(return_code_ok);
             case 'g':
                 driver = optarg;
                 break;
+            case 'F':
+                input_format = optarg;
+                break;
             case 'l':
                 output_lines = true;
                 break;
@@ -139,6 +195,15 @@ Options::Options(int argc, char* argv[]) {
                     split_large_polygons = false;
                 }
                 break;
+            case 'M': {
+                const int mbytes = std::atoi(optarg); // NOLINT(cert-err34-c) atoi is good enough for this use case
+                if (mbytes < 0) {
+                    std::cerr << "The -M/--segments-memory option needs a number not smaller than 0\n";
+                    std::exit(return_code_cmdline);
+                }
+                segments_memory = static_cast<std::size_t>(mbytes) * 1024U * 1024U;
+                break;
+            }
             case 'p':
                 if (!std::strcmp(optarg, "none")) {
                     output_polygons = output_polygon_type::none;
@@ -153,12 +218,18 @@ Options::Options(int argc, char* argv[]) {
                     std::exit(return_code_cmdline);
                 }
                 break;
+            case 'P':
+                previous_segments = optarg;
+                break;
             case 'o':
                 output_database = optarg;
                 break;
             case 'r':
                 output_rings = true;
                 break;
+            case 'R':
+                read_cache = optarg;
+                break;
             case 'f':
                 overwrite_output = true;
                 break;
@@ -168,6 +239,13 @@ Options::Options(int argc, char* argv[]) {
             case 'S':
                 segmentfile = optarg;
                 break;
+            case 't':
+                threads = std::atoi(optarg); // NOLINT(cert-err34-c) atoi is good enough for this use case
+                if (threads < 1) {
+                    std::cerr << "The -t/--threads option needs a number larger than 0\n";
+                    std::exit(return_code_cmdline);
+                }
+                break;
             case 'v':
                 verbose = true;
                 break;
@@ -183,17 +261,50 @@ Options::Options(int argc, char* argv[]) {
                           << "This is free software: you are free to change and redistribute it.\n"
                           << "There is NO WARRANTY, to the extent permitted by law.\n";
                 std::exit(return_code_ok);
+            case 'z':
+                split_grid_zoom = std::atoi(optarg); // NOLINT(cert-err34-c) atoi is good enough for this use case
+                if (split_grid_zoom < 0 || split_grid_zoom > max_split_grid_zoom) {
+                    std::cerr << "The -z/--split-grid option needs a zoom level between 0 and " << max_split_grid_zoom << "\n";
+                    std::exit(return_code_cmdline);
+                }
+                break;
             default:
                 std::exit(return_code_cmdline);
         }
     }
 
-    if (!split_large_polygons && (output_polygons == output_polygon_type::water || output_polygons == output_polygon_type::both)) {
+    if (split_grid_zoom >= 0 && epsg != 3857) {
+        std::cerr << "The -z/--split-grid option only works with -s/--srs=3857\n";
+        std::exit(return_code_cmdline);
+    }
+
+    if (!split_large_polygons && split_grid_zoom < 0 && (output_polygons == output_polygon_type::water || output_polygons == output_polygon_type::both)) {
         std::cerr << "Can not use -m/--max-points=0 when writing out water polygons\n";
         std::exit(return_code_cmdline);
     }
 
-    if (optind != argc - 1) {
+    if (!previous_segments.empty() && segments_memory != 0) {
+        std::cerr << "Can not use -P/--previous-segments together with -M/--segments-memory\n";
+        std::exit(return_code_cmdline);
+    }
+
+    if (!read_cache.empty()) {
+        if (optind != argc && change_file.empty()) {
+            std::cerr << "Can not use OSMFILE together with -R/--read-cache option without -a/--apply-changes\n";
+            std::exit(return_code_cmdline);
+        }
+        if (optind < argc - 1) {
+            std::cerr << "Usage: osmcoastline [OPTIONS] OSMFILE\n";
+            std::exit(return_code_cmdline);
+        }
+        if (!write_cache.empty() && change_file.empty()) {
+            std::cerr << "Can not use -R/--read-cache and -C/--write-cache options together without -a/--apply-changes\n";
+            std::exit(return_code_cmdline);
+        }
+    } else if (!change_file.empty()) {
+        std::cerr << "The -a/--apply-changes option needs the -R/--read-cache option\n";
+        std::exit(return_code_cmdline);
+    } else if (optind != argc - 1) {
         std::cerr << "Usage: osmcoastline [OPTIONS] OSMFILE\n";
         std::exit(return_code_cmdline);
     }
@@ -211,6 +322,8 @@ Options::Options(int argc, char* argv[]) {
         }
     }
 
-    inputfile = argv[optind];
+    if (optind < argc) {
+        inputfile = argv[optind];
+    }
 }
 
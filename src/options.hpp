@@ -22,6 +22,7 @@
 
 */
 
+#include <cstddef>
 #include <string>
 
 enum class output_polygon_type {
@@ -31,6 +32,12 @@ enum class output_polygon_type {
     both  = 3
 };
 
+enum class split_method_type {
+    bisect = 0,
+    cells  = 1,
+    median = 2
+};
+
 /**
  * This class encapsulates the command line parsing.
  */
@@ -39,6 +46,9 @@ struct Options {
     /// Input OSM file name.
     std::string inputfile;
 
+    /// Input OSM file format (empty means autodetect from file name).
+    std::string input_format;
+
     /// Overlap when splitting polygons.
     double bbox_overlap = -1.0;
 
@@ -66,6 +76,21 @@ struct Options {
     /// Should large polygons be split?
     bool split_large_polygons = true;
 
+    /// How large polygons are split.
+    split_method_type split_method = split_method_type::bisect;
+
+    /**
+     * Zoom level of the tile grid the polygons are split into. If this is
+     * -1, the polygons are not split into tiles.
+     */
+    int split_grid_zoom = -1;
+
+    /**
+     * Memory (in bytes) used for sorting the segments in the intersection
+     * check. If this is 0, all segments are kept in memory.
+     */
+    std::size_t segments_memory = 0;
+
     /// What polygons should be written out?
     output_polygon_type output_polygons = output_polygon_type::land;
 
@@ -90,12 +115,30 @@ struct Options {
     /// Tolerance for simplification
     double tolerance = 0.0;
 
+    /// Number of threads used for parallel processing.
+    int threads = 1;
+
     /// Verbose output?
     bool verbose = false;
 
     /// Name of optional segment file
     std::string segmentfile;
 
+    /**
+     * Name of optional segment file from a previous run. If set, only
+     * segments that changed since then are checked for intersections.
+     */
+    std::string previous_segments;
+
+    /// Name of optional cache file to write coastline ways to.
+    std::string write_cache;
+
+    /// Name of optional cache file to read coastline ways from.
+    std::string read_cache;
+
+    /// Name of optional OSM change file applied to the ways from the cache.
+    std::string change_file;
+
     Options(int argc, char* argv[]);
 
 }; // struct Options
@@ -19,19 +19,31 @@
 
 */
 
+#include "coastline_cache.hpp"
+#include "coastline_changes.hpp"
 #include "coastline_polygons.hpp"
 #include "coastline_ring_collection.hpp"
+#include "location_map.hpp"
 #include "options.hpp"
 #include "output_database.hpp"
+#include "polygon_nesting.hpp"
+#include "polygon_validation.hpp"
 #include "return_codes.hpp"
+#include "segment_file.hpp"
 #include "srs.hpp"
 #include "stats.hpp"
-#include "util.hpp"
 #include "version.hpp"
 
+#include <osmium/geom/ogr.hpp>
 #include <osmium/io/any_input.hpp>
 #include <osmium/io/file.hpp>
+#include <osmium/io/header.hpp>
+#include <osmium/memory/buffer.hpp>
+#include <osmium/memory/item.hpp>
 #include <osmium/osm/entity_bits.hpp>
+#include <osmium/osm/node.hpp>
+#include <osmium/osm/way.hpp>
+#include <osmium/thread/pool.hpp>
 #include <osmium/util/memory.hpp>
 #include <osmium/util/verbose_output.hpp>
 #include <osmium/visitor.hpp>
@@ -39,10 +51,13 @@
 #include <ogr_core.h>
 #include <ogr_geometry.h>
 
-#include <cassert>
 #include <cerrno>
+#include <cstddef>
+#include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <deque>
+#include <future>
 #include <iostream>
 #include <memory>
 #include <sstream>
@@ -70,72 +85,42 @@ const unsigned int max_warnings = 500;
 /* ================================================== */
 
 /**
- * This function assembles all the coastline rings into one huge multipolygon.
+ * This function assembles all the coastline rings into polygons with holes.
  */
-polygon_vector_type create_polygons(CoastlineRingCollection& coastline_rings, OutputDatabase& output, unsigned int* warnings, unsigned int* errors) {
-    std::vector<OGRGeometry*> all_polygons = coastline_rings.add_polygons_to_vector();
+polygon_vector_type create_polygons(CoastlineRingCollection& coastline_rings, OutputDatabase& output, int num_threads, unsigned int* warnings, unsigned int* errors) {
+    polygon_vector_type all_polygons = coastline_rings.add_polygons_to_vector(num_threads);
 
     if (all_polygons.empty()) {
         throw std::runtime_error{"No polygons created!"};
     }
 
-    int is_valid = false;
-    const char* options[] = {"METHOD=ONLY_CCW", nullptr};
     if (debug) {
-        std::cerr << "Calling organizePolygons()\n";
+        std::cerr << "Nesting " << all_polygons.size() << " rings\n";
     }
-    std::unique_ptr<OGRGeometry> mega_geometry{OGRGeometryFactory::organizePolygons(&all_polygons[0], all_polygons.size(), &is_valid, options)};
+    polygon_vector_type nested_polygons = nest_polygons(std::move(all_polygons), num_threads);
     if (debug) {
-        std::cerr << "organizePolygons() done (" << (is_valid ? "valid" : "invalid") << ")\n";
+        std::cerr << "Nesting done (" << nested_polygons.size() << " polygons)\n";
     }
 
-    if (!mega_geometry) {
-        throw std::runtime_error{"No polygons created!"};
-    }
+    auto results = validate_polygons(nested_polygons, true, num_threads);
 
     polygon_vector_type polygons;
+    polygons.reserve(nested_polygons.size());
 
-    if (mega_geometry->getGeometryType() == wkbPolygon) {
-        if (mega_geometry->IsValid()) {
-            polygons.push_back(static_cast_unique_ptr<OGRPolygon>(std::move(mega_geometry)));
+    for (std::size_t n = 0; n < nested_polygons.size(); ++n) {
+        auto& p = nested_polygons[n];
+        if (results[n].valid) {
+            polygons.push_back(std::move(p));
         } else {
-            std::cerr << "Ignoring invalid polygon geometry.\n";
-            (*errors)++;
-        }
-    } else if (mega_geometry->getGeometryType() != wkbMultiPolygon) {
-        throw std::runtime_error{"mega geometry isn't a (multi)polygon. Something is very wrong!"};
-    } else {
-
-        // This isn't an owning pointer on purpose. We are going to "steal" parts
-        // of the geometry a few lines below but only mark them as unowned farther
-        // below when we are calling removeGeometry() on it. If this was an
-        // owning pointer we'd get a double free if there is an error.
-        auto* mega_multipolygon = static_cast<OGRMultiPolygon*>(mega_geometry.release());
-
-        polygons.reserve(mega_multipolygon->getNumGeometries());
-        for (int i = 0; i < mega_multipolygon->getNumGeometries(); ++i) {
-            OGRGeometry* geom = mega_multipolygon->getGeometryRef(i);
-            assert(geom);
-            assert(geom->getGeometryType() == wkbPolygon);
-            std::unique_ptr<OGRPolygon> p{static_cast<OGRPolygon*>(geom)};
-            if (p->IsValid()) {
-                polygons.push_back(std::move(p));
+            output.add_error_line(p.ogr_linestring(0, srs.wgs84()), "invalid");
+            if (results[n].repaired && results[n].repaired_valid) {
+                polygons.push_back(std::move(results[n].repaired_polygon));
+                (*warnings)++;
             } else {
-                output.add_error_line(make_unique_ptr_clone<OGRLineString>(p->getExteriorRing()), "invalid");
-                std::unique_ptr<OGRGeometry> buf0{p->Buffer(0)};
-                if (buf0 && buf0->getGeometryType() == wkbPolygon && buf0->IsValid()) {
-                    buf0->assignSpatialReference(srs.wgs84());
-                    polygons.push_back(static_cast_unique_ptr<OGRPolygon>(std::move(buf0)));
-                    (*warnings)++;
-                } else {
-                    std::cerr << "Ignoring invalid polygon geometry.\n";
-                    (*errors)++;
-                }
+                std::cerr << "Ignoring invalid polygon geometry.\n";
+                (*errors)++;
             }
         }
-
-        mega_multipolygon->removeGeometry(-1, FALSE);
-        delete mega_multipolygon; // NOLINT(cppcoreguidelines-owning-memory)
     }
 
     return polygons;
@@ -153,13 +138,259 @@ std::string memory_usage() {
 
 /* ================================================== */
 
-std::unique_ptr<OutputDatabase> open_output_database(const std::string& driver, const std::string& name, const bool create_index) try {
-    return std::unique_ptr<OutputDatabase>{new OutputDatabase{driver, name, srs, create_index}};
+/**
+ * We are only interested in ways tagged with natural=coastline. But we
+ * ignore the bogus coastline in Antarctica.
+ */
+static bool is_coastline_way(const osmium::Way& way) {
+    return way.tags().has_tag("natural", "coastline") &&
+           !way.tags().has_tag("coastline", "bogus");
+}
+
+/**
+ * Nodes should never be tagged natural=coastline. We report them as errors.
+ */
+static bool is_coastline_node(const osmium::Node& node) {
+    return node.tags().has_tag("natural", "coastline");
+}
+
+static void add_tagged_node_error(OutputDatabase& output, const osmium::Node& node) {
+    osmium::geom::OGRFactory<> factory;
+    try {
+        output.add_error_point(factory.create_point(node), "tagged_node", node.id());
+    } catch (const osmium::geometry_error&) {
+        std::cerr << "Ignoring illegal geometry for node " << node.id() << ".\n";
+    }
+}
+
+/**
+ * Does the header of this file say that the ways in it contain the node
+ * locations? This is the case for files created with
+ * "osmium add-locations-to-ways".
+ */
+static bool has_locations_on_ways(const osmium::io::Header& header) {
+    for (const auto& option : header) {
+        if (option.first.compare(0, 21, "pbf_optional_feature_") == 0 &&
+            option.second == "LocationsOnWays") {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool input_has_locations_on_ways(const osmium::io::File& file) {
+    osmium::io::Reader reader{file, osmium::osm_entity_bits::nothing};
+    const bool result = has_locations_on_ways(reader.header());
+    reader.close();
+    return result;
+}
+
+/**
+ * Read the OSM change file and apply the changes to the coastline ways
+ * from the cache. Returns the updated ways.
+ */
+static osmium::memory::Buffer apply_changes(const std::string& change_file, const osmium::memory::Buffer& ways, OutputDatabase& output, osmium::util::VerboseOutput& vout) {
+    CoastlineChanges changes;
+
+    osmium::io::Reader reader{change_file, osmium::osm_entity_bits::node | osmium::osm_entity_bits::way};
+    while (const auto buffer = reader.read()) {
+        for (const auto& node : buffer.select<osmium::Node>()) {
+            if (node.visible() && is_coastline_node(node)) {
+                add_tagged_node_error(output, node);
+            }
+            changes.add_node(node);
+        }
+        for (const auto& way : buffer.select<osmium::Way>()) {
+            changes.add_way(way, is_coastline_way(way));
+        }
+    }
+    reader.close();
+
+    auto result = changes.apply(ways);
+
+    vout << "  Removed or replaced " << changes.ways_removed()
+         << " coastline ways, added " << changes.ways_added()
+         << " new or changed coastline ways, "
+         << changes.ways_with_moved_nodes()
+         << " other coastline ways have moved nodes.\n";
+
+    return result;
+}
+
+/**
+ * Task run on the worker threads in the first pass. It copies all coastline
+ * ways (and all nodes tagged as coastline) from an input buffer into a new
+ * compact buffer. If there are no such objects in the input buffer an
+ * invalid buffer is returned.
+ */
+class CoastlineFilter {
+
+    osmium::memory::Buffer m_buffer;
+
+    void copy(osmium::memory::Buffer& out, const osmium::memory::Item& item) {
+        if (!out) {
+            out = osmium::memory::Buffer{64 * 1024, osmium::memory::Buffer::auto_grow::yes};
+        }
+        out.add_item(item);
+        out.commit();
+    }
+
+public:
+
+    explicit CoastlineFilter(osmium::memory::Buffer&& buffer) :
+        m_buffer(std::move(buffer)) {
+    }
+
+    osmium::memory::Buffer operator()() {
+        osmium::memory::Buffer out;
+
+        for (const auto& node : m_buffer.select<osmium::Node>()) {
+            if (is_coastline_node(node)) {
+                copy(out, node);
+            }
+        }
+
+        for (const auto& way : m_buffer.select<osmium::Way>()) {
+            if (is_coastline_way(way)) {
+                copy(out, way);
+            }
+        }
+
+        return out;
+    }
+
+}; // class CoastlineFilter
+
+/**
+ * Read all coastline ways from the input file and add them to the
+ * collection of coastline rings. If nodes are read, too, nodes tagged
+ * as coastline are reported as errors.
+ *
+ * If the cache_ways buffer is valid, all coastline ways are also copied into
+ * it so they can be written to the cache file later.
+ *
+ * If more than one thread is used, the input buffers are handed to worker
+ * threads which find the coastline objects. Only the assembly of the rings
+ * happens on this thread. The buffers are processed in the same order as
+ * they are read, so the result is the same as if we had used one thread.
+ */
+static void read_coastline_ways(osmium::io::Reader& reader, CoastlineRingCollection& coastline_rings, OutputDatabase& output, int num_threads, osmium::memory::Buffer& cache_ways) {
+    const auto add_way = [&coastline_rings, &cache_ways](const osmium::Way& way) {
+        coastline_rings.add_way(way);
+        if (cache_ways) {
+            cache_ways.add_item(way);
+            cache_ways.commit();
+        }
+    };
+
+    if (num_threads <= 1) {
+        while (const auto buffer = reader.read()) {
+            for (const auto& node : buffer.select<osmium::Node>()) {
+                if (is_coastline_node(node)) {
+                    add_tagged_node_error(output, node);
+                }
+            }
+            for (const auto& way : buffer.select<osmium::Way>()) {
+                if (is_coastline_way(way)) {
+                    add_way(way);
+                }
+            }
+        }
+        return;
+    }
+
+    osmium::thread::Pool pool{num_threads};
+    std::deque<std::future<osmium::memory::Buffer>> results;
+    const std::size_t max_results_in_flight = 4 * static_cast<std::size_t>(num_threads);
+
+    const auto add_objects = [&add_way, &output](std::future<osmium::memory::Buffer>& result) {
+        const auto buffer = result.get();
+        if (buffer) {
+            for (const auto& node : buffer.select<osmium::Node>()) {
+                add_tagged_node_error(output, node);
+            }
+            for (const auto& way : buffer.select<osmium::Way>()) {
+                add_way(way);
+            }
+        }
+    };
+
+    while (auto buffer = reader.read()) {
+        results.push_back(pool.submit(CoastlineFilter{std::move(buffer)}));
+        if (results.size() > max_results_in_flight) {
+            add_objects(results.front());
+            results.pop_front();
+        }
+    }
+
+    while (!results.empty()) {
+        add_objects(results.front());
+        results.pop_front();
+    }
+}
+
+static void print_ring_stats(osmium::util::VerboseOutput& vout, const CoastlineRingCollection& coastline_rings, Stats& stats) {
+    stats.ways = coastline_rings.num_ways();
+    stats.unconnected_nodes = coastline_rings.num_unconnected_nodes();
+    stats.rings = coastline_rings.size();
+    stats.rings_from_single_way = coastline_rings.num_rings_from_single_way();
+    vout << "  There are "
+         << coastline_rings.num_unconnected_nodes()
+         << " nodes where the coastline is not closed.\n";
+    vout << "  There are "
+         << coastline_rings.size()
+         << " coastline rings ("
+         << coastline_rings.num_rings_from_single_way()
+         << " from a single closed way and "
+         << (coastline_rings.size() - coastline_rings.num_rings_from_single_way())
+         << " others).\n";
+    vout << memory_usage();
+}
+
+/* ================================================== */
+
+std::unique_ptr<OutputDatabase> open_output_database(const std::string& driver, const std::string& name, const bool create_index, const bool with_tiles) try {
+    return std::unique_ptr<OutputDatabase>{new OutputDatabase{driver, name, srs, create_index, with_tiles}};
 } catch (const std::exception& e) {
     std::cerr << e.what() << '\n';
     std::exit(return_code_fatal);
 }
 
+/**
+ * Removes a temporary file when it goes out of scope, unless release() was
+ * called. Use it with static storage duration for files that must be
+ * removed if the program ends with std::exit(), which doesn't destroy
+ * local objects.
+ */
+class TemporaryFileGuard {
+
+    std::string m_filename;
+
+public:
+
+    TemporaryFileGuard() = default;
+
+    TemporaryFileGuard(const TemporaryFileGuard&) = delete;
+    TemporaryFileGuard& operator=(const TemporaryFileGuard&) = delete;
+
+    ~TemporaryFileGuard() {
+        if (!m_filename.empty()) {
+            unlink(m_filename.c_str());
+        }
+    }
+
+    /// Remove the file with this name at the end.
+    void set(const std::string& filename) {
+        m_filename = filename;
+    }
+
+    /// Don't remove the file, it is not temporary any more.
+    void release() noexcept {
+        m_filename.clear();
+    }
+
+}; // class TemporaryFileGuard
+
 /* ================================================== */
 
 int main(int argc, char *argv[]) {
@@ -187,15 +418,44 @@ int main(int argc, char *argv[]) {
         std::exit(return_code_fatal);
     }
 
-    // Optionally set up segments file
+    // Optionally set up segments file. The segments are written to a
+    // temporary file which is renamed when it is complete. This way the
+    // same file can be used with --previous-segments and --write-segments,
+    // and a failed run doesn't destroy the segments file of the last run.
+    // The guard removes the temporary file on every exit before the rename.
     int segments_fd = -1;
+    const std::string segments_tmp_file = options.segmentfile + ".tmp";
+    static TemporaryFileGuard segments_tmp_guard;
     if (!options.segmentfile.empty()) {
         vout << "Writing segments to file '" << options.segmentfile << "' (because you told me to with --write-segments/-S option).\n";
-        segments_fd = ::open(options.segmentfile.c_str(), O_WRONLY | O_CREAT, 0666); // NOLINT(hicpp-signed-bitwise)
+        segments_fd = ::open(segments_tmp_file.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666); // NOLINT(hicpp-signed-bitwise)
         if (segments_fd == -1) {
-            std::cerr << "Couldn't open file '" << options.segmentfile << "' (" << std::strerror(errno) << ")\n";
+            std::cerr << "Couldn't open file '" << segments_tmp_file << "' (" << std::strerror(errno) << ")\n";
             std::exit(return_code_fatal);
         }
+        segments_tmp_guard.set(segments_tmp_file);
+    }
+
+    // Optionally set up segments file from previous run
+    int previous_segments_fd = -1;
+    std::unique_ptr<SegmentFileReader> previous_segments;
+    if (!options.previous_segments.empty()) {
+        vout << "Reading previous segments from file '" << options.previous_segments << "' (because you told me to with --previous-segments/-P option).\n";
+        previous_segments_fd = ::open(options.previous_segments.c_str(), O_RDONLY); // NOLINT(hicpp-signed-bitwise)
+        if (previous_segments_fd == -1) {
+            std::cerr << "Couldn't open file '" << options.previous_segments << "' (" << std::strerror(errno) << ")\n";
+            std::exit(return_code_fatal);
+        }
+        try {
+            previous_segments.reset(new SegmentFileReader{previous_segments_fd});
+        } catch (const std::exception& e) {
+            std::cerr << "Couldn't read file '" << options.previous_segments << "' (" << e.what() << ")\n";
+            std::exit(return_code_fatal);
+        }
+        if (!previous_segments->has_findings()) {
+            vout << "  Previous segments file doesn't contain findings. All segments will be checked.\n";
+            previous_segments.reset();
+        }
     }
 
     // Set up output database.
@@ -211,71 +471,115 @@ int main(int argc, char *argv[]) {
         vout << "Will NOT create geometry index (because you told me to using --no-index/-i).\n";
     }
 
-    auto output_database = open_output_database(options.driver, options.output_database, options.create_index);
+    auto output_database = open_output_database(options.driver, options.output_database, options.create_index, options.split_grid_zoom >= 0);
 
     // The collection of all coastline rings we will be filling and then
     // operating on.
     CoastlineRingCollection coastline_rings;
 
+    // If we are writing a cache file, we keep a copy of all coastline
+    // ways in here. If we are reading from a cache file, the ways from
+    // that file end up here. The cache file is only written after we know
+    // that all locations are there, so a failed run never leaves a broken
+    // cache file behind for the next run.
+    osmium::memory::Buffer cache_ways;
+
     try {
         // This is in an extra scope so that the considerable amounts of memory
         // held by some intermediate datastructures is recovered after we don't
         // need them any more.
-        vout << "Reading from file '" << options.inputfile << "'.\n";
-        osmium::io::File infile{options.inputfile};
 
-        vout << "Reading ways (1st pass through input file)...\n";
-        osmium::io::Reader reader1{infile, osmium::osm_entity_bits::way};
-        while (const auto buffer = reader1.read()) {
-            for (const auto& way : buffer.select<osmium::Way>()) {
-                // We are only interested in ways tagged with natural=coastline.
-                if (way.tags().has_tag("natural", "coastline")) {
-                    // ignore bogus coastline in Antarctica
-                    if (!way.tags().has_tag("coastline", "bogus")) {
-                        coastline_rings.add_way(way);
+        if (!options.read_cache.empty()) {
+            vout << "Reading ways from cache file '" << options.read_cache << "' (because you told me to with --read-cache/-R)...\n";
+            cache_ways = read_coastline_cache(options.read_cache);
+
+            if (!options.change_file.empty()) {
+                vout << "Applying changes from file '" << options.change_file << "' (because you told me to with --apply-changes/-a)...\n";
+                cache_ways = apply_changes(options.change_file, cache_ways, *output_database, vout);
+
+                // Ways that became coastline ways without changes to their
+                // nodes (for instance because they were retagged) have
+                // nodes that are neither in the change file nor in the
+                // cache. Their locations can only come from an OSM file.
+                LocationMap locmap;
+                const auto missing = add_missing_way_locations_to_locmap(cache_ways, locmap);
+                if (missing > 0) {
+                    if (options.inputfile.empty()) {
+                        vout << "  There are " << missing << " node locations missing after applying the changes. Give the OSM file the cache was created from as OSMFILE to read them from there.\n";
+                    } else {
+                        vout << "  Reading " << missing << " missing node locations from file '" << options.inputfile << "'...\n";
+                        locmap.sort();
+                        osmium::io::Reader reader{osmium::io::File{options.inputfile, options.input_format}, osmium::osm_entity_bits::node};
+                        while (const auto buffer = reader.read()) {
+                            for (const auto& node : buffer.select<osmium::Node>()) {
+                                locmap.set_location(node.id(), node.location());
+                            }
+                        }
+                        reader.close();
                     }
                 }
             }
-        }
-        reader1.close();
-        stats.ways = coastline_rings.num_ways();
-        stats.unconnected_nodes = coastline_rings.num_unconnected_nodes();
-        stats.rings = coastline_rings.size();
-        stats.rings_from_single_way = coastline_rings.num_rings_from_single_way();
-        vout << "  There are "
-             << coastline_rings.num_unconnected_nodes()
-             << " nodes where the coastline is not closed.\n";
-        vout << "  There are "
-             << coastline_rings.size()
-             << " coastline rings ("
-             << coastline_rings.num_rings_from_single_way()
-             << " from a single closed way and "
-             << (coastline_rings.size() - coastline_rings.num_rings_from_single_way())
-             << " others).\n";
-        vout << memory_usage();
-
-        vout << "Reading nodes (2nd pass through input file)...\n";
-        locmap_type locmap{};
-        coastline_rings.setup_locations(locmap);
-        osmium::geom::OGRFactory<> factory;
-        osmium::io::Reader reader2{infile, osmium::osm_entity_bits::node};
-        while (const auto buffer = reader2.read()) {
-            for (const auto& node : buffer.select<osmium::Node>()) {
-                if (node.tags().has_tag("natural", "coastline")) {
-                    try {
-                        output_database->add_error_point(factory.create_point(node), "tagged_node", node.id());
-                    } catch (const osmium::geometry_error&) {
-                        std::cerr << "Ignoring illegal geometry for node " << node.id() << ".\n";
-                    }
+
+            for (const auto& way : cache_ways.select<osmium::Way>()) {
+                coastline_rings.add_way(way);
+            }
+            print_ring_stats(vout, coastline_rings, stats);
+        } else {
+            if (!options.write_cache.empty()) {
+                cache_ways = osmium::memory::Buffer{1024 * 1024, osmium::memory::Buffer::auto_grow::yes};
+            }
+
+            vout << "Reading from file '" << options.inputfile << "'.\n";
+            osmium::io::File infile{options.inputfile, options.input_format};
+
+            // If the ways in the input file already contain the node locations,
+            // we can do everything in one pass. We can't look at the header of
+            // STDIN before reading it for real, so we always expect the node
+            // locations on the ways in this case.
+            const bool from_stdin = infile.filename().empty();
+            const bool single_pass = from_stdin || input_has_locations_on_ways(infile);
+
+            if (single_pass) {
+                vout << "Reading nodes and ways (input file has node locations on ways, only one pass needed)...\n";
+            } else {
+                vout << "Reading ways (1st pass through input file)...\n";
+            }
+            if (options.threads > 1) {
+                vout << "  Filtering ways on " << options.threads << " threads. (Set this with --threads/-t.)\n";
+            }
+
+            osmium::io::Reader reader1{infile, single_pass ? (osmium::osm_entity_bits::node | osmium::osm_entity_bits::way)
+                                                           : osmium::osm_entity_bits::way};
+            if (single_pass && !has_locations_on_ways(reader1.header())) {
+                throw std::runtime_error{"Reading from STDIN only works if the input has node locations on ways (see 'osmium add-locations-to-ways')."};
+            }
+            read_coastline_ways(reader1, coastline_rings, *output_database, options.threads, cache_ways);
+            reader1.close();
+
+            print_ring_stats(vout, coastline_rings, stats);
+
+            if (!single_pass) {
+                vout << "Reading nodes (2nd pass through input file)...\n";
+                LocationMap locmap;
+                coastline_rings.setup_locations(locmap);
+                if (cache_ways) {
+                    add_way_locations_to_locmap(cache_ways, locmap);
                 }
+                locmap.sort();
+
+                osmium::io::Reader reader2{infile, osmium::osm_entity_bits::node};
+                while (const auto buffer = reader2.read()) {
+                    for (const auto& node : buffer.select<osmium::Node>()) {
+                        if (is_coastline_node(node)) {
+                            add_tagged_node_error(*output_database, node);
+                        }
 
-                const auto ret = locmap.equal_range(node.id());
-                for (auto it = ret.first; it != ret.second; ++it) {
-                    *(it->second) = node.location();
+                        locmap.set_location(node.id(), node.location());
+                    }
                 }
+                reader2.close();
             }
         }
-        reader2.close();
     } catch (const std::exception& e) {
         std::cerr << e.what() << '\n';
         std::exit(return_code_fatal);
@@ -290,6 +594,19 @@ int main(int argc, char *argv[]) {
         vout << "  All locations are there.\n";
     }
 
+    if (!options.write_cache.empty()) {
+        vout << "Writing ways to cache file '" << options.write_cache << "' (because you told me to with --write-cache/-C)...\n";
+        try {
+            write_coastline_cache(options.write_cache, cache_ways);
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << '\n';
+            std::exit(return_code_fatal);
+        }
+    }
+    cache_ways = osmium::memory::Buffer{};
+
+    coastline_rings.drop_node_ids();
+
     vout << memory_usage();
 
     if (options.driver == "SQLite") {
@@ -297,10 +614,24 @@ int main(int argc, char *argv[]) {
     }
 
     vout << "Check line segments for intersections and overlaps...\n";
-    warnings += coastline_rings.check_for_intersections(*output_database, segments_fd);
+    try {
+        warnings += coastline_rings.check_for_intersections(*output_database, segments_fd, previous_segments.get(), options.threads, options.segments_memory);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << '\n';
+        std::exit(return_code_fatal);
+    }
+
+    if (previous_segments_fd != -1) {
+        previous_segments.reset();
+        ::close(previous_segments_fd);
+    }
 
     if (segments_fd != -1) {
-        ::close(segments_fd);
+        if (::close(segments_fd) != 0 || std::rename(segments_tmp_file.c_str(), options.segmentfile.c_str()) != 0) {
+            std::cerr << "Couldn't write file '" << options.segmentfile << "' (" << std::strerror(errno) << ")\n";
+            std::exit(return_code_fatal);
+        }
+        segments_tmp_guard.release();
     }
 
     vout << "Trying to close Antarctica ring...\n";
@@ -325,7 +656,7 @@ int main(int argc, char *argv[]) {
 
     if (options.output_rings) {
         vout << "Writing out rings... (Because you gave the --output-rings/-r option.)\n";
-        warnings += coastline_rings.output_rings(*output_database);
+        warnings += coastline_rings.output_rings(*output_database, options.threads);
     } else {
         vout << "Not writing out rings. (Use option --output-rings/-r if you want the rings.)\n";
     }
@@ -333,10 +664,12 @@ int main(int argc, char *argv[]) {
     if (options.output_polygons != output_polygon_type::none || options.output_lines) {
         try {
             vout << "Create polygons...\n";
-            CoastlinePolygons coastline_polygons{create_polygons(coastline_rings, *output_database, &warnings, &errors), \
+            CoastlinePolygons coastline_polygons{create_polygons(coastline_rings, *output_database, options.threads, &warnings, &errors), \
                                                  *output_database, \
                                                  options.bbox_overlap, \
-                                                 options.max_points_in_polygon};
+                                                 options.max_points_in_polygon, \
+                                                 options.threads, \
+                                                 options.split_method};
 
             stats.land_polygons_before_split = coastline_polygons.num_polygons();
 
@@ -367,7 +700,12 @@ int main(int argc, char *argv[]) {
                     vout << "Not performing check for questionable input data, because it only works in EPSG:4326...\n";
                 }
 
-                if (options.split_large_polygons) {
+                if (options.split_grid_zoom >= 0) {
+                    vout << "Split polygons into tiles of zoom level " << options.split_grid_zoom << "... (Because you used --split-grid/-z)\n";
+                    vout << "  Using overlap of " << options.bbox_overlap << " (Set this with --bbox-overlap/-b).\n";
+                    errors += coastline_polygons.split_grid(options.split_grid_zoom);
+                    stats.land_polygons_after_split = coastline_polygons.num_polygons();
+                } else if (options.split_large_polygons) {
                     vout << "Split polygons with more than " << options.max_points_in_polygon << " points... (Use --max-points/-m to change this. Set to 0 not to split at all.)\n";
                     vout << "  Using overlap of " << options.bbox_overlap << " (Set this with --bbox-overlap/-b).\n";
                     coastline_polygons.split();
@@ -385,7 +723,7 @@ int main(int argc, char *argv[]) {
                 if (options.output_polygons == output_polygon_type::water ||
                     options.output_polygons == output_polygon_type::both) {
                     vout << "Writing out water polygons...\n";
-                    coastline_polygons.output_water_polygons();
+                    errors += coastline_polygons.output_water_polygons();
                 }
             }
         } catch (const std::runtime_error& e) {
@@ -20,24 +20,21 @@
 */
 
 #include "return_codes.hpp"
+#include "segment_file.hpp"
 #include "version.hpp"
 
 #include <osmium/osm/undirected_segment.hpp>
-#include <osmium/util/memory_mapping.hpp>
 
 #include <gdalcpp.hpp>
 
-#include <algorithm>
 #include <cerrno>
 #include <cstdlib>
 #include <fcntl.h>
 #include <getopt.h>
 #include <iostream>
-#include <iterator>
 #include <memory>
 #include <stdexcept>
 #include <string>
-#include <sys/stat.h>
 #include <sys/types.h>
 #include <system_error>
 #include <vector>
@@ -48,17 +45,15 @@
 # include <io.h>
 #endif
 
-using segvec = std::vector<osmium::UndirectedSegment>;
+using segvec = std::vector<segment_record>;
 
 class InputFile {
 
-    std::string m_filename;
     int m_fd;
 
 public:
 
     explicit InputFile(const std::string& filename) :
-        m_filename(filename),
         m_fd(::open(filename.c_str(), O_RDONLY)) {
         if (m_fd == -1) {
             throw std::system_error{errno, std::system_category(), std::string{"Opening '"} + filename + "' failed"};
@@ -69,34 +64,75 @@ public:
         return m_fd;
     }
 
-    std::size_t size() const {
-        struct stat s; // NOLINT(cppcoreguidelines-pro-type-member-init, hicpp-member-init)
-        if (::fstat(m_fd, &s) != 0) {
-            throw std::system_error{errno, std::system_category(), std::string{"Can't get file size for '"} + m_filename + "'"};
-        }
-        return std::size_t(s.st_size);
-    }
-
 }; // class InputFile
 
 void print_help() {
 }
 
-void add_segment(gdalcpp::Layer& layer, int change, const osmium::UndirectedSegment& segment) {
+void add_segment(gdalcpp::Layer& layer, int change, const segment_record& record) {
     auto linestring = std::unique_ptr<OGRLineString>{new OGRLineString()};
-    linestring->addPoint(segment.first().lon(), segment.first().lat());
-    linestring->addPoint(segment.second().lon(), segment.second().lat());
+    linestring->addPoint(record.segment.first().lon(), record.segment.first().lat());
+    linestring->addPoint(record.segment.second().lon(), record.segment.second().lat());
 
     gdalcpp::Feature feature(layer, std::move(linestring));
     feature.set_field("change", change);
+    feature.set_field("ring_id", std::to_string(record.ids.ring_id).c_str());
+    feature.set_field("way_id", std::to_string(record.ids.way_id).c_str());
     feature.add_to_layer();
 }
 
+void dump_segment(const segment_record& record) {
+    std::cout << "  " << record.segment;
+    if (record.ids.way_id != 0) {
+        std::cout << " way " << record.ids.way_id;
+    }
+    if (record.ids.ring_id != 0) {
+        std::cout << " ring " << record.ids.ring_id;
+    }
+    std::cout << "\n";
+}
+
+/**
+ * Compare the sorted segments from both files. Segments only in the first
+ * file are added to removed_segments, segments only in the second file to
+ * added_segments. Both files are read only once and never completely held
+ * in memory.
+ */
+void diff_segments(SegmentFileReader& reader1, SegmentFileReader& reader2, segvec& removed_segments, segvec& added_segments) {
+    bool has1 = reader1.next();
+    bool has2 = reader2.next();
+
+    while (has1 && has2) {
+        const auto& record1 = reader1.current();
+        const auto& record2 = reader2.current();
+        if (record1.segment < record2.segment) {
+            removed_segments.push_back(record1);
+            has1 = reader1.next();
+        } else if (record2.segment < record1.segment) {
+            added_segments.push_back(record2);
+            has2 = reader2.next();
+        } else {
+            has1 = reader1.next();
+            has2 = reader2.next();
+        }
+    }
+
+    for (; has1; has1 = reader1.next()) {
+        removed_segments.push_back(reader1.current());
+    }
+
+    for (; has2; has2 = reader2.next()) {
+        added_segments.push_back(reader2.current());
+    }
+}
+
 void output_ogr(const std::string& filename, const std::string& driver_name, const segvec& removed_segments, const segvec& added_segments) {
     gdalcpp::Dataset dataset{driver_name, filename};
 
     gdalcpp::Layer layer{dataset, "changes", wkbLineString};
     layer.add_field("change", OFTInteger, 1);
+    layer.add_field("ring_id", OFTString, 10);
+    layer.add_field("way_id", OFTString, 10);
     layer.start_transaction();
 
     for (const auto& segment : removed_segments) {
@@ -169,21 +205,20 @@ int main(int argc, char *argv[]) {
         InputFile file1{argv[optind]};
         InputFile file2{argv[optind + 1]};
 
-        osmium::util::TypedMemoryMapping<osmium::UndirectedSegment> m1{file1.size() / sizeof(osmium::UndirectedSegment), osmium::util::MemoryMapping::mapping_mode::readonly, file1.fd()};
-        osmium::util::TypedMemoryMapping<osmium::UndirectedSegment> m2{file2.size() / sizeof(osmium::UndirectedSegment), osmium::util::MemoryMapping::mapping_mode::readonly, file2.fd()};
+        SegmentFileReader reader1{file1.fd()};
+        SegmentFileReader reader2{file2.fd()};
 
-        std::set_difference(m1.cbegin(), m1.cend(), m2.cbegin(), m2.cend(), std::back_inserter(removed_segments));
-        std::set_difference(m2.cbegin(), m2.cend(), m1.cbegin(), m1.cend(), std::back_inserter(added_segments));
+        diff_segments(reader1, reader2, removed_segments, added_segments);
 
         if (dump) {
             std::cout << "Removed:\n";
-            for (const auto& segment : removed_segments) {
-                std::cout << "  " << segment << "\n";
+            for (const auto& record : removed_segments) {
+                dump_segment(record);
             }
 
             std::cout << "Added:\n";
-            for (const auto& segment : added_segments) {
-                std::cout << "  " << segment << "\n";
+            for (const auto& record : added_segments) {
+                dump_segment(record);
             }
         } else if (!geom.empty()) {
             output_ogr(geom, format, removed_segments, added_segments);
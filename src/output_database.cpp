@@ -29,14 +29,16 @@
 #include <ogr_core.h>
 #include <ogr_geometry.h>
 
+#include <cassert>
 #include <cstddef>
 #include <iostream>
 #include <sstream>
 #include <utility>
 
-OutputDatabase::OutputDatabase(const std::string& driver, const std::string& outdb, SRS& srs, bool with_index) :
+OutputDatabase::OutputDatabase(const std::string& driver, const std::string& outdb, SRS& srs, bool with_index, bool with_tiles) :
     m_driver(driver),
     m_with_index(with_index),
+    m_with_tiles(with_tiles),
     m_srs(srs),
     m_dataset(driver, outdb, gdalcpp::SRS(*srs.out()), driver_options()),
     m_layer_error_points(m_dataset, "error_points", wkbPoint, layer_options()),
@@ -59,6 +61,14 @@ OutputDatabase::OutputDatabase(const std::string& driver, const std::string& out
     m_layer_rings.add_field("land",    OFTInteger, 1);
     m_layer_rings.add_field("valid",   OFTInteger, 1);
 
+    if (m_with_tiles) {
+        m_layer_land_polygons.add_field("x", OFTInteger, 6);
+        m_layer_land_polygons.add_field("y", OFTInteger, 6);
+
+        m_layer_water_polygons.add_field("x", OFTInteger, 6);
+        m_layer_water_polygons.add_field("y", OFTInteger, 6);
+    }
+
     if (m_driver == "SQLite") {
         m_dataset.exec("CREATE TABLE options (overlap REAL, close_distance REAL, max_points_in_polygons INTEGER, split_large_polygons INTEGER)");
         m_dataset.exec("CREATE TABLE meta ("
@@ -150,11 +160,8 @@ void OutputDatabase::add_error_line(std::unique_ptr<OGRLineString>&& linestring,
     feature.add_to_layer();
 }
 
-void OutputDatabase::add_ring(std::unique_ptr<OGRPolygon>&& polygon, int osm_id, unsigned int nways, unsigned int npoints, bool fixed) {
-    m_srs.transform(polygon.get());
-
+void OutputDatabase::add_ring(std::unique_ptr<OGRPolygon>&& polygon, bool valid, int osm_id, unsigned int nways, unsigned int npoints, bool fixed) {
     const bool land = polygon->getExteriorRing()->isClockwise();
-    const bool valid = polygon->IsValid();
 
     if (!valid) {
         /*
@@ -229,6 +236,24 @@ void OutputDatabase::add_water_polygon(std::unique_ptr<OGRPolygon>&& polygon) {
     feature.add_to_layer();
 }
 
+void OutputDatabase::add_land_polygon(std::unique_ptr<OGRPolygon>&& polygon, uint32_t tile_x, uint32_t tile_y) {
+    assert(m_with_tiles);
+    m_srs.transform(polygon.get());
+    gdalcpp::Feature feature{m_layer_land_polygons, std::move(polygon)};
+    feature.set_field("x", static_cast<int>(tile_x));
+    feature.set_field("y", static_cast<int>(tile_y));
+    feature.add_to_layer();
+}
+
+void OutputDatabase::add_water_polygon(std::unique_ptr<OGRPolygon>&& polygon, uint32_t tile_x, uint32_t tile_y) {
+    assert(m_with_tiles);
+    m_srs.transform(polygon.get());
+    gdalcpp::Feature feature{m_layer_water_polygons, std::move(polygon)};
+    feature.set_field("x", static_cast<int>(tile_x));
+    feature.set_field("y", static_cast<int>(tile_y));
+    feature.add_to_layer();
+}
+
 void OutputDatabase::add_line(std::unique_ptr<OGRLineString>&& linestring) {
     m_srs.transform(linestring.get());
     gdalcpp::Feature feature{m_layer_lines, std::move(linestring)};
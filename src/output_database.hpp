@@ -26,6 +26,7 @@
 
 #include <gdalcpp.hpp>
 
+#include <cstdint>
 #include <memory>
 #include <string>
 #include <vector>
@@ -49,6 +50,10 @@ class OutputDatabase {
 
     bool m_with_index;
 
+    // Do the land and water polygons have the x and y fields of the tile
+    // they are in?
+    bool m_with_tiles;
+
     SRS& m_srs;
 
     gdalcpp::Dataset m_dataset;
@@ -83,15 +88,28 @@ class OutputDatabase {
 
 public:
 
-    OutputDatabase(const std::string& driver, const std::string& outdb, SRS& srs, bool with_index=false);
+    OutputDatabase(const std::string& driver, const std::string& outdb, SRS& srs, bool with_index=false, bool with_tiles=false);
 
     ~OutputDatabase() noexcept = default;
 
     void add_error_point(std::unique_ptr<OGRPoint>&& point, const char* error, osmium::object_id_type id = 0);
     void add_error_line(std::unique_ptr<OGRLineString>&& linestring, const char* error, osmium::object_id_type id = 0);
-    void add_ring(std::unique_ptr<OGRPolygon>&& polygon, int osm_id, unsigned int nways, unsigned int npoints, bool fixed);
+
+    /**
+     * Add a ring. The polygon must already be in the output SRS. If it is
+     * not valid, the reason is written to the error points.
+     */
+    void add_ring(std::unique_ptr<OGRPolygon>&& polygon, bool valid, int osm_id, unsigned int nways, unsigned int npoints, bool fixed);
+
     void add_land_polygon(std::unique_ptr<OGRPolygon>&& polygon);
     void add_water_polygon(std::unique_ptr<OGRPolygon>&& polygon);
+
+    /**
+     * Add a land or water polygon in the tile with the given x and y. This
+     * needs the tile fields enabled in the constructor.
+     */
+    void add_land_polygon(std::unique_ptr<OGRPolygon>&& polygon, uint32_t tile_x, uint32_t tile_y);
+    void add_water_polygon(std::unique_ptr<OGRPolygon>&& polygon, uint32_t tile_x, uint32_t tile_y);
     void add_line(std::unique_ptr<OGRLineString>&& linestring);
 
     void set_options(const Options& options);
@@ -0,0 +1,243 @@
+#ifndef PARALLEL_HPP
+#define PARALLEL_HPP
+
+/*
+
+  Copyright 2012-2021 Jochen Topf <jochen@topf.org>.
+
+  This file is part of OSMCoastline.
+
+  OSMCoastline is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  OSMCoastline is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with OSMCoastline.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include <osmium/thread/pool.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/**
+ * Call func(n) for all n in [0, num_tasks). If there is a pool, this is
+ * done in parallel on the threads of the pool. Returns when all tasks are
+ * done.
+ */
+template <typename TFunc>
+void run_tasks(osmium::thread::Pool* pool, std::size_t num_tasks, TFunc&& func) {
+    if (!pool) {
+        for (std::size_t n = 0; n < num_tasks; ++n) {
+            func(n);
+        }
+        return;
+    }
+
+    std::vector<std::future<void>> results;
+    results.reserve(num_tasks);
+    for (std::size_t n = 0; n < num_tasks; ++n) {
+        results.push_back(pool->submit([&func, n]() {
+            func(n);
+        }));
+    }
+    for (auto& result : results) {
+        result.get();
+    }
+}
+
+/**
+ * Call func(n) for all n in [0, size). The range is split into a few
+ * chunks per thread of the pool which are run as tasks.
+ */
+template <typename TFunc>
+void run_chunked(osmium::thread::Pool* pool, std::size_t size, TFunc&& func) {
+    const std::size_t num_chunks = pool ? std::min(size, static_cast<std::size_t>(pool->num_threads()) * 8) : 1;
+    run_tasks(pool, num_chunks, [&](std::size_t chunk) {
+        for (std::size_t n = size * chunk / num_chunks; n < size * (chunk + 1) / num_chunks; ++n) {
+            func(n);
+        }
+    });
+}
+
+/**
+ * Runs tasks which can create new tasks while they are running on a
+ * number of worker threads. Each worker has its own queue of tasks. New
+ * tasks go to the back of the queue of the worker that created them and
+ * the worker takes its next task from there, too. Workers that run out
+ * of tasks steal from the front of the queues of the other workers, so
+ * they get the big tasks near the root of the task tree.
+ *
+ * Workers without tasks sleep until a new task is added or all tasks are
+ * done, so they don't use any CPU while a single big task is running.
+ *
+ * This doesn't use the osmium::thread::Pool, because tasks waiting there
+ * for the results of their subtasks could block all threads.
+ */
+template <typename TTask>
+class WorkStealingScheduler {
+
+    struct worker_queue {
+        std::mutex mutex;
+        std::deque<TTask> tasks;
+    };
+
+    std::vector<worker_queue> m_queues;
+
+    // Number of tasks added but not finished yet.
+    std::atomic<std::size_t> m_pending{0};
+
+    // Number of tasks in the queues, i.e. added but not started yet.
+    std::atomic<std::size_t> m_queued{0};
+
+    // Idle workers wait on this for new tasks or the end of the run.
+    std::mutex m_idle_mutex;
+    std::condition_variable m_idle;
+
+    std::atomic<bool> m_failed{false};
+    std::exception_ptr m_exception;
+    std::mutex m_exception_mutex;
+
+    bool pop(std::size_t worker, TTask& task) {
+        {
+            auto& queue = m_queues[worker];
+            std::lock_guard<std::mutex> lock{queue.mutex};
+            if (!queue.tasks.empty()) {
+                task = std::move(queue.tasks.back());
+                queue.tasks.pop_back();
+                --m_queued;
+                return true;
+            }
+        }
+
+        for (std::size_t n = 1; n < m_queues.size(); ++n) {
+            auto& queue = m_queues[(worker + n) % m_queues.size()];
+            std::lock_guard<std::mutex> lock{queue.mutex};
+            if (!queue.tasks.empty()) {
+                task = std::move(queue.tasks.front());
+                queue.tasks.pop_front();
+                --m_queued;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    /**
+     * Wake up idle workers. The mutex is locked after the state they wait
+     * for was changed, so a worker can't miss the notification between
+     * checking the state and starting to wait.
+     */
+    void wake_idle(bool all) {
+        {
+            std::lock_guard<std::mutex> lock{m_idle_mutex};
+        }
+        if (all) {
+            m_idle.notify_all();
+        } else {
+            m_idle.notify_one();
+        }
+    }
+
+    template <typename TFunc>
+    void work(std::size_t worker, TFunc& func) {
+        TTask task;
+        while (!m_failed) {
+            if (pop(worker, task)) {
+                try {
+                    func(worker, std::move(task));
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock{m_exception_mutex};
+                    if (!m_exception) {
+                        m_exception = std::current_exception();
+                    }
+                    m_failed = true;
+                    wake_idle(true);
+                }
+                if (--m_pending == 0) {
+                    wake_idle(true);
+                }
+            } else if (m_pending == 0) {
+                return;
+            } else {
+                std::unique_lock<std::mutex> lock{m_idle_mutex};
+                m_idle.wait(lock, [this]() {
+                    return m_queued > 0 || m_pending == 0 || m_failed;
+                });
+            }
+        }
+    }
+
+public:
+
+    /// Create a scheduler with num_threads workers (at least one).
+    explicit WorkStealingScheduler(int num_threads) :
+        m_queues(num_threads > 1 ? static_cast<std::size_t>(num_threads) : 1) {
+    }
+
+    std::size_t num_workers() const noexcept {
+        return m_queues.size();
+    }
+
+    /**
+     * Add a task to the queue of the given worker. Call this from inside
+     * a task with the worker running it to add subtasks.
+     */
+    void spawn(std::size_t worker, TTask&& task) {
+        ++m_pending;
+        {
+            auto& queue = m_queues[worker];
+            std::lock_guard<std::mutex> lock{queue.mutex};
+            queue.tasks.push_back(std::move(task));
+            ++m_queued;
+        }
+        wake_idle(false);
+    }
+
+    /**
+     * Run func(worker, task) for all tasks until there are none left. If
+     * there is only one worker, everything is done on the calling thread.
+     * If a task throws an exception, no new tasks are started and the
+     * exception is re-thrown here.
+     */
+    template <typename TFunc>
+    void run(TFunc&& func) {
+        std::vector<std::thread> threads;
+        threads.reserve(m_queues.size() - 1);
+        for (std::size_t worker = 1; worker < m_queues.size(); ++worker) {
+            threads.emplace_back([this, worker, &func]() {
+                work(worker, func);
+            });
+        }
+
+        work(0, func);
+
+        for (auto& thread : threads) {
+            thread.join();
+        }
+
+        if (m_exception) {
+            std::rethrow_exception(m_exception);
+        }
+    }
+
+}; // class WorkStealingScheduler
+
+#endif // PARALLEL_HPP
@@ -0,0 +1,134 @@
+/*
+
+  Copyright 2012-2021 Jochen Topf <jochen@topf.org>.
+
+  This file is part of OSMCoastline.
+
+  OSMCoastline is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  OSMCoastline is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with OSMCoastline.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include "polygon.hpp"
+
+#include <ogr_geometry.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+
+namespace {
+
+    void add_ogr_ring(const OGRLinearRing& ring, Polygon& polygon) {
+        const int num_points = ring.getNumPoints();
+        for (int n = 0; n < num_points; ++n) {
+            polygon.add_point(ring.getX(n), ring.getY(n));
+        }
+        polygon.finish_ring();
+    }
+
+} // anonymous namespace
+
+Polygon::Polygon(const OGRPolygon& polygon) {
+    const OGRLinearRing* exterior_ring = polygon.getExteriorRing();
+    if (!exterior_ring) {
+        return;
+    }
+
+    std::size_t size = exterior_ring->getNumPoints();
+    for (int i = 0; i < polygon.getNumInteriorRings(); ++i) {
+        size += polygon.getInteriorRing(i)->getNumPoints();
+    }
+    reserve(size);
+
+    add_ogr_ring(*exterior_ring, *this);
+    for (int i = 0; i < polygon.getNumInteriorRings(); ++i) {
+        add_ogr_ring(*polygon.getInteriorRing(i), *this);
+    }
+}
+
+void Polygon::add_ring(const Polygon& other, std::size_t ring) {
+    const auto begin = other.ring_begin(ring);
+    const auto end = other.ring_end(ring);
+    m_x.insert(m_x.end(), other.m_x.begin() + begin, other.m_x.begin() + end);
+    m_y.insert(m_y.end(), other.m_y.begin() + begin, other.m_y.begin() + end);
+    finish_ring();
+}
+
+OGREnvelope Polygon::envelope() const noexcept {
+    OGREnvelope envelope;
+    if (empty()) {
+        return envelope;
+    }
+
+    const auto x = std::minmax_element(m_x.begin(), m_x.end());
+    const auto y = std::minmax_element(m_y.begin(), m_y.end());
+    envelope.MinX = *x.first;
+    envelope.MaxX = *x.second;
+    envelope.MinY = *y.first;
+    envelope.MaxY = *y.second;
+    return envelope;
+}
+
+double Polygon::ring_area2(std::size_t ring) const noexcept {
+    double sum = 0.0;
+    for (std::size_t n = ring_begin(ring) + 1; n < ring_end(ring); ++n) {
+        sum += m_x[n - 1] * m_y[n] - m_x[n] * m_y[n - 1];
+    }
+    return sum;
+}
+
+void Polygon::reverse_ring(std::size_t ring) noexcept {
+    std::reverse(m_x.begin() + ring_begin(ring), m_x.begin() + ring_end(ring));
+    std::reverse(m_y.begin() + ring_begin(ring), m_y.begin() + ring_end(ring));
+}
+
+std::unique_ptr<OGRPolygon> Polygon::ogr_polygon(OGRSpatialReference* srs) const {
+    std::unique_ptr<OGRPolygon> polygon{new OGRPolygon};
+    for (std::size_t ring = 0; ring < num_rings(); ++ring) {
+        std::unique_ptr<OGRLinearRing> ogr_ring{new OGRLinearRing};
+        ogr_ring->setPoints(static_cast<int>(ring_size(ring)), m_x.data() + ring_begin(ring), m_y.data() + ring_begin(ring));
+        polygon->addRingDirectly(ogr_ring.release());
+    }
+    polygon->assignSpatialReference(srs);
+    return polygon;
+}
+
+std::unique_ptr<OGRLineString> Polygon::ogr_linestring(std::size_t ring, OGRSpatialReference* srs) const {
+    std::unique_ptr<OGRLineString> linestring{new OGRLineString};
+    linestring->setPoints(static_cast<int>(ring_size(ring)), m_x.data() + ring_begin(ring), m_y.data() + ring_begin(ring));
+    linestring->assignSpatialReference(srs);
+    return linestring;
+}
+
+bool add_ogr_geometry(const OGRGeometry& geometry, polygon_vector_type& polygons) {
+    if (geometry.getGeometryType() == wkbPolygon) {
+        if (!geometry.IsEmpty()) {
+            polygons.emplace_back(static_cast<const OGRPolygon&>(geometry));
+        }
+        return true;
+    }
+
+    if (geometry.getGeometryType() == wkbMultiPolygon) {
+        const auto& multipolygon = static_cast<const OGRMultiPolygon&>(geometry);
+        for (int i = 0; i < multipolygon.getNumGeometries(); ++i) {
+            const auto* polygon = static_cast<const OGRPolygon*>(multipolygon.getGeometryRef(i));
+            if (!polygon->IsEmpty()) {
+                polygons.emplace_back(*polygon);
+            }
+        }
+        return true;
+    }
+
+    return false;
+}
@@ -0,0 +1,161 @@
+#ifndef POLYGON_HPP
+#define POLYGON_HPP
+
+/*
+
+  Copyright 2012-2021 Jochen Topf <jochen@topf.org>.
+
+  This file is part of OSMCoastline.
+
+  OSMCoastline is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  OSMCoastline is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with OSMCoastline.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include <ogr_core.h>
+
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+class OGRGeometry;
+class OGRLineString;
+class OGRPolygon;
+class OGRSpatialReference;
+
+/**
+ * A lightweight polygon used inside osmcoastline. All coordinates are
+ * stored in two flat buffers (one for the x and one for the y coordinates)
+ * with the rings one after the other, the first ring is the outer ring.
+ * So a polygon needs only a few memory allocations however many rings it
+ * has. OGR geometries are only created from it when they are needed for
+ * output or for GEOS operations done through OGR.
+ *
+ * The rings are closed, ie. the last point of each ring is the same as
+ * the first.
+ */
+class Polygon {
+
+    std::vector<double> m_x;
+    std::vector<double> m_y;
+
+    // Ring r has the points from m_ring_begin[r] to m_ring_begin[r + 1] - 1.
+    std::vector<std::size_t> m_ring_begin{0};
+
+public:
+
+    Polygon() = default;
+
+    /// Create polygon from an OGR polygon.
+    explicit Polygon(const OGRPolygon& polygon);
+
+    /// The number of rings including the outer ring.
+    std::size_t num_rings() const noexcept {
+        return m_ring_begin.size() - 1;
+    }
+
+    /// The number of points in all rings.
+    std::size_t num_points() const noexcept {
+        return m_x.size();
+    }
+
+    bool empty() const noexcept {
+        return m_x.empty();
+    }
+
+    /// Index of the first point of the ring.
+    std::size_t ring_begin(std::size_t ring) const noexcept {
+        assert(ring < num_rings());
+        return m_ring_begin[ring];
+    }
+
+    /// Index one past the last point of the ring.
+    std::size_t ring_end(std::size_t ring) const noexcept {
+        assert(ring < num_rings());
+        return m_ring_begin[ring + 1];
+    }
+
+    /// The number of points in the ring.
+    std::size_t ring_size(std::size_t ring) const noexcept {
+        return ring_end(ring) - ring_begin(ring);
+    }
+
+    double x(std::size_t n) const noexcept {
+        return m_x[n];
+    }
+
+    double y(std::size_t n) const noexcept {
+        return m_y[n];
+    }
+
+    /// All x coordinates, for transforming them in place.
+    double* x_data() noexcept {
+        return m_x.data();
+    }
+
+    /// All y coordinates, for transforming them in place.
+    double* y_data() noexcept {
+        return m_y.data();
+    }
+
+    void reserve(std::size_t num_points) {
+        m_x.reserve(num_points);
+        m_y.reserve(num_points);
+    }
+
+    /// Add a point to the ring currently being built.
+    void add_point(double x, double y) {
+        m_x.push_back(x);
+        m_y.push_back(y);
+    }
+
+    /// Finish the ring currently being built.
+    void finish_ring() {
+        m_ring_begin.push_back(m_x.size());
+    }
+
+    /// Add a copy of a ring from another polygon.
+    void add_ring(const Polygon& other, std::size_t ring);
+
+    /// Calculate the bounding box.
+    OGREnvelope envelope() const noexcept;
+
+    /// Twice the signed area of the ring, positive if counterclockwise.
+    double ring_area2(std::size_t ring) const noexcept;
+
+    bool is_clockwise(std::size_t ring) const noexcept {
+        return ring_area2(ring) < 0;
+    }
+
+    /// Reverse the order of the points in the ring.
+    void reverse_ring(std::size_t ring) noexcept;
+
+    /// Create an OGR polygon from this polygon with the given SRS.
+    std::unique_ptr<OGRPolygon> ogr_polygon(OGRSpatialReference* srs) const;
+
+    /// Create an OGR linestring from a ring of this polygon with the given SRS.
+    std::unique_ptr<OGRLineString> ogr_linestring(std::size_t ring, OGRSpatialReference* srs) const;
+
+}; // class Polygon
+
+using polygon_vector_type = std::vector<Polygon>;
+
+/**
+ * Add the polygon or all polygons of the multipolygon to the vector.
+ * Empty polygons are skipped.
+ * Returns false if the geometry is of some other type.
+ */
+bool add_ogr_geometry(const OGRGeometry& geometry, polygon_vector_type& polygons);
+
+#endif // POLYGON_HPP
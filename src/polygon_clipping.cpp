@@ -0,0 +1,536 @@
+/*
+
+  Copyright 2012-2021 Jochen Topf <jochen@topf.org>.
+
+  This file is part of OSMCoastline.
+
+  OSMCoastline is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  OSMCoastline is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with OSMCoastline.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include "polygon_clipping.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <limits>
+#include <utility>
+#include <vector>
+
+namespace {
+
+    constexpr const std::size_t none = std::numeric_limits<std::size_t>::max();
+
+    struct point {
+        double x;
+        double y;
+    };
+
+    using ring_type = std::vector<point>;
+
+    /**
+     * A part of a ring inside the slab. It starts where the ring enters the
+     * slab and ends where the ring leaves it again.
+     */
+    struct chain {
+        ring_type points;
+        std::size_t next = none;
+
+        // The boundary and the index in the crossings of that boundary
+        // where the chain starts (none for chains at the start of a ring).
+        std::size_t entry_boundary = none;
+        std::size_t entry_index = none;
+
+        bool used = false;
+    };
+
+    /// A place where a ring crosses one of the boundaries of the slab.
+    struct crossing {
+        double pos; // position along the boundary
+        std::size_t chain;
+        bool entry;
+
+        crossing(double p, std::size_t c, bool e) noexcept :
+            pos(p),
+            chain(c),
+            entry(e) {
+        }
+    };
+
+    double ring_area2(const ring_type& ring) noexcept {
+        double sum = 0.0;
+        for (std::size_t n = 1; n < ring.size(); ++n) {
+            sum += ring[n - 1].x * ring[n].y - ring[n].x * ring[n - 1].y;
+        }
+        return sum;
+    }
+
+    /**
+     * Check whether the point is inside the ring. Returns 1 if it is
+     * inside, 0 if it is outside and -1 if it is on the ring.
+     */
+    int point_in_ring(const point& p, const ring_type& ring) noexcept {
+        bool inside = false;
+        for (std::size_t n = 1; n < ring.size(); ++n) {
+            const point& a = ring[n - 1];
+            const point& b = ring[n];
+            if ((b.x - a.x) * (p.y - a.y) == (p.x - a.x) * (b.y - a.y) &&
+                std::min(a.x, b.x) <= p.x && p.x <= std::max(a.x, b.x) &&
+                std::min(a.y, b.y) <= p.y && p.y <= std::max(a.y, b.y)) {
+                return -1;
+            }
+            if ((a.y > p.y) != (b.y > p.y)) {
+                const double x = a.x + (p.y - a.y) * (b.x - a.x) / (b.y - a.y);
+                if (p.x < x) {
+                    inside = !inside;
+                }
+            }
+        }
+        return inside ? 1 : 0;
+    }
+
+    class SlabClipper {
+
+        clip_axis m_axis;
+        double m_bounds[2];
+
+        std::vector<chain> m_chains;
+
+        // The crossings with the min and the max boundary.
+        std::vector<crossing> m_crossings[2];
+
+        std::vector<ring_type> m_outer_rings;
+        std::vector<ring_type> m_inner_rings;
+
+        // The chain at the start and the chain currently open in the ring
+        // currently being added.
+        std::size_t m_first_chain = none;
+        std::size_t m_open_chain = none;
+        bool m_outer = false;
+
+        // The coordinate along the clip axis.
+        double coord(const point& p) const noexcept {
+            return m_axis == clip_axis::x ? p.x : p.y;
+        }
+
+        // The coordinate along the boundaries.
+        double pos(const point& p) const noexcept {
+            return m_axis == clip_axis::x ? p.y : p.x;
+        }
+
+        // The region of the point: -1 if below the slab, 0 inside, 1 above.
+        // Returns 2 for points on a boundary.
+        int region(const point& p) const noexcept {
+            const double c = coord(p);
+            if (c < m_bounds[0]) {
+                return -1;
+            }
+            if (c > m_bounds[1]) {
+                return 1;
+            }
+            if (c == m_bounds[0] || c == m_bounds[1]) {
+                return 2;
+            }
+            return 0;
+        }
+
+        static std::size_t boundary(int region) noexcept {
+            return region < 0 ? 0 : 1;
+        }
+
+        point intersection(const point& p, const point& q, std::size_t b) const noexcept {
+            const double value = m_bounds[b];
+            const double s = (value - coord(p)) / (coord(q) - coord(p));
+            if (m_axis == clip_axis::x) {
+                return point{value, p.y + s * (q.y - p.y)};
+            }
+            return point{p.x + s * (q.x - p.x), value};
+        }
+
+        void start_chain(const point& p, std::size_t b) {
+            m_open_chain = m_chains.size();
+            m_chains.emplace_back();
+            m_chains.back().points.push_back(p);
+            m_chains.back().entry_boundary = b;
+            m_chains.back().entry_index = m_crossings[b].size();
+            m_crossings[b].emplace_back(pos(p), m_open_chain, true);
+        }
+
+        void end_chain(const point& p, std::size_t b) {
+            m_chains[m_open_chain].points.push_back(p);
+            m_crossings[b].emplace_back(pos(p), m_open_chain, false);
+            m_open_chain = none;
+        }
+
+        /*
+         * The rings are oriented so that the inside is always on the
+         * right (outer rings clockwise, inner rings counterclockwise). So
+         * the new outer rings have to follow the boundary from where they
+         * leave the slab in the direction which has the slab on the right
+         * to where they enter it again.
+         */
+        bool follows_increasing_pos(std::size_t b) const noexcept {
+            return (m_axis == clip_axis::x) == (b == 0);
+        }
+
+        bool link_chains(std::size_t b) {
+            auto& crossings = m_crossings[b];
+            std::sort(crossings.begin(), crossings.end(), [](const crossing& lhs, const crossing& rhs) {
+                return lhs.pos < rhs.pos;
+            });
+
+            for (std::size_t n = 1; n < crossings.size(); ++n) {
+                if (crossings[n - 1].pos == crossings[n].pos) {
+                    return false;
+                }
+            }
+
+            const bool increasing = follows_increasing_pos(b);
+            for (std::size_t n = 0; n < crossings.size(); ++n) {
+                if (crossings[n].entry) {
+                    continue;
+                }
+                if (increasing ? n + 1 == crossings.size() : n == 0) {
+                    return false;
+                }
+                const auto& next = crossings[increasing ? n + 1 : n - 1];
+                if (!next.entry) {
+                    return false;
+                }
+                m_chains[crossings[n].chain].next = next.chain;
+            }
+
+            return true;
+        }
+
+        /**
+         * Find the outer ring containing the inner ring. Returns none if
+         * there is no such ring or if it can't be decided.
+         */
+        std::size_t find_outer_ring(const ring_type& inner) const {
+            if (m_outer_rings.size() == 1) {
+                return 0;
+            }
+
+            for (const auto& p : inner) {
+                std::size_t found = none;
+                bool on_boundary = false;
+                for (std::size_t n = 0; n < m_outer_rings.size(); ++n) {
+                    const int result = point_in_ring(p, m_outer_rings[n]);
+                    if (result < 0) {
+                        on_boundary = true;
+                        break;
+                    }
+                    if (result > 0) {
+                        if (found != none) {
+                            return none;
+                        }
+                        found = n;
+                    }
+                }
+                if (!on_boundary) {
+                    return found;
+                }
+            }
+
+            return none;
+        }
+
+    public:
+
+        SlabClipper(clip_axis axis, double min, double max) noexcept :
+            m_axis(axis),
+            m_bounds{min, max} {
+        }
+
+        /// Start adding a new ring.
+        void begin_ring(bool outer) noexcept {
+            m_first_chain = none;
+            m_open_chain = none;
+            m_outer = outer;
+        }
+
+        /**
+         * The first point of the ring, call this only if it is inside the
+         * slab or on one of its boundaries.
+         */
+        bool start_ring(const point& p) {
+            if (region(p) != 0) {
+                return false;
+            }
+            m_first_chain = m_chains.size();
+            m_open_chain = m_first_chain;
+            m_chains.emplace_back();
+            m_chains.back().points.push_back(p);
+            return true;
+        }
+
+        /**
+         * Add an edge of the ring. Edges not touching the slab can be left
+         * out.
+         */
+        bool add_edge(const point& p, const point& q) {
+            const int rp = region(p);
+            const int rq = region(q);
+            if (rp == 2 || rq == 2) {
+                return false;
+            }
+
+            if (rp == 0) {
+                if (rq == 0) {
+                    m_chains[m_open_chain].points.push_back(q);
+                } else {
+                    end_chain(intersection(p, q, boundary(rq)), boundary(rq));
+                }
+            } else if (rq == 0) {
+                start_chain(intersection(p, q, boundary(rp)), boundary(rp));
+                m_chains[m_open_chain].points.push_back(q);
+            } else if (rq != rp) {
+                start_chain(intersection(p, q, boundary(rp)), boundary(rp));
+                end_chain(intersection(p, q, boundary(rq)), boundary(rq));
+            }
+
+            return true;
+        }
+
+        /**
+         * Finish the ring. A chain still open at the end of the ring is
+         * continued by the chain at the start of the ring.
+         */
+        bool end_ring() {
+            if ((m_open_chain == none) != (m_first_chain == none)) {
+                return false;
+            }
+
+            if (m_open_chain == none) {
+                return true;
+            }
+
+            auto& open = m_chains[m_open_chain];
+            if (m_open_chain == m_first_chain) {
+                // The ring is completely inside the slab
+                if (m_outer) {
+                    m_outer_rings.push_back(std::move(open.points));
+                } else {
+                    m_inner_rings.push_back(std::move(open.points));
+                }
+            } else {
+                auto& first = m_chains[m_first_chain];
+                open.points.insert(open.points.end(), first.points.begin() + 1, first.points.end());
+                first.points = std::move(open.points);
+                first.entry_boundary = open.entry_boundary;
+                first.entry_index = open.entry_index;
+                m_crossings[first.entry_boundary][first.entry_index].chain = m_first_chain;
+            }
+
+            open.points.clear();
+            open.used = true;
+            m_open_chain = none;
+            return true;
+        }
+
+        /// Stitch the chains together into outer rings.
+        bool stitch() {
+            if (!link_chains(0) || !link_chains(1)) {
+                return false;
+            }
+
+            for (std::size_t n = 0; n < m_chains.size(); ++n) {
+                if (m_chains[n].used) {
+                    continue;
+                }
+                ring_type ring;
+                std::size_t c = n;
+                do {
+                    if (c == none || m_chains[c].used) {
+                        return false;
+                    }
+                    m_chains[c].used = true;
+                    ring.insert(ring.end(), m_chains[c].points.begin(), m_chains[c].points.end());
+                    c = m_chains[c].next;
+                } while (c != n);
+                ring.push_back(ring.front());
+
+                if (ring_area2(ring) >= 0) {
+                    return false;
+                }
+                m_outer_rings.push_back(std::move(ring));
+            }
+
+            return true;
+        }
+
+        /**
+         * Add the inner rings to the outer rings they are in and add the
+         * resulting polygons to the parts. If reverse is set, the points of
+         * all rings are reversed again.
+         */
+        bool assemble(bool reverse, polygon_vector_type& parts) const {
+            std::vector<std::vector<std::size_t>> holes(m_outer_rings.size());
+            for (std::size_t n = 0; n < m_inner_rings.size(); ++n) {
+                const auto outer = find_outer_ring(m_inner_rings[n]);
+                if (outer == none) {
+                    return false;
+                }
+                holes[outer].push_back(n);
+            }
+
+            const auto add_ring = [reverse](Polygon& polygon, const ring_type& ring) {
+                if (reverse) {
+                    for (auto it = ring.rbegin(); it != ring.rend(); ++it) {
+                        polygon.add_point(it->x, it->y);
+                    }
+                } else {
+                    for (const auto& p : ring) {
+                        polygon.add_point(p.x, p.y);
+                    }
+                }
+                polygon.finish_ring();
+            };
+
+            for (std::size_t n = 0; n < m_outer_rings.size(); ++n) {
+                std::size_t size = m_outer_rings[n].size();
+                for (const auto hole : holes[n]) {
+                    size += m_inner_rings[hole].size();
+                }
+
+                Polygon polygon;
+                polygon.reserve(size);
+                add_ring(polygon, m_outer_rings[n]);
+                for (const auto hole : holes[n]) {
+                    add_ring(polygon, m_inner_rings[hole]);
+                }
+                parts.push_back(std::move(polygon));
+            }
+
+            return true;
+        }
+
+    }; // class SlabClipper
+
+} // anonymous namespace
+
+bool clip_polygon_to_slabs(const Polygon& polygon, clip_axis axis, const std::vector<std::pair<double, double>>& slabs, std::vector<polygon_vector_type>& parts) {
+    parts.clear();
+    parts.resize(slabs.size());
+    if (polygon.empty()) {
+        return true;
+    }
+
+    std::vector<SlabClipper> clippers;
+    clippers.reserve(slabs.size());
+    for (const auto& slab : slabs) {
+        clippers.emplace_back(axis, slab.first, slab.second);
+    }
+
+    // The slabs touching the range from a to b.
+    const auto touched = [&](double a, double b) {
+        const auto first = std::lower_bound(slabs.begin(), slabs.end(), a, [](const std::pair<double, double>& slab, double value) {
+            return slab.second < value;
+        });
+        const auto last = std::upper_bound(slabs.begin(), slabs.end(), b, [](double value, const std::pair<double, double>& slab) {
+            return value < slab.first;
+        });
+        return std::make_pair(static_cast<std::size_t>(first - slabs.begin()), static_cast<std::size_t>(last - slabs.begin()));
+    };
+
+    const auto coord = [axis](const point& p) {
+        return axis == clip_axis::x ? p.x : p.y;
+    };
+
+    // The clipper needs the outer ring clockwise and inner rings
+    // counterclockwise.
+    const bool reverse = !polygon.is_clockwise(0);
+
+    for (std::size_t ring = 0; ring < polygon.num_rings(); ++ring) {
+        const auto begin = polygon.ring_begin(ring);
+        const auto size = polygon.ring_size(ring);
+        if (size < 4) {
+            return false;
+        }
+
+        const bool clockwise = ring == 0 ? !reverse : !polygon.is_clockwise(ring);
+
+        // Number of points without the closing point
+        const auto num_points = size - 1;
+        const auto get = [&](std::size_t n) {
+            const auto index = begin + (clockwise ? n : num_points - n);
+            return point{polygon.x(index), polygon.y(index)};
+        };
+
+        for (auto& clipper : clippers) {
+            clipper.begin_ring(ring == 0);
+        }
+
+        point p = get(0);
+        const auto start = touched(coord(p), coord(p));
+        for (std::size_t n = start.first; n < start.second; ++n) {
+            if (!clippers[n].start_ring(p)) {
+                return false;
+            }
+        }
+
+        for (std::size_t i = 1; i <= num_points; ++i) {
+            const point q = get(i);
+            const auto range = touched(std::min(coord(p), coord(q)), std::max(coord(p), coord(q)));
+            for (std::size_t n = range.first; n < range.second; ++n) {
+                if (!clippers[n].add_edge(p, q)) {
+                    return false;
+                }
+            }
+            p = q;
+        }
+
+        for (auto& clipper : clippers) {
+            if (!clipper.end_ring()) {
+                return false;
+            }
+        }
+    }
+
+    for (std::size_t n = 0; n < clippers.size(); ++n) {
+        if (!clippers[n].stitch() || !clippers[n].assemble(reverse, parts[n])) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool clip_polygon(const Polygon& polygon, clip_axis axis, double min, double max, polygon_vector_type& parts) {
+    if (polygon.empty()) {
+        return true;
+    }
+
+    const OGREnvelope envelope = polygon.envelope();
+    const double env_min = axis == clip_axis::x ? envelope.MinX : envelope.MinY;
+    const double env_max = axis == clip_axis::x ? envelope.MaxX : envelope.MaxY;
+
+    if (env_max < min || env_min > max) {
+        return true;
+    }
+
+    if (min < env_min && env_max < max) {
+        parts.push_back(polygon);
+        return true;
+    }
+
+    std::vector<polygon_vector_type> result;
+    if (!clip_polygon_to_slabs(polygon, axis, {std::make_pair(min, max)}, result)) {
+        return false;
+    }
+
+    std::move(result[0].begin(), result[0].end(), std::back_inserter(parts));
+    return true;
+}
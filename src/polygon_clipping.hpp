@@ -0,0 +1,68 @@
+#ifndef POLYGON_CLIPPING_HPP
+#define POLYGON_CLIPPING_HPP
+
+/*
+
+  Copyright 2012-2021 Jochen Topf <jochen@topf.org>.
+
+  This file is part of OSMCoastline.
+
+  OSMCoastline is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  OSMCoastline is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with OSMCoastline.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include "polygon.hpp"
+
+#include <utility>
+#include <vector>
+
+enum class clip_axis {
+    x = 0,
+    y = 1
+};
+
+/**
+ * Clip a (valid) polygon to the slab of the plane where the coordinate on
+ * the given axis is between min and max. Use infinite values for min or
+ * max to clip to a half plane. The resulting parts are added to the parts
+ * vector. This gives the same result as the intersection with a rectangle
+ * covering the slab, but it is much faster than the general overlay done
+ * by GEOS.
+ *
+ * Each ring is cut into chains of points inside the slab. The chains are
+ * then stitched together along the boundaries of the slab into new outer
+ * rings. Holes completely inside the slab are added to the outer ring
+ * containing them. The parts have the same orientation as the polygon.
+ *
+ * Returns false, without adding anything to the parts, if the polygon has
+ * a point exactly on one of the boundaries or if the rings don't fit
+ * together. The caller has to fall back to GEOS in that case.
+ */
+bool clip_polygon(const Polygon& polygon, clip_axis axis, double min, double max, polygon_vector_type& parts);
+
+/**
+ * Clip a polygon to several slabs along the same axis at once, each given
+ * as a pair of min and max. The slabs must be sorted by both their min and
+ * their max, they can overlap. The parts in slab n are put into parts[n].
+ *
+ * This walks the rings only once and each edge is only looked at for the
+ * slabs it touches, so every point is handled only a few times however
+ * many slabs there are.
+ *
+ * Returns false in the same cases as clip_polygon(). The parts are not
+ * usable then.
+ */
+bool clip_polygon_to_slabs(const Polygon& polygon, clip_axis axis, const std::vector<std::pair<double, double>>& slabs, std::vector<polygon_vector_type>& parts);
+
+#endif // POLYGON_CLIPPING_HPP
@@ -0,0 +1,432 @@
+/*
+
+  Copyright 2012-2021 Jochen Topf <jochen@topf.org>.
+
+  This file is part of OSMCoastline.
+
+  OSMCoastline is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  OSMCoastline is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with OSMCoastline.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include "parallel.hpp"
+#include "polygon_nesting.hpp"
+
+#include <osmium/thread/pool.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <numeric>
+#include <utility>
+#include <vector>
+
+namespace {
+
+    constexpr const std::size_t none = std::numeric_limits<std::size_t>::max();
+
+    struct envelope {
+        double min_x = std::numeric_limits<double>::max();
+        double min_y = std::numeric_limits<double>::max();
+        double max_x = std::numeric_limits<double>::lowest();
+        double max_y = std::numeric_limits<double>::lowest();
+
+        void extend(double x, double y) noexcept {
+            min_x = std::min(min_x, x);
+            min_y = std::min(min_y, y);
+            max_x = std::max(max_x, x);
+            max_y = std::max(max_y, y);
+        }
+
+        void extend(const envelope& other) noexcept {
+            extend(other.min_x, other.min_y);
+            extend(other.max_x, other.max_y);
+        }
+
+        bool contains(const envelope& other) const noexcept {
+            return min_x <= other.min_x && min_y <= other.min_y &&
+                   max_x >= other.max_x && max_y >= other.max_y;
+        }
+
+        double center_x() const noexcept {
+            return (min_x + max_x) / 2;
+        }
+
+        double center_y() const noexcept {
+            return (min_y + max_y) / 2;
+        }
+    };
+
+    struct ring_info {
+        envelope env;
+        double area = 0.0;
+
+        /// Clockwise rings are outer rings.
+        bool outer = false;
+    };
+
+    ring_info get_ring_info(const Polygon& ring) {
+        ring_info info;
+        for (std::size_t n = 0; n < ring.num_points(); ++n) {
+            info.env.extend(ring.x(n), ring.y(n));
+        }
+        const double area2 = ring.ring_area2(0);
+        info.area = std::abs(area2 / 2);
+        info.outer = area2 < 0;
+        return info;
+    }
+
+    /**
+     * An STR (sort-tile-recursive) tree on the envelopes of the outer
+     * rings. It finds all outer rings whose envelope contains some other
+     * envelope.
+     */
+    class EnvelopeTree {
+
+        static constexpr const std::size_t node_size = 16;
+
+        // On level 0 begin is the index of the ring, on the other levels
+        // [begin, end) is the range of child nodes on the level below.
+        struct node {
+            envelope env;
+            std::size_t begin;
+            std::size_t end;
+        };
+
+        std::vector<std::vector<node>> m_levels;
+
+        // Sort the nodes into slices by x and each slice by y and create
+        // one parent node for every node_size consecutive nodes.
+        static std::vector<node> pack(std::vector<node>& nodes) {
+            const auto by_x = [](const node& a, const node& b) {
+                return a.env.center_x() < b.env.center_x();
+            };
+            const auto by_y = [](const node& a, const node& b) {
+                return a.env.center_y() < b.env.center_y();
+            };
+
+            const std::size_t num_parents = (nodes.size() + node_size - 1) / node_size;
+            const auto num_slices = static_cast<std::size_t>(std::ceil(std::sqrt(static_cast<double>(num_parents))));
+            const std::size_t slice_size = (num_parents + num_slices - 1) / num_slices * node_size;
+
+            std::sort(nodes.begin(), nodes.end(), by_x);
+            for (std::size_t begin = 0; begin < nodes.size(); begin += slice_size) {
+                const auto end = std::min(begin + slice_size, nodes.size());
+                std::sort(nodes.begin() + begin, nodes.begin() + end, by_y);
+            }
+
+            std::vector<node> parents;
+            parents.reserve(num_parents);
+            for (std::size_t begin = 0; begin < nodes.size(); begin += node_size) {
+                const auto end = std::min(begin + node_size, nodes.size());
+                node parent{envelope{}, begin, end};
+                for (std::size_t n = begin; n < end; ++n) {
+                    parent.env.extend(nodes[n].env);
+                }
+                parents.push_back(parent);
+            }
+            return parents;
+        }
+
+        template <typename TFunc>
+        void query(std::size_t level, std::size_t n, const envelope& env, TFunc&& func) const {
+            const node& nd = m_levels[level][n];
+            if (!nd.env.contains(env)) {
+                return;
+            }
+            if (level == 0) {
+                func(nd.begin);
+                return;
+            }
+            for (std::size_t child = nd.begin; child < nd.end; ++child) {
+                query(level - 1, child, env, func);
+            }
+        }
+
+    public:
+
+        EnvelopeTree(const std::vector<ring_info>& info, const std::vector<std::size_t>& rings) {
+            if (rings.empty()) {
+                return;
+            }
+
+            m_levels.emplace_back();
+            m_levels.back().reserve(rings.size());
+            for (const auto ring : rings) {
+                m_levels.back().push_back(node{info[ring].env, ring, ring + 1});
+            }
+
+            while (m_levels.back().size() > 1) {
+                auto parents = pack(m_levels.back());
+                m_levels.push_back(std::move(parents));
+            }
+        }
+
+        /// Call func(ring) for all rings whose envelope contains env.
+        template <typename TFunc>
+        void for_each_containing(const envelope& env, TFunc&& func) const {
+            if (!m_levels.empty()) {
+                query(m_levels.size() - 1, 0, env, func);
+            }
+        }
+
+    }; // class EnvelopeTree
+
+    /**
+     * Index for point in ring tests on a (possibly huge) outer ring. The
+     * y range of the ring is split into bands, each band knows the edges
+     * of the ring reaching into it. So only a few edges have to be looked
+     * at for each test.
+     *
+     * The tests do the same calculations as OGRLinearRing::isPointInRing()
+     * and OGRLinearRing::isPointOnRingBoundary() so the results are the
+     * same as in organizePolygons().
+     */
+    class RingIndex {
+
+        // Average number of edges per band.
+        static constexpr const std::size_t band_edges = 8;
+
+        const Polygon& m_ring;
+        double m_min_y = 0.0;
+        double m_max_y = 0.0;
+        double m_band_height = 1.0;
+        std::size_t m_num_bands = 1;
+
+        // Edge e goes from point e to point e+1. The edges in band b are
+        // m_edges[m_band_begin[b]] to m_edges[m_band_begin[b + 1] - 1].
+        std::vector<std::size_t> m_band_begin;
+        std::vector<std::size_t> m_edges;
+
+        std::size_t band(double y) const noexcept {
+            const double b = std::floor((y - m_min_y) / m_band_height);
+            if (b < 0) {
+                return 0;
+            }
+            return std::min(static_cast<std::size_t>(b), m_num_bands - 1);
+        }
+
+        template <typename TFunc>
+        void for_each_edge_in_band(double y, TFunc&& func) const {
+            const auto b = band(y);
+            for (auto n = m_band_begin[b]; n < m_band_begin[b + 1]; ++n) {
+                const auto e = m_edges[n];
+                func(m_ring.x(e), m_ring.y(e), m_ring.x(e + 1), m_ring.y(e + 1));
+            }
+        }
+
+    public:
+
+        RingIndex(const Polygon& ring, const envelope& env) :
+            m_ring(ring),
+            m_min_y(env.min_y),
+            m_max_y(env.max_y) {
+            if (ring.num_points() < 2) {
+                m_band_begin.assign(2, 0);
+                return;
+            }
+            const std::size_t num_edges = ring.num_points() - 1;
+
+            m_num_bands = std::max(num_edges / band_edges, static_cast<std::size_t>(1));
+            if (m_max_y > m_min_y) {
+                m_band_height = (m_max_y - m_min_y) / static_cast<double>(m_num_bands);
+            }
+
+            const auto edge_bands = [&](std::size_t e) {
+                const double y1 = ring.y(e);
+                const double y2 = ring.y(e + 1);
+                return std::make_pair(band(std::min(y1, y2)), band(std::max(y1, y2)));
+            };
+
+            m_band_begin.assign(m_num_bands + 1, 0);
+            for (std::size_t e = 0; e < num_edges; ++e) {
+                const auto bands = edge_bands(e);
+                for (auto b = bands.first; b <= bands.second; ++b) {
+                    ++m_band_begin[b + 1];
+                }
+            }
+            std::partial_sum(m_band_begin.begin(), m_band_begin.end(), m_band_begin.begin());
+
+            std::vector<std::size_t> pos(m_band_begin.begin(), m_band_begin.end() - 1);
+            m_edges.resize(m_band_begin.back());
+            for (std::size_t e = 0; e < num_edges; ++e) {
+                const auto bands = edge_bands(e);
+                for (auto b = bands.first; b <= bands.second; ++b) {
+                    m_edges[pos[b]++] = e;
+                }
+            }
+        }
+
+        /// Is the point exactly on one of the edges of the ring?
+        bool on_boundary(double px, double py) const {
+            if (py < m_min_y || py > m_max_y) {
+                return false;
+            }
+            bool result = false;
+            for_each_edge_in_band(py, [&](double ax, double ay, double bx, double by) {
+                const double x1 = ax - px;
+                const double y1 = ay - py;
+                const double x2 = bx - px;
+                const double y2 = by - py;
+                if ((x1 != x2 || y1 != y2) && x1 * y2 - x2 * y1 == 0 &&
+                    x1 * x2 <= 0 && y1 * y2 <= 0) {
+                    result = true;
+                }
+            });
+            return result;
+        }
+
+        /// Is the point inside the ring? Uses the crossing number.
+        bool contains(double px, double py) const {
+            if (py < m_min_y || py > m_max_y) {
+                return false;
+            }
+            int crossings = 0;
+            for_each_edge_in_band(py, [&](double ax, double ay, double bx, double by) {
+                const double x1 = bx - px;
+                const double y1 = by - py;
+                const double x2 = ax - px;
+                const double y2 = ay - py;
+                if ((y1 > 0 && y2 <= 0) || (y2 > 0 && y1 <= 0)) {
+                    if ((x1 * y2 - x2 * y1) / (y2 - y1) > 0) {
+                        ++crossings;
+                    }
+                }
+            });
+            return (crossings & 1) != 0;
+        }
+
+    }; // class RingIndex
+
+    /**
+     * Is the inner ring inside the outer ring? The first point of the
+     * inner ring which is not on the outer ring decides. If all are on the
+     * outer ring, the middle of the first segment is used.
+     */
+    bool is_inside(const Polygon& inner, const RingIndex& outer) {
+        const std::size_t num_points = inner.num_points();
+        for (std::size_t n = 0; n < num_points; ++n) {
+            const double x = inner.x(n);
+            const double y = inner.y(n);
+            if (!outer.on_boundary(x, y)) {
+                return outer.contains(x, y);
+            }
+        }
+        if (num_points > 2) {
+            return outer.contains((inner.x(0) + inner.x(1)) / 2,
+                                  (inner.y(0) + inner.y(1)) / 2);
+        }
+        return false;
+    }
+
+} // anonymous namespace
+
+polygon_vector_type nest_polygons(polygon_vector_type&& rings, int num_threads) {
+    std::unique_ptr<osmium::thread::Pool> pool;
+    if (num_threads > 1) {
+        pool.reset(new osmium::thread::Pool{num_threads});
+    }
+
+    std::vector<ring_info> info(rings.size());
+    run_chunked(pool.get(), rings.size(), [&](std::size_t n) {
+        info[n] = get_ring_info(rings[n]);
+    });
+
+    // Order the rings by area, largest first.
+    std::vector<std::size_t> order(rings.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) {
+        return info[a].area > info[b].area;
+    });
+
+    std::vector<std::size_t> rank(rings.size());
+    std::vector<std::size_t> outers;
+    std::vector<std::size_t> inners;
+    for (std::size_t r = 0; r < order.size(); ++r) {
+        rank[order[r]] = r;
+        (info[order[r]].outer ? outers : inners).push_back(order[r]);
+    }
+
+    // Find the outer rings larger than each inner ring whose envelopes
+    // contain the envelope of the inner ring, smallest first.
+    const EnvelopeTree tree{info, outers};
+    std::vector<std::vector<std::size_t>> candidates(inners.size());
+    run_chunked(pool.get(), inners.size(), [&](std::size_t n) {
+        const auto inner = inners[n];
+        auto& c = candidates[n];
+        tree.for_each_containing(info[inner].env, [&](std::size_t outer) {
+            if (rank[outer] < rank[inner]) {
+                c.push_back(outer);
+            }
+        });
+        std::sort(c.begin(), c.end(), [&](std::size_t a, std::size_t b) {
+            return rank[a] > rank[b];
+        });
+    });
+
+    // Build the point in ring index for all outer rings which are
+    // candidates for some inner ring.
+    std::vector<bool> needed(rings.size());
+    std::vector<std::size_t> indexed;
+    for (const auto& c : candidates) {
+        for (const auto outer : c) {
+            if (!needed[outer]) {
+                needed[outer] = true;
+                indexed.push_back(outer);
+            }
+        }
+    }
+
+    std::vector<std::unique_ptr<RingIndex>> indexes(rings.size());
+    run_chunked(pool.get(), indexed.size(), [&](std::size_t n) {
+        const auto outer = indexed[n];
+        indexes[outer].reset(new RingIndex{rings[outer], info[outer].env});
+    });
+
+    // Each inner ring becomes a hole in the first candidate containing it.
+    std::vector<std::size_t> enclosing(inners.size(), none);
+    run_chunked(pool.get(), inners.size(), [&](std::size_t n) {
+        const Polygon& ring = rings[inners[n]];
+        for (const auto outer : candidates[n]) {
+            if (is_inside(ring, *indexes[outer])) {
+                enclosing[n] = outer;
+                return;
+            }
+        }
+    });
+
+    std::vector<std::vector<std::size_t>> holes(rings.size());
+    std::vector<bool> is_hole(rings.size());
+    for (std::size_t n = 0; n < inners.size(); ++n) {
+        if (enclosing[n] != none) {
+            holes[enclosing[n]].push_back(inners[n]);
+            is_hole[inners[n]] = true;
+        }
+    }
+
+    polygon_vector_type polygons;
+    for (const auto n : order) {
+        if (is_hole[n]) {
+            continue;
+        }
+        for (const auto hole : holes[n]) {
+            rings[n].add_ring(rings[hole], 0);
+        }
+        polygons.push_back(std::move(rings[n]));
+    }
+
+    return polygons;
+}
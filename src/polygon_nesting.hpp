@@ -0,0 +1,47 @@
+#ifndef POLYGON_NESTING_HPP
+#define POLYGON_NESTING_HPP
+
+/*
+
+  Copyright 2012-2021 Jochen Topf <jochen@topf.org>.
+
+  This file is part of OSMCoastline.
+
+  OSMCoastline is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  OSMCoastline is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with OSMCoastline.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include "polygon.hpp"
+
+/**
+ * Assemble polygons out of rings, each given as a polygon without holes.
+ * This does the same as OGRGeometryFactory::organizePolygons() with the
+ * METHOD=ONLY_CCW option:
+ *
+ * Clockwise rings are outer rings. Counterclockwise rings are inner rings,
+ * each is added as a hole to the smallest outer ring (by area) containing
+ * it. Inner rings not inside any larger outer ring become polygons of their
+ * own.
+ *
+ * The outer rings which might contain an inner ring are found with an STR
+ * tree on the bounding boxes of the outer rings. Containment is then
+ * checked with a point in polygon test. The work is done on num_threads
+ * threads.
+ *
+ * The polygons are returned ordered by the area of their outer rings,
+ * largest first. Holes are ordered the same way.
+ */
+polygon_vector_type nest_polygons(polygon_vector_type&& rings, int num_threads);
+
+#endif // POLYGON_NESTING_HPP
@@ -0,0 +1,225 @@
+/*
+
+  Copyright 2012-2021 Jochen Topf <jochen@topf.org>.
+
+  This file is part of OSMCoastline.
+
+  OSMCoastline is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  OSMCoastline is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with OSMCoastline.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include "parallel.hpp"
+#include "polygon_validation.hpp"
+
+#include <osmium/thread/pool.hpp>
+
+#include <geos_c.h>
+#include <ogr_geometry.h>
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace {
+
+    // GDAL uses this number of segments per quadrant in Buffer().
+    constexpr const int buffer_quadrant_segments = 30;
+
+    class GEOSContext {
+
+        GEOSContextHandle_t m_handle;
+
+    public:
+
+        GEOSContext() :
+            m_handle(OGRGeometry::createGEOSContext()) {
+        }
+
+        GEOSContext(const GEOSContext&) = delete;
+        GEOSContext& operator=(const GEOSContext&) = delete;
+
+        GEOSContext(GEOSContext&&) = delete;
+        GEOSContext& operator=(GEOSContext&&) = delete;
+
+        ~GEOSContext() noexcept {
+            OGRGeometry::freeGEOSContext(m_handle);
+        }
+
+        GEOSContextHandle_t get() const noexcept {
+            return m_handle;
+        }
+
+    }; // class GEOSContext
+
+    class GEOSGeometryPtr {
+
+        GEOSContextHandle_t m_context;
+        GEOSGeometry* m_geometry;
+
+    public:
+
+        GEOSGeometryPtr(GEOSContextHandle_t context, GEOSGeometry* geometry) noexcept :
+            m_context(context),
+            m_geometry(geometry) {
+        }
+
+        GEOSGeometryPtr(const GEOSGeometryPtr&) = delete;
+        GEOSGeometryPtr& operator=(const GEOSGeometryPtr&) = delete;
+
+        GEOSGeometryPtr(GEOSGeometryPtr&&) = delete;
+        GEOSGeometryPtr& operator=(GEOSGeometryPtr&&) = delete;
+
+        ~GEOSGeometryPtr() noexcept {
+            if (m_geometry) {
+                GEOSGeom_destroy_r(m_context, m_geometry);
+            }
+        }
+
+        GEOSGeometry* get() const noexcept {
+            return m_geometry;
+        }
+
+    }; // class GEOSGeometryPtr
+
+    bool is_valid(const GEOSContext& context, const GEOSGeometryPtr& geometry) {
+        return geometry.get() && GEOSisValid_r(context.get(), geometry.get()) == 1;
+    }
+
+    GEOSGeometry* create_ring(const GEOSContext& context, const Polygon& polygon, std::size_t ring) {
+        const auto size = static_cast<unsigned int>(polygon.ring_size(ring));
+        GEOSCoordSequence* sequence = GEOSCoordSeq_create_r(context.get(), size, 2);
+        if (!sequence) {
+            return nullptr;
+        }
+        const auto begin = polygon.ring_begin(ring);
+        for (unsigned int n = 0; n < size; ++n) {
+            GEOSCoordSeq_setX_r(context.get(), sequence, n, polygon.x(begin + n));
+            GEOSCoordSeq_setY_r(context.get(), sequence, n, polygon.y(begin + n));
+        }
+
+        // The ring takes ownership of the sequence.
+        return GEOSGeom_createLinearRing_r(context.get(), sequence);
+    }
+
+    GEOSGeometry* create_geos_polygon(const GEOSContext& context, const Polygon& polygon) {
+        if (polygon.num_rings() == 0) {
+            return nullptr;
+        }
+
+        std::vector<GEOSGeometry*> rings;
+        rings.reserve(polygon.num_rings());
+        for (std::size_t ring = 0; ring < polygon.num_rings(); ++ring) {
+            GEOSGeometry* geos_ring = create_ring(context, polygon, ring);
+            if (!geos_ring) {
+                for (auto* r : rings) {
+                    GEOSGeom_destroy_r(context.get(), r);
+                }
+                return nullptr;
+            }
+            rings.push_back(geos_ring);
+        }
+
+        // The polygon takes ownership of the rings.
+        return GEOSGeom_createPolygon_r(context.get(), rings[0], rings.data() + 1, static_cast<unsigned int>(rings.size() - 1));
+    }
+
+    bool add_geos_ring(const GEOSContext& context, const GEOSGeometry* ring, Polygon& polygon) {
+        const GEOSCoordSequence* sequence = GEOSGeom_getCoordSeq_r(context.get(), ring);
+        unsigned int size = 0;
+        if (!sequence || !GEOSCoordSeq_getSize_r(context.get(), sequence, &size)) {
+            return false;
+        }
+        for (unsigned int n = 0; n < size; ++n) {
+            double x = 0.0;
+            double y = 0.0;
+            GEOSCoordSeq_getX_r(context.get(), sequence, n, &x);
+            GEOSCoordSeq_getY_r(context.get(), sequence, n, &y);
+            polygon.add_point(x, y);
+        }
+        polygon.finish_ring();
+        return true;
+    }
+
+    // Convert a GEOS geometry into a polygon. Fails if the geometry is not
+    // a (non-empty) polygon.
+    bool convert_geos_polygon(const GEOSContext& context, const GEOSGeometry* geometry, Polygon& polygon) {
+        if (GEOSGeomTypeId_r(context.get(), geometry) != GEOS_POLYGON ||
+            GEOSisEmpty_r(context.get(), geometry)) {
+            return false;
+        }
+
+        if (!add_geos_ring(context, GEOSGetExteriorRing_r(context.get(), geometry), polygon)) {
+            return false;
+        }
+        const int num_interior_rings = GEOSGetNumInteriorRings_r(context.get(), geometry);
+        for (int i = 0; i < num_interior_rings; ++i) {
+            if (!add_geos_ring(context, GEOSGetInteriorRingN_r(context.get(), geometry, i), polygon)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    validation_result validate_polygon(const GEOSContext& context, const Polygon& polygon, bool repair) {
+        validation_result result;
+
+        const GEOSGeometryPtr geometry{context.get(), create_geos_polygon(context, polygon)};
+        result.valid = is_valid(context, geometry);
+        if (result.valid || !repair || !geometry.get()) {
+            return result;
+        }
+
+        const GEOSGeometryPtr buffered{context.get(), GEOSBuffer_r(context.get(), geometry.get(), 0.0, buffer_quadrant_segments)};
+        if (!buffered.get()) {
+            return result;
+        }
+
+        result.repaired = convert_geos_polygon(context, buffered.get(), result.repaired_polygon);
+        if (result.repaired) {
+            result.repaired_valid = is_valid(context, buffered);
+        } else {
+            result.repaired_polygon = Polygon{};
+        }
+
+        return result;
+    }
+
+} // anonymous namespace
+
+std::vector<validation_result> validate_polygons(const polygon_vector_type& polygons, bool repair, int num_threads, const std::vector<bool>& known_valid) {
+    assert(known_valid.empty() || known_valid.size() == polygons.size());
+    std::vector<validation_result> results(polygons.size());
+
+    std::unique_ptr<osmium::thread::Pool> pool;
+    if (num_threads > 1 && polygons.size() > 1) {
+        pool.reset(new osmium::thread::Pool{num_threads});
+    }
+
+    const std::size_t num_workers = pool ? static_cast<std::size_t>(pool->num_threads()) : 1;
+    std::atomic<std::size_t> next{0};
+    run_tasks(pool.get(), num_workers, [&](std::size_t /*worker*/) {
+        const GEOSContext context;
+        for (std::size_t n = next++; n < polygons.size(); n = next++) {
+            if (!known_valid.empty() && known_valid[n]) {
+                results[n].valid = true;
+            } else {
+                results[n] = validate_polygon(context, polygons[n], repair);
+            }
+        }
+    });
+
+    return results;
+}
@@ -0,0 +1,67 @@
+#ifndef POLYGON_VALIDATION_HPP
+#define POLYGON_VALIDATION_HPP
+
+/*
+
+  Copyright 2012-2021 Jochen Topf <jochen@topf.org>.
+
+  This file is part of OSMCoastline.
+
+  OSMCoastline is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  OSMCoastline is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with OSMCoastline.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include "polygon.hpp"
+
+#include <vector>
+
+/**
+ * The result of checking one polygon with validate_polygons().
+ */
+struct validation_result {
+
+    /// Is the polygon valid?
+    bool valid = false;
+
+    /**
+     * The polygon is invalid, a repair was asked for and Buffer(0) on it
+     * resulted in a single polygon.
+     */
+    bool repaired = false;
+
+    /// Is the repaired polygon valid?
+    bool repaired_valid = false;
+
+    /// The repaired polygon.
+    Polygon repaired_polygon;
+
+}; // struct validation_result
+
+/**
+ * Check the polygons for validity like OGRGeometry::IsValid() does. If
+ * repair is set, invalid polygons are also repaired like with Buffer(0).
+ * The polygons are handed to GEOS directly without creating OGR geometries.
+ *
+ * The checks are done on num_threads threads, each with its own GEOS
+ * context. The polygons are handed out to the threads one by one, so a
+ * few huge polygons don't hold up the others. The results are returned
+ * in the same order as the polygons.
+ *
+ * If known_valid is not empty, it must have one entry for each polygon.
+ * Polygons for which it is true are not checked, they are reported as
+ * valid.
+ */
+std::vector<validation_result> validate_polygons(const polygon_vector_type& polygons, bool repair, int num_threads, const std::vector<bool>& known_valid = std::vector<bool>{});
+
+#endif // POLYGON_VALIDATION_HPP
@@ -0,0 +1,211 @@
+/*
+
+  Copyright 2012-2021 Jochen Topf <jochen@topf.org>.
+
+  This file is part of OSMCoastline.
+
+  OSMCoastline is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  OSMCoastline is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with OSMCoastline.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include "segment_batch.hpp"
+
+#include <osmium/osm/location.hpp>
+
+#include <cmath>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+# define OSMCOASTLINE_USE_AVX2
+# include <immintrin.h>
+#endif
+
+constexpr const std::size_t SegmentBatch::max_size;
+
+namespace {
+
+    // Relative error bound for the orientation calculated in double
+    // precision. The coordinate differences are exact, so there are only
+    // three rounding errors: two multiplications and the subtraction.
+    constexpr const double error_bound = 3.3306690738754716e-16;
+
+    /**
+     * The coordinates of the query segment.
+     */
+    struct query_segment {
+        int32_t cx;
+        int32_t cy;
+        int32_t dx;
+        int32_t dy;
+
+        explicit query_segment(const osmium::UndirectedSegment& s) noexcept :
+            cx(s.first().x()),
+            cy(s.first().y()),
+            dx(s.second().x()),
+            dy(s.second().y()) {
+        }
+    };
+
+    // Orientation of r relative to the line from p to q. Returns 1 or -1
+    // if the sign is certain, 0 otherwise.
+    int certain_orientation(double px, double py, double qx, double qy, double rx, double ry) noexcept {
+        const double left = (qx - px) * (ry - py);
+        const double right = (qy - py) * (rx - px);
+        const double det = left - right;
+        const double bound = error_bound * (std::abs(left) + std::abs(right));
+        return (det > bound) - (det < -bound);
+    }
+
+    bool test_scalar(int32_t ax, int32_t ay, int32_t bx, int32_t by, const query_segment& q) noexcept {
+        const bool ac = ax == q.cx && ay == q.cy;
+        const bool ad = ax == q.dx && ay == q.dy;
+        const bool bc = bx == q.cx && by == q.cy;
+        const bool bd = bx == q.dx && by == q.dy;
+
+        if (ac && bd) {
+            return true; // same segment
+        }
+        if (ac || ad || bc || bd) {
+            return false;
+        }
+
+        // The segments can not intersect if the end points of one of them
+        // are certainly on the same side of the other segment.
+        const int o1 = certain_orientation(ax, ay, bx, by, q.cx, q.cy);
+        const int o2 = certain_orientation(ax, ay, bx, by, q.dx, q.dy);
+        if (o1 * o2 > 0) {
+            return false;
+        }
+
+        const int o3 = certain_orientation(q.cx, q.cy, q.dx, q.dy, ax, ay);
+        const int o4 = certain_orientation(q.cx, q.cy, q.dx, q.dy, bx, by);
+        return o3 * o4 <= 0;
+    }
+
+#ifdef OSMCOASTLINE_USE_AVX2
+
+    // Returns a mask of the lanes where the points r are certainly on the
+    // same side of the line from p to q as the points s.
+    __attribute__((target("avx2")))
+    __m256d certain_same_side(__m256d px, __m256d py, __m256d qx, __m256d qy,
+                              __m256d rx, __m256d ry, __m256d sx, __m256d sy) noexcept {
+        const __m256d abs_mask = _mm256_castsi256_pd(_mm256_set1_epi64x(0x7fffffffffffffffLL));
+        const __m256d eps = _mm256_set1_pd(error_bound);
+
+        const __m256d dx = _mm256_sub_pd(qx, px);
+        const __m256d dy = _mm256_sub_pd(qy, py);
+
+        const __m256d left1 = _mm256_mul_pd(dx, _mm256_sub_pd(ry, py));
+        const __m256d right1 = _mm256_mul_pd(dy, _mm256_sub_pd(rx, px));
+        const __m256d det1 = _mm256_sub_pd(left1, right1);
+        const __m256d bound1 = _mm256_mul_pd(eps, _mm256_add_pd(_mm256_and_pd(left1, abs_mask),
+                                                                _mm256_and_pd(right1, abs_mask)));
+
+        const __m256d left2 = _mm256_mul_pd(dx, _mm256_sub_pd(sy, py));
+        const __m256d right2 = _mm256_mul_pd(dy, _mm256_sub_pd(sx, px));
+        const __m256d det2 = _mm256_sub_pd(left2, right2);
+        const __m256d bound2 = _mm256_mul_pd(eps, _mm256_add_pd(_mm256_and_pd(left2, abs_mask),
+                                                                _mm256_and_pd(right2, abs_mask)));
+
+        const __m256d neg_bound1 = _mm256_sub_pd(_mm256_setzero_pd(), bound1);
+        const __m256d neg_bound2 = _mm256_sub_pd(_mm256_setzero_pd(), bound2);
+
+        const __m256d both_left = _mm256_and_pd(_mm256_cmp_pd(det1, bound1, _CMP_GT_OQ),
+                                                _mm256_cmp_pd(det2, bound2, _CMP_GT_OQ));
+        const __m256d both_right = _mm256_and_pd(_mm256_cmp_pd(det1, neg_bound1, _CMP_LT_OQ),
+                                                 _mm256_cmp_pd(det2, neg_bound2, _CMP_LT_OQ));
+
+        return _mm256_or_pd(both_left, both_right);
+    }
+
+    // Test four candidates at once. Returns a bit mask of the possible
+    // hits. This must come to the same result as test_scalar().
+    __attribute__((target("avx2")))
+    unsigned int test_avx2(const int32_t* x1, const int32_t* y1, const int32_t* x2, const int32_t* y2, const query_segment& q) noexcept {
+        const __m128i ax = _mm_loadu_si128(reinterpret_cast<const __m128i*>(x1));
+        const __m128i ay = _mm_loadu_si128(reinterpret_cast<const __m128i*>(y1));
+        const __m128i bx = _mm_loadu_si128(reinterpret_cast<const __m128i*>(x2));
+        const __m128i by = _mm_loadu_si128(reinterpret_cast<const __m128i*>(y2));
+
+        const __m128i cx = _mm_set1_epi32(q.cx);
+        const __m128i cy = _mm_set1_epi32(q.cy);
+        const __m128i dx = _mm_set1_epi32(q.dx);
+        const __m128i dy = _mm_set1_epi32(q.dy);
+
+        const __m128i ac = _mm_and_si128(_mm_cmpeq_epi32(ax, cx), _mm_cmpeq_epi32(ay, cy));
+        const __m128i ad = _mm_and_si128(_mm_cmpeq_epi32(ax, dx), _mm_cmpeq_epi32(ay, dy));
+        const __m128i bc = _mm_and_si128(_mm_cmpeq_epi32(bx, cx), _mm_cmpeq_epi32(by, cy));
+        const __m128i bd = _mm_and_si128(_mm_cmpeq_epi32(bx, dx), _mm_cmpeq_epi32(by, dy));
+
+        const auto same = static_cast<unsigned int>(_mm_movemask_ps(_mm_castsi128_ps(_mm_and_si128(ac, bd))));
+        const auto shared = static_cast<unsigned int>(_mm_movemask_ps(_mm_castsi128_ps(
+                                _mm_or_si128(_mm_or_si128(ac, ad), _mm_or_si128(bc, bd)))));
+
+        if (shared == 0xfU) {
+            return same;
+        }
+
+        // Converting the int32 coordinates to double is exact and so are
+        // the differences between them.
+        const __m256d dax = _mm256_cvtepi32_pd(ax);
+        const __m256d day = _mm256_cvtepi32_pd(ay);
+        const __m256d dbx = _mm256_cvtepi32_pd(bx);
+        const __m256d dby = _mm256_cvtepi32_pd(by);
+        const __m256d dcx = _mm256_set1_pd(q.cx);
+        const __m256d dcy = _mm256_set1_pd(q.cy);
+        const __m256d ddx = _mm256_set1_pd(q.dx);
+        const __m256d ddy = _mm256_set1_pd(q.dy);
+
+        const __m256d separated = _mm256_or_pd(certain_same_side(dax, day, dbx, dby, dcx, dcy, ddx, ddy),
+                                               certain_same_side(dcx, dcy, ddx, ddy, dax, day, dbx, dby));
+
+        const auto possible = ~static_cast<unsigned int>(_mm256_movemask_pd(separated)) & 0xfU;
+
+        return same | (possible & ~shared & 0xfU);
+    }
+
+    bool has_avx2() noexcept {
+        static const bool result = __builtin_cpu_supports("avx2") != 0;
+        return result;
+    }
+
+#endif
+
+} // anonymous namespace
+
+std::size_t SegmentBatch::test(const osmium::UndirectedSegment& query, uint32_t* hits) const noexcept {
+    const query_segment q{query};
+    std::size_t count = 0;
+    std::size_t n = 0;
+
+#ifdef OSMCOASTLINE_USE_AVX2
+    if (has_avx2()) {
+        for (; n + 4 <= m_size; n += 4) {
+            unsigned int mask = test_avx2(m_x1 + n, m_y1 + n, m_x2 + n, m_y2 + n, q);
+            while (mask != 0) {
+                const auto bit = static_cast<uint32_t>(__builtin_ctz(mask));
+                hits[count++] = static_cast<uint32_t>(n) + bit;
+                mask &= mask - 1;
+            }
+        }
+    }
+#endif
+
+    for (; n < m_size; ++n) {
+        if (test_scalar(m_x1[n], m_y1[n], m_x2[n], m_y2[n], q)) {
+            hits[count++] = static_cast<uint32_t>(n);
+        }
+    }
+
+    return count;
+}
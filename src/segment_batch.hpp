@@ -0,0 +1,108 @@
+#ifndef SEGMENT_BATCH_HPP
+#define SEGMENT_BATCH_HPP
+
+/*
+
+  Copyright 2012-2021 Jochen Topf <jochen@topf.org>.
+
+  This file is part of OSMCoastline.
+
+  OSMCoastline is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  OSMCoastline is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with OSMCoastline.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include <osmium/osm/location.hpp>
+#include <osmium/osm/undirected_segment.hpp>
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * A batch of candidate segments that are tested against one query segment
+ * all at once. The coordinates of the candidates are stored as a structure
+ * of arrays, so the test can use SIMD instructions if the CPU has them.
+ *
+ * The test is a fast filter using orientation tests in double precision
+ * with error bounds. It finds all candidates that are the same as the
+ * query segment or that might intersect with it. Only for those the (more
+ * expensive) exact check of the pair has to be done.
+ */
+class SegmentBatch {
+
+public:
+
+    static constexpr const std::size_t max_size = 64;
+
+private:
+
+    int32_t m_x1[max_size];
+    int32_t m_y1[max_size];
+    int32_t m_x2[max_size];
+    int32_t m_y2[max_size];
+    std::size_t m_index[max_size];
+    std::size_t m_size = 0;
+
+public:
+
+    std::size_t size() const noexcept {
+        return m_size;
+    }
+
+    bool empty() const noexcept {
+        return m_size == 0;
+    }
+
+    bool full() const noexcept {
+        return m_size == max_size;
+    }
+
+    void clear() noexcept {
+        m_size = 0;
+    }
+
+    /// The index of the candidate segment at position n in the batch.
+    std::size_t index(std::size_t n) const noexcept {
+        return m_index[n];
+    }
+
+    /// The candidate segment at position n in the batch.
+    osmium::UndirectedSegment segment(std::size_t n) const noexcept {
+        return osmium::UndirectedSegment{osmium::Location{m_x1[n], m_y1[n]},
+                                         osmium::Location{m_x2[n], m_y2[n]}};
+    }
+
+    /**
+     * Add a candidate segment with the given index in the segment vector
+     * to the batch. The batch must not be full.
+     */
+    void add(std::size_t index, const osmium::UndirectedSegment& segment) noexcept {
+        m_x1[m_size] = segment.first().x();
+        m_y1[m_size] = segment.first().y();
+        m_x2[m_size] = segment.second().x();
+        m_y2[m_size] = segment.second().y();
+        m_index[m_size] = index;
+        ++m_size;
+    }
+
+    /**
+     * Test all candidates in the batch against the query segment. The
+     * positions of the candidates that are the same as the query segment
+     * or might intersect with it are written to hits (which must have
+     * room for size() entries). Returns the number of hits.
+     */
+    std::size_t test(const osmium::UndirectedSegment& query, uint32_t* hits) const noexcept;
+
+}; // class SegmentBatch
+
+#endif // SEGMENT_BATCH_HPP
@@ -0,0 +1,266 @@
+/*
+
+  Copyright 2012-2021 Jochen Topf <jochen@topf.org>.
+
+  This file is part of OSMCoastline.
+
+  OSMCoastline is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  OSMCoastline is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with OSMCoastline.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include "segment_diff.hpp"
+
+#include <osmium/osm/location.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+
+    // Segments longer than this in x direction (0.1 degree) are kept in
+    // a separate list, so they don't widen the x range that has to be
+    // searched for every changed segment.
+    constexpr const int32_t max_short_extent = 1000000;
+
+    // Computed in 64 bit, because segments spanning more than about 214
+    // degrees (from broken data) would overflow in 32 bit.
+    int64_t x_extent(const osmium::UndirectedSegment& segment) noexcept {
+        return static_cast<int64_t>(segment.second().x()) - segment.first().x();
+    }
+
+    bool y_overlap(const osmium::UndirectedSegment& s1, const osmium::UndirectedSegment& s2) noexcept {
+        const auto range1 = std::minmax(s1.first().y(), s1.second().y());
+        const auto range2 = std::minmax(s2.first().y(), s2.second().y());
+        return range1.first <= range2.second && range2.first <= range1.second;
+    }
+
+    /**
+     * Mark all segments whose number of copies in the previous file is
+     * different as changed. Returns the number of changed segments.
+     */
+    std::size_t mark_changed(const std::vector<osmium::UndirectedSegment>& segments,
+                             SegmentFileReader& previous,
+                             std::vector<bool>& changed) {
+        std::size_t num_changed = 0;
+
+        bool has_previous = previous.next();
+        osmium::UndirectedSegment last{osmium::Location{}, osmium::Location{}};
+        const auto advance = [&]() {
+            last = previous.current().segment;
+            has_previous = previous.next();
+            if (has_previous && previous.current().segment < last) {
+                throw std::runtime_error{"Previous segments file is not sorted"};
+            }
+        };
+
+        std::size_t n = 0;
+        while (n < segments.size()) {
+            const auto& segment = segments[n];
+            std::size_t end = n + 1;
+            while (end < segments.size() && segments[end] == segment) {
+                ++end;
+            }
+
+            while (has_previous && previous.current().segment < segment) {
+                advance();
+            }
+
+            std::size_t count = 0;
+            while (has_previous && previous.current().segment == segment) {
+                ++count;
+                advance();
+            }
+
+            if (count != end - n) {
+                std::fill(changed.begin() + static_cast<std::ptrdiff_t>(n), changed.begin() + static_cast<std::ptrdiff_t>(end), true);
+                num_changed += end - n;
+            }
+
+            n = end;
+        }
+
+        // The findings come after all segments.
+        while (has_previous) {
+            advance();
+        }
+
+        return num_changed;
+    }
+
+    /**
+     * The copies of a segment in the sorted segments: index of the first
+     * copy and number of copies.
+     */
+    struct copies {
+        std::size_t first;
+        std::size_t count;
+    };
+
+    /**
+     * Find the copies of the segment. Returns zero copies if the segment
+     * is not in the segments or if it changed.
+     */
+    copies unchanged_copies(const std::vector<osmium::UndirectedSegment>& segments,
+                            const std::vector<bool>& changed,
+                            const osmium::UndirectedSegment& segment) {
+        const auto range = std::equal_range(segments.cbegin(), segments.cend(), segment);
+        const auto first = static_cast<std::size_t>(std::distance(segments.cbegin(), range.first));
+        if (range.first == range.second || changed[first]) {
+            return {0, 0};
+        }
+        return {first, static_cast<std::size_t>(std::distance(range.first, range.second))};
+    }
+
+} // anonymous namespace
+
+bool find_intersections_incremental(const std::vector<osmium::UndirectedSegment>& segments,
+                                    SegmentFileReader& previous,
+                                    std::vector<segment_finding>& findings,
+                                    std::size_t& num_changed) {
+    if (!previous.has_findings()) {
+        return false;
+    }
+
+    std::vector<bool> changed(segments.size());
+    num_changed = mark_changed(segments, previous, changed);
+
+    std::vector<segment_finding> result;
+
+    // Findings between unchanged segments are still valid, but the
+    // indexes of the segments have to be found again. If there are several
+    // copies of a segment, the findings for all copies are the same and
+    // they are in the order of the copies in the file.
+    std::map<std::pair<osmium::UndirectedSegment, osmium::UndirectedSegment>, std::size_t> seen;
+    while (previous.next_finding()) {
+        const finding_record& finding = previous.current_finding();
+        const copies copies1 = unchanged_copies(segments, changed, finding.segment1);
+        const copies copies2 = unchanged_copies(segments, changed, finding.segment2);
+        if (copies1.count == 0 || copies2.count == 0) {
+            continue;
+        }
+
+        const segment_finding::kind type = finding.overlap ? segment_finding::kind::overlap : segment_finding::kind::intersection;
+        if (copies1.count == 1 && copies2.count == 1) {
+            result.push_back(segment_finding{copies1.first, copies2.first, type, finding.location, finding.segment1, finding.segment2});
+            continue;
+        }
+
+        // Overlaps between the copies of one segment are added below.
+        if (finding.segment1 == finding.segment2) {
+            continue;
+        }
+
+        const std::size_t n = seen[std::make_pair(finding.segment1, finding.segment2)]++;
+        result.push_back(segment_finding{copies1.first + n / copies2.count, copies2.first + n % copies2.count,
+                                         type, finding.location, finding.segment1, finding.segment2});
+    }
+
+    // All copies of an unchanged segment overlap each other.
+    for (std::size_t n = 0; n < segments.size();) {
+        std::size_t end = n + 1;
+        while (end < segments.size() && segments[end] == segments[n]) {
+            ++end;
+        }
+        if (!changed[n]) {
+            for (std::size_t i = n; i < end; ++i) {
+                for (std::size_t j = i + 1; j < end; ++j) {
+                    check_segment_pair(i, segments[i], j, segments[j], result);
+                }
+            }
+        }
+        n = end;
+    }
+
+    int64_t max_extent = 0;
+    std::vector<std::size_t> long_segments;
+    for (std::size_t n = 0; n < segments.size(); ++n) {
+        const int64_t extent = x_extent(segments[n]);
+        if (extent > max_short_extent) {
+            long_segments.push_back(n);
+        } else if (extent > max_extent) {
+            max_extent = extent;
+        }
+    }
+
+    // Each changed segment is checked against all segments whose bounding
+    // box overlaps with it. Pairs of two changed segments are only checked
+    // once from the segment with the larger index.
+    SegmentBatch batch;
+    uint32_t hits[SegmentBatch::max_size];
+    for (std::size_t index = 0; index < segments.size(); ++index) {
+        if (!changed[index]) {
+            continue;
+        }
+        const osmium::UndirectedSegment& segment = segments[index];
+
+        const auto check_batch = [&]() {
+            const std::size_t num_hits = batch.test(segment, hits);
+            for (std::size_t h = 0; h < num_hits; ++h) {
+                const std::size_t other = batch.index(hits[h]);
+                if (other < index) {
+                    check_segment_pair(other, batch.segment(hits[h]), index, segment, result);
+                } else {
+                    check_segment_pair(index, segment, other, batch.segment(hits[h]), result);
+                }
+            }
+            batch.clear();
+        };
+
+        const auto add_candidate = [&](std::size_t other) {
+            if (other == index || (changed[other] && other > index)) {
+                return;
+            }
+            const osmium::UndirectedSegment& other_segment = segments[other];
+            if (other_segment.second().x() < segment.first().x() ||
+                other_segment.first().x() > segment.second().x() ||
+                !y_overlap(segment, other_segment)) {
+                return;
+            }
+            batch.add(other, other_segment);
+            if (batch.full()) {
+                check_batch();
+            }
+        };
+
+        const auto begin = std::lower_bound(segments.cbegin(), segments.cend(),
+                                            static_cast<int64_t>(segment.first().x()) - max_extent,
+                                            [](const osmium::UndirectedSegment& s, int64_t x) {
+            return s.first().x() < x;
+        });
+        const auto end = std::upper_bound(begin, segments.cend(), segment.second().x(),
+                                          [](int32_t x, const osmium::UndirectedSegment& s) {
+            return x < s.first().x();
+        });
+
+        for (auto it = begin; it != end; ++it) {
+            if (x_extent(*it) <= max_short_extent) {
+                add_candidate(static_cast<std::size_t>(std::distance(segments.cbegin(), it)));
+            }
+        }
+        for (const auto other : long_segments) {
+            add_candidate(other);
+        }
+        if (!batch.empty()) {
+            check_batch();
+        }
+    }
+
+    std::sort(result.begin(), result.end());
+    findings = std::move(result);
+
+    return true;
+}
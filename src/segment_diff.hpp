@@ -0,0 +1,54 @@
+#ifndef SEGMENT_DIFF_HPP
+#define SEGMENT_DIFF_HPP
+
+/*
+
+  Copyright 2012-2021 Jochen Topf <jochen@topf.org>.
+
+  This file is part of OSMCoastline.
+
+  OSMCoastline is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  OSMCoastline is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with OSMCoastline.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include "segment_file.hpp"
+#include "segment_intersections.hpp"
+
+#include <osmium/osm/undirected_segment.hpp>
+
+#include <cstddef>
+#include <vector>
+
+/**
+ * Find all intersections and overlaps between the segments using the
+ * findings of an earlier run stored in the segments file read by the
+ * previous reader. The segments must be sorted.
+ *
+ * The segments are compared with the segments in the file. Findings
+ * between segments that didn't change are taken over from the file, only
+ * the changed segments (those whose number of copies is different in
+ * the file) are checked against all segments. Candidates for those
+ * checks are found by binary search on the x coordinate.
+ *
+ * The result is the same as from find_intersections(). Returns false
+ * (without reading anything from the file) if the file doesn't contain
+ * findings. Otherwise the number of changed segments is stored in
+ * num_changed.
+ */
+bool find_intersections_incremental(const std::vector<osmium::UndirectedSegment>& segments,
+                                    SegmentFileReader& previous,
+                                    std::vector<segment_finding>& findings,
+                                    std::size_t& num_changed);
+
+#endif // SEGMENT_DIFF_HPP
@@ -0,0 +1,430 @@
+/*
+
+  Copyright 2012-2021 Jochen Topf <jochen@topf.org>.
+
+  This file is part of OSMCoastline.
+
+  OSMCoastline is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  OSMCoastline is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with OSMCoastline.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include "segment_file.hpp"
+
+#include <protozero/varint.hpp>
+
+#include <zlib.h>
+
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#ifndef _MSC_VER
+# include <unistd.h>
+#else
+# include <io.h>
+#endif
+
+constexpr const std::size_t SegmentFileWriter::block_size;
+
+namespace {
+
+    constexpr const char magic[] = "OSMCSEGS";
+    constexpr const std::size_t magic_size = sizeof(magic) - 1;
+
+    // Size of the header of each block: three 32 bit integers.
+    constexpr const std::size_t block_header_size = 3 * sizeof(uint32_t);
+
+    // Number of segments read at once from a version 1 file.
+    constexpr const std::size_t v1_block_size = 64 * 1024;
+
+    // Upper bounds for the size of a segment and of a finding in a block:
+    // up to six or eleven varints with up to ten bytes each.
+    constexpr const std::size_t max_segment_size = 6 * 10;
+    constexpr const std::size_t max_finding_size = 11 * 10;
+
+    void append_uint32(std::string& data, uint32_t value) {
+        for (unsigned int n = 0; n < 4; ++n) {
+            data.push_back(static_cast<char>((value >> (n * 8U)) & 0xffU));
+        }
+    }
+
+    uint32_t get_uint32(const char* data) noexcept {
+        uint32_t value = 0;
+        for (unsigned int n = 0; n < 4; ++n) {
+            value |= static_cast<uint32_t>(static_cast<unsigned char>(data[n])) << (n * 8U);
+        }
+        return value;
+    }
+
+    // Differences are calculated with wrap around, so they can't overflow.
+    void append_delta(std::string& data, int64_t value, int64_t previous) {
+        const auto delta = static_cast<int64_t>(static_cast<uint64_t>(value) - static_cast<uint64_t>(previous));
+        protozero::add_varint_to_buffer(&data, protozero::encode_zigzag64(delta));
+    }
+
+    int64_t decode_delta(const char** data, const char* end, int64_t previous) {
+        const int64_t delta = protozero::decode_zigzag64(protozero::decode_varint(data, end));
+        return static_cast<int64_t>(static_cast<uint64_t>(previous) + static_cast<uint64_t>(delta));
+    }
+
+    void append_location(std::string& data, const osmium::Location& location, const osmium::Location& previous) {
+        append_delta(data, location.x(), previous.x());
+        append_delta(data, location.y(), previous.y());
+    }
+
+    osmium::Location decode_location(const char** data, const char* end, const osmium::Location& previous) {
+        const int64_t x = decode_delta(data, end, previous.x());
+        const int64_t y = decode_delta(data, end, previous.y());
+        return osmium::Location{static_cast<int32_t>(x), static_cast<int32_t>(y)};
+    }
+
+} // anonymous namespace
+
+SegmentFileWriter::SegmentFileWriter(int fd, uint32_t flags) :
+    m_fd(fd),
+    m_flags(flags) {
+    if (m_fd < 0) {
+        return;
+    }
+
+    m_buffer.reserve(block_size);
+
+    std::string header{magic, magic_size};
+    append_uint32(header, segment_file::version);
+    append_uint32(header, m_flags);
+    write(header.data(), header.size());
+}
+
+void SegmentFileWriter::write(const void* data, std::size_t length) {
+#ifndef _MSC_VER
+    if (::write(m_fd, data, length) != static_cast<ssize_t>(length)) {
+#else
+    if (_write(m_fd, data, static_cast<unsigned int>(length)) != static_cast<int>(length)) {
+#endif
+        throw std::runtime_error{"Write error"};
+    }
+}
+
+void SegmentFileWriter::write_block(std::size_t count) {
+    std::string header;
+    append_uint32(header, static_cast<uint32_t>(count));
+
+    // An empty block (the end marker) has no data.
+    if (count == 0) {
+        append_uint32(header, 0);
+        append_uint32(header, 0);
+        write(header.data(), header.size());
+        return;
+    }
+
+    uLongf compressed_size = compressBound(static_cast<uLong>(m_data.size()));
+    std::string compressed(compressed_size, '\0');
+    const int result = compress2(reinterpret_cast<Bytef*>(&compressed[0]), &compressed_size,
+                                 reinterpret_cast<const Bytef*>(m_data.data()), static_cast<uLong>(m_data.size()),
+                                 Z_DEFAULT_COMPRESSION);
+    if (result != Z_OK) {
+        throw std::runtime_error{"Compressing segments failed"};
+    }
+
+    append_uint32(header, static_cast<uint32_t>(m_data.size()));
+    append_uint32(header, static_cast<uint32_t>(compressed_size));
+    write(header.data(), header.size());
+    write(compressed.data(), compressed_size);
+}
+
+void SegmentFileWriter::flush() {
+    if (m_fd < 0 || m_buffer.empty()) {
+        return;
+    }
+
+    m_data.clear();
+    osmium::Location previous{0, 0};
+    segment_ids ids;
+    for (const auto& record : m_buffer) {
+        append_location(m_data, record.segment.first(), previous);
+        append_location(m_data, record.segment.second(), record.segment.first());
+        previous = record.segment.first();
+        if (m_flags & segment_file::has_ring_ids) {
+            append_delta(m_data, record.ids.ring_id, ids.ring_id);
+        }
+        if (m_flags & segment_file::has_way_ids) {
+            append_delta(m_data, record.ids.way_id, ids.way_id);
+        }
+        ids = record.ids;
+    }
+
+    write_block(m_buffer.size());
+    m_buffer.clear();
+}
+
+void SegmentFileWriter::finish_segments() {
+    if (m_segments_done) {
+        return;
+    }
+
+    flush();
+    write_block(0);
+    m_segments_done = true;
+}
+
+void SegmentFileWriter::flush_findings() {
+    if (m_findings.empty()) {
+        return;
+    }
+
+    m_data.clear();
+    osmium::Location previous{0, 0};
+    for (const auto& finding : m_findings) {
+        const osmium::Location& first = finding.segment1.first();
+        protozero::add_varint_to_buffer(&m_data, finding.overlap ? 1 : 0);
+        append_location(m_data, first, previous);
+        append_location(m_data, finding.segment1.second(), first);
+        append_location(m_data, finding.segment2.first(), first);
+        append_location(m_data, finding.segment2.second(), first);
+        if (!finding.overlap) {
+            append_location(m_data, finding.location, first);
+        }
+        previous = first;
+    }
+
+    write_block(m_findings.size());
+    m_findings.clear();
+}
+
+void SegmentFileWriter::close() {
+    if (m_fd < 0) {
+        return;
+    }
+
+    finish_segments();
+
+    if (m_flags & segment_file::has_findings) {
+        flush_findings();
+        write_block(0);
+    }
+
+    m_fd = -1;
+}
+
+SegmentFileReader::SegmentFileReader(int fd) :
+    m_fd(fd) {
+    char header[magic_size + 2 * sizeof(uint32_t)];
+    const std::size_t size = read(header, magic_size);
+
+    if (size == magic_size && std::memcmp(header, magic, magic_size) == 0) {
+        if (read(header + magic_size, 2 * sizeof(uint32_t)) != 2 * sizeof(uint32_t)) {
+            throw std::runtime_error{"Segment file header is truncated"};
+        }
+        m_version = get_uint32(header + magic_size);
+        m_flags = get_uint32(header + magic_size + sizeof(uint32_t));
+        if (m_version != segment_file::version) {
+            throw std::runtime_error{"Unsupported segment file version " + std::to_string(m_version)};
+        }
+        return;
+    }
+
+    // No header: This is a version 1 file and the bytes read are already
+    // part of the first segment.
+    m_data.assign(header, size);
+}
+
+std::size_t SegmentFileReader::read(char* data, std::size_t length) {
+    std::size_t done = 0;
+    while (done < length) {
+#ifndef _MSC_VER
+        const auto result = ::read(m_fd, data + done, length - done);
+#else
+        const auto result = _read(m_fd, data + done, static_cast<unsigned int>(length - done));
+#endif
+        if (result < 0) {
+            throw std::runtime_error{"Read error"};
+        }
+        if (result == 0) {
+            break;
+        }
+        done += static_cast<std::size_t>(result);
+    }
+    return done;
+}
+
+void SegmentFileReader::read_block_v1() {
+    const std::size_t prefix = m_data.size();
+    m_data.resize(v1_block_size * sizeof(osmium::UndirectedSegment));
+    const std::size_t size = prefix + read(&m_data[prefix], m_data.size() - prefix);
+
+    if (size % sizeof(osmium::UndirectedSegment) != 0) {
+        throw std::runtime_error{"Segment file has wrong size"};
+    }
+    if (size < m_data.size()) {
+        m_eof = true;
+    }
+
+    const std::size_t count = size / sizeof(osmium::UndirectedSegment);
+    m_records.resize(count);
+    for (std::size_t n = 0; n < count; ++n) {
+        std::memcpy(&m_records[n].segment, m_data.data() + n * sizeof(osmium::UndirectedSegment), sizeof(osmium::UndirectedSegment));
+    }
+    m_data.clear();
+}
+
+uint32_t SegmentFileReader::read_block(std::size_t max_record_size) {
+    char header[block_header_size];
+    if (read(header, block_header_size) != block_header_size) {
+        throw std::runtime_error{"Segment file is truncated"};
+    }
+
+    const uint32_t count = get_uint32(header);
+    const uint32_t raw_size = get_uint32(header + sizeof(uint32_t));
+    const uint32_t compressed_size = get_uint32(header + 2 * sizeof(uint32_t));
+
+    if (count == 0) {
+        return 0;
+    }
+
+    if (raw_size > count * max_record_size) {
+        throw std::runtime_error{"Segment file is corrupt"};
+    }
+
+    m_compressed.resize(compressed_size);
+    if (read(&m_compressed[0], compressed_size) != compressed_size) {
+        throw std::runtime_error{"Segment file is truncated"};
+    }
+
+    m_data.resize(raw_size);
+    uLongf size = raw_size;
+    const int result = uncompress(reinterpret_cast<Bytef*>(&m_data[0]), &size,
+                                  reinterpret_cast<const Bytef*>(m_compressed.data()), compressed_size);
+    if (result != Z_OK || size != raw_size) {
+        throw std::runtime_error{"Uncompressing segments failed"};
+    }
+
+    return count;
+}
+
+void SegmentFileReader::read_block_v2() {
+    const uint32_t count = read_block(max_segment_size);
+    if (count == 0) {
+        m_eof = true;
+        return;
+    }
+
+    const char* data = m_data.data();
+    const char* const end = data + m_data.size();
+    m_records.resize(count);
+
+    try {
+        osmium::Location previous{0, 0};
+        segment_ids ids;
+        for (auto& record : m_records) {
+            const osmium::Location first = decode_location(&data, end, previous);
+            const osmium::Location second = decode_location(&data, end, first);
+            if (has_ring_ids()) {
+                ids.ring_id = decode_delta(&data, end, ids.ring_id);
+            }
+            if (has_way_ids()) {
+                ids.way_id = decode_delta(&data, end, ids.way_id);
+            }
+            record.segment = osmium::UndirectedSegment{first, second};
+            record.ids = ids;
+            previous = first;
+        }
+    } catch (const protozero::exception&) {
+        throw std::runtime_error{"Segment file is corrupt"};
+    }
+
+    if (data != end) {
+        throw std::runtime_error{"Segment file is corrupt"};
+    }
+}
+
+void SegmentFileReader::read_findings_block() {
+    const uint32_t count = read_block(max_finding_size);
+    if (count == 0) {
+        m_findings_eof = true;
+        return;
+    }
+
+    const char* data = m_data.data();
+    const char* const end = data + m_data.size();
+    m_findings.resize(count);
+
+    try {
+        osmium::Location previous{0, 0};
+        for (auto& finding : m_findings) {
+            finding.overlap = protozero::decode_varint(&data, end) != 0;
+            const osmium::Location first = decode_location(&data, end, previous);
+            finding.segment1 = osmium::UndirectedSegment{first, decode_location(&data, end, first)};
+            const osmium::Location first2 = decode_location(&data, end, first);
+            finding.segment2 = osmium::UndirectedSegment{first2, decode_location(&data, end, first)};
+            finding.location = finding.overlap ? osmium::Location{} : decode_location(&data, end, first);
+            previous = first;
+        }
+    } catch (const protozero::exception&) {
+        throw std::runtime_error{"Segment file is corrupt"};
+    }
+
+    if (data != end) {
+        throw std::runtime_error{"Segment file is corrupt"};
+    }
+}
+
+bool SegmentFileReader::next() {
+    if (m_pos < m_records.size()) {
+        ++m_pos;
+        return true;
+    }
+
+    m_records.clear();
+    m_pos = 0;
+    if (m_eof) {
+        return false;
+    }
+
+    if (m_version == 1) {
+        read_block_v1();
+    } else {
+        read_block_v2();
+    }
+
+    if (m_records.empty()) {
+        m_eof = true;
+        return false;
+    }
+
+    m_pos = 1;
+    return true;
+}
+
+bool SegmentFileReader::next_finding() {
+    if (m_findings_pos < m_findings.size()) {
+        ++m_findings_pos;
+        return true;
+    }
+
+    m_findings.clear();
+    m_findings_pos = 0;
+    if (!m_eof || !has_findings() || m_findings_eof) {
+        return false;
+    }
+
+    read_findings_block();
+
+    if (m_findings.empty()) {
+        m_findings_eof = true;
+        return false;
+    }
+
+    m_findings_pos = 1;
+    return true;
+}
@@ -0,0 +1,287 @@
+#ifndef SEGMENT_FILE_HPP
+#define SEGMENT_FILE_HPP
+
+/*
+
+  Copyright 2012-2021 Jochen Topf <jochen@topf.org>.
+
+  This file is part of OSMCoastline.
+
+  OSMCoastline is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  OSMCoastline is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with OSMCoastline.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include <osmium/osm/location.hpp>
+#include <osmium/osm/types.hpp>
+#include <osmium/osm/undirected_segment.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * The segments file (see the --write-segments option) contains all
+ * segments of the coastline sorted in the order of UndirectedSegment.
+ *
+ * Version 1 of the format is a raw dump of the UndirectedSegment structs
+ * without any header.
+ *
+ * Version 2 starts with a header: the magic "OSMCSEGS", the version and
+ * a set of flags, each as little endian 32 bit unsigned integer. Then come
+ * blocks of segments. Each block starts with the number of segments in it,
+ * the size of the uncompressed and the size of the zlib-compressed data
+ * (again as 32 bit integers) followed by the compressed data. A block with
+ * zero segments marks the end of the segments.
+ *
+ * Inside a block each segment is stored as zigzag-encoded varints: the
+ * first location as difference to the first location of the previous
+ * segment, the second location as difference to the first location. If
+ * the flags say so, the ring ID and way ID follow, again as differences
+ * to those of the previous segment.
+ *
+ * If the has_findings flag is set, the intersections and overlaps found
+ * between the segments follow in the same kind of blocks, again ending
+ * with an empty block. Each finding is stored as its type, the first
+ * segment (encoded like above), the second segment and, for intersections,
+ * the location of the intersection. The locations of the second segment
+ * and of the intersection are differences to the first location of the
+ * first segment.
+ */
+namespace segment_file {
+
+    constexpr const uint32_t version = 2;
+
+    enum flags : uint32_t {
+        has_ring_ids = 1U,
+        has_way_ids  = 2U,
+        has_findings = 4U
+    };
+
+} // namespace segment_file
+
+/**
+ * IDs of the ring and way a segment belongs to. The ring ID is the
+ * smallest way ID in the ring. Both are 0 if unknown.
+ */
+struct segment_ids {
+    osmium::object_id_type ring_id = 0;
+    osmium::object_id_type way_id = 0;
+
+    segment_ids() noexcept = default;
+
+    segment_ids(osmium::object_id_type ring, osmium::object_id_type way) noexcept :
+        ring_id(ring),
+        way_id(way) {
+    }
+};
+
+/**
+ * A segment as read from a segments file.
+ */
+struct segment_record {
+    osmium::UndirectedSegment segment;
+    segment_ids ids;
+
+    segment_record() noexcept :
+        segment(osmium::Location{}, osmium::Location{}) {
+    }
+
+    segment_record(const osmium::UndirectedSegment& s, const segment_ids& i) noexcept :
+        segment(s),
+        ids(i) {
+    }
+};
+
+/**
+ * An intersection or overlap between two segments as stored in a segments
+ * file.
+ */
+struct finding_record {
+    osmium::UndirectedSegment segment1;
+    osmium::UndirectedSegment segment2;
+
+    /// Location of the intersection (undefined for overlaps).
+    osmium::Location location;
+
+    bool overlap = false;
+
+    finding_record() noexcept :
+        segment1(osmium::Location{}, osmium::Location{}),
+        segment2(osmium::Location{}, osmium::Location{}) {
+    }
+
+    finding_record(const osmium::UndirectedSegment& s1, const osmium::UndirectedSegment& s2, const osmium::Location& l, bool o) noexcept :
+        segment1(s1),
+        segment2(s2),
+        location(l),
+        overlap(o) {
+    }
+};
+
+/**
+ * Writes segments to the segments file in the version 2 format. Segments
+ * must be added in sorted order. They are buffered and written out in
+ * compressed blocks. If the has_findings flag is set, the findings are
+ * added after all segments.
+ */
+class SegmentFileWriter {
+
+    std::vector<segment_record> m_buffer;
+    std::vector<finding_record> m_findings;
+    std::string m_data;
+    int m_fd;
+    uint32_t m_flags;
+    bool m_segments_done = false;
+
+    static constexpr const std::size_t block_size = 64 * 1024;
+
+    void write(const void* data, std::size_t length);
+
+    void write_block(std::size_t count);
+
+    void finish_segments();
+
+    void flush_findings();
+
+public:
+
+    /**
+     * Write to the file descriptor fd. If fd is -1 nothing is written.
+     * The flags (see segment_file::flags) decide which IDs are written.
+     */
+    SegmentFileWriter(int fd, uint32_t flags);
+
+    SegmentFileWriter(const SegmentFileWriter&) = delete;
+    SegmentFileWriter& operator=(const SegmentFileWriter&) = delete;
+
+    SegmentFileWriter(SegmentFileWriter&&) = delete;
+    SegmentFileWriter& operator=(SegmentFileWriter&&) = delete;
+
+    ~SegmentFileWriter() noexcept = default;
+
+    /// Add a single segment.
+    void add(const osmium::UndirectedSegment& segment, const segment_ids& ids = segment_ids{}) {
+        if (m_fd < 0) {
+            return;
+        }
+        m_buffer.push_back(segment_record{segment, ids});
+        if (m_buffer.size() == block_size) {
+            flush();
+        }
+    }
+
+    /// Write out all buffered segments as a block.
+    void flush();
+
+    /**
+     * Add a finding. This ends the segments, no segments can be added
+     * after the first finding.
+     */
+    void add_finding(const finding_record& finding) {
+        if (m_fd < 0) {
+            return;
+        }
+        finish_segments();
+        m_findings.push_back(finding);
+        if (m_findings.size() == block_size) {
+            flush_findings();
+        }
+    }
+
+    /**
+     * Write out everything still buffered and the end markers. Nothing
+     * can be added after this.
+     */
+    void close();
+
+}; // class SegmentFileWriter
+
+/**
+ * Reads segments from a segments file in version 1 or 2 format. The
+ * segments are read one after the other, so the file doesn't have to fit
+ * into memory.
+ */
+class SegmentFileReader {
+
+    std::vector<segment_record> m_records;
+    std::vector<finding_record> m_findings;
+    std::string m_compressed;
+    std::string m_data;
+    std::size_t m_pos = 0;
+    std::size_t m_findings_pos = 0;
+    int m_fd;
+    uint32_t m_version = 1;
+    uint32_t m_flags = 0;
+    bool m_eof = false;
+    bool m_findings_eof = false;
+
+    std::size_t read(char* data, std::size_t length);
+
+    uint32_t read_block(std::size_t max_record_size);
+
+    void read_block_v1();
+
+    void read_block_v2();
+
+    void read_findings_block();
+
+public:
+
+    /// Read from the file descriptor fd.
+    explicit SegmentFileReader(int fd);
+
+    /// The version of the file format.
+    uint32_t version() const noexcept {
+        return m_version;
+    }
+
+    bool has_ring_ids() const noexcept {
+        return (m_flags & segment_file::has_ring_ids) != 0;
+    }
+
+    bool has_way_ids() const noexcept {
+        return (m_flags & segment_file::has_way_ids) != 0;
+    }
+
+    bool has_findings() const noexcept {
+        return (m_flags & segment_file::has_findings) != 0;
+    }
+
+    /**
+     * Move on to the next segment. Returns false at the end of the file.
+     * Call this once before accessing the first segment.
+     */
+    bool next();
+
+    /// The current segment. IDs not in the file are 0.
+    const segment_record& current() const noexcept {
+        return m_records[m_pos - 1];
+    }
+
+    /**
+     * Move on to the next finding. Returns false at the end of the file
+     * or if the file doesn't contain findings. This can only be called
+     * after next() has returned false.
+     */
+    bool next_finding();
+
+    /// The current finding.
+    const finding_record& current_finding() const noexcept {
+        return m_findings[m_findings_pos - 1];
+    }
+
+}; // class SegmentFileReader
+
+#endif // SEGMENT_FILE_HPP
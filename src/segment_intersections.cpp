@@ -0,0 +1,348 @@
+/*
+
+  Copyright 2012-2021 Jochen Topf <jochen@topf.org>.
+
+  This file is part of OSMCoastline.
+
+  OSMCoastline is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  OSMCoastline is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with OSMCoastline.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include "segment_intersections.hpp"
+
+#include <osmium/thread/pool.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <functional>
+#include <future>
+
+constexpr const int32_t ActiveSegments::none;
+
+namespace {
+
+#ifdef __SIZEOF_INT128__
+
+    __extension__ using int128_type = __int128;
+
+    int sign_of_product_difference(int64_t a, int64_t b, int64_t c, int64_t d) noexcept {
+        const int128_type ab = static_cast<int128_type>(a) * b;
+        const int128_type cd = static_cast<int128_type>(c) * d;
+        return (ab > cd) - (ab < cd);
+    }
+
+#else
+
+    // Full 128 bit product of two unsigned 64 bit numbers.
+    std::pair<uint64_t, uint64_t> multiply(uint64_t a, uint64_t b) noexcept {
+        const uint64_t a_lo = a & 0xffffffffU;
+        const uint64_t a_hi = a >> 32U;
+        const uint64_t b_lo = b & 0xffffffffU;
+        const uint64_t b_hi = b >> 32U;
+
+        const uint64_t lo_lo = a_lo * b_lo;
+        const uint64_t hi_lo = a_hi * b_lo;
+        const uint64_t lo_hi = a_lo * b_hi;
+        const uint64_t hi_hi = a_hi * b_hi;
+
+        const uint64_t middle = (lo_lo >> 32U) + (hi_lo & 0xffffffffU) + lo_hi;
+
+        return {hi_hi + (hi_lo >> 32U) + (middle >> 32U),
+                (middle << 32U) | (lo_lo & 0xffffffffU)};
+    }
+
+    int sign(int64_t a) noexcept {
+        return (a > 0) - (a < 0);
+    }
+
+    uint64_t magnitude(int64_t a) noexcept {
+        return a < 0 ? static_cast<uint64_t>(-a) : static_cast<uint64_t>(a);
+    }
+
+    int sign_of_product_difference(int64_t a, int64_t b, int64_t c, int64_t d) noexcept {
+        const int sign_ab = sign(a) * sign(b);
+        const int sign_cd = sign(c) * sign(d);
+        if (sign_ab != sign_cd) {
+            return sign_ab > sign_cd ? 1 : -1;
+        }
+        const auto ab = multiply(magnitude(a), magnitude(b));
+        const auto cd = multiply(magnitude(c), magnitude(d));
+        return sign_ab * ((ab > cd) - (ab < cd));
+    }
+
+#endif
+
+    // The value of the orientation, this is only approximate.
+    double orientation_value(const osmium::Location& p, const osmium::Location& q, const osmium::Location& r) noexcept {
+        return static_cast<double>(int64_t(q.x()) - p.x()) * static_cast<double>(int64_t(r.y()) - p.y()) -
+               static_cast<double>(int64_t(q.y()) - p.y()) * static_cast<double>(int64_t(r.x()) - p.x());
+    }
+
+} // anonymous namespace
+
+int orientation(const osmium::Location& p, const osmium::Location& q, const osmium::Location& r) noexcept {
+    return sign_of_product_difference(int64_t(q.x()) - p.x(), int64_t(r.y()) - p.y(),
+                                      int64_t(q.y()) - p.y(), int64_t(r.x()) - p.x());
+}
+
+osmium::Location intersection(const osmium::Segment& s1, const osmium::Segment&s2) {
+    if (s1.first()  == s2.first()  ||
+        s1.first()  == s2.second() ||
+        s1.second() == s2.first()  ||
+        s1.second() == s2.second()) {
+        return osmium::Location{};
+    }
+
+    // The segments intersect if the end points of each segment are on
+    // different sides of the other segment (or on it), unless they are
+    // all on one line.
+    const int o1 = orientation(s1.first(), s1.second(), s2.first());
+    const int o2 = orientation(s1.first(), s1.second(), s2.second());
+    if (o1 * o2 > 0) {
+        return osmium::Location{};
+    }
+
+    const int o3 = orientation(s2.first(), s2.second(), s1.first());
+    const int o4 = orientation(s2.first(), s2.second(), s1.second());
+    if (o3 * o4 > 0 || (o3 == 0 && o4 == 0)) {
+        return osmium::Location{};
+    }
+
+    // Only now that we know there is an intersection, calculate where it
+    // is. This doesn't have to be exact.
+    const double v3 = orientation_value(s2.first(), s2.second(), s1.first());
+    const double v4 = orientation_value(s2.first(), s2.second(), s1.second());
+    double ua = (v3 == v4) ? 0.0 : v3 / (v3 - v4);
+    if (ua < 0.0) {
+        ua = 0.0;
+    } else if (ua > 1.0) {
+        ua = 1.0;
+    }
+
+    const double ix = s1.first().x() + ua * (static_cast<double>(s1.second().x()) - s1.first().x());
+    const double iy = s1.first().y() + ua * (static_cast<double>(s1.second().y()) - s1.first().y());
+
+    return osmium::Location{static_cast<int32_t>(std::lround(ix)),
+                            static_cast<int32_t>(std::lround(iy))};
+}
+
+void ActiveSegments::update(int32_t n) noexcept {
+    node& x = m_nodes[n];
+    x.max_yhi = x.yhi;
+    if (x.left != none && m_nodes[x.left].max_yhi > x.max_yhi) {
+        x.max_yhi = m_nodes[x.left].max_yhi;
+    }
+    if (x.right != none && m_nodes[x.right].max_yhi > x.max_yhi) {
+        x.max_yhi = m_nodes[x.right].max_yhi;
+    }
+}
+
+int32_t ActiveSegments::merge(int32_t a, int32_t b) noexcept {
+    if (a == none) {
+        return b;
+    }
+    if (b == none) {
+        return a;
+    }
+    if (m_nodes[a].priority > m_nodes[b].priority) {
+        m_nodes[a].right = merge(m_nodes[a].right, b);
+        update(a);
+        return a;
+    }
+    m_nodes[b].left = merge(a, m_nodes[b].left);
+    update(b);
+    return b;
+}
+
+void ActiveSegments::split(int32_t t, int32_t key, int32_t& a, int32_t& b) noexcept {
+    if (t == none) {
+        a = none;
+        b = none;
+        return;
+    }
+    if (less(t, key)) {
+        split(m_nodes[t].right, key, m_nodes[t].right, b);
+        a = t;
+    } else {
+        split(m_nodes[t].left, key, a, m_nodes[t].left);
+        b = t;
+    }
+    update(t);
+}
+
+int32_t ActiveSegments::erase(int32_t t, int32_t key) noexcept {
+    assert(t != none);
+    if (t == key) {
+        return merge(m_nodes[t].left, m_nodes[t].right);
+    }
+    if (less(key, t)) {
+        m_nodes[t].left = erase(m_nodes[t].left, key);
+    } else {
+        m_nodes[t].right = erase(m_nodes[t].right, key);
+    }
+    update(t);
+    return t;
+}
+
+void ActiveSegments::expire(int32_t x) noexcept {
+    while (!m_expiry.empty() && m_expiry.front().first < x) {
+        const int32_t n = m_expiry.front().second;
+        std::pop_heap(m_expiry.begin(), m_expiry.end(), std::greater<std::pair<int32_t, int32_t>>{});
+        m_expiry.pop_back();
+        m_root = erase(m_root, n);
+        m_free_nodes.push_back(n);
+    }
+}
+
+void ActiveSegments::insert(std::size_t index, const osmium::UndirectedSegment& segment) {
+    const int32_t y1 = segment.first().y();
+    const int32_t y2 = segment.second().y();
+
+    int32_t n = 0;
+    if (m_free_nodes.empty()) {
+        n = static_cast<int32_t>(m_nodes.size());
+        m_nodes.push_back(node{0, 0, 0, 0, 0, none, none, segment});
+    } else {
+        n = m_free_nodes.back();
+        m_free_nodes.pop_back();
+    }
+
+    const int32_t ylo = y1 < y2 ? y1 : y2;
+    const int32_t yhi = y1 < y2 ? y2 : y1;
+    m_nodes[n] = node{ylo, yhi, yhi, next_random(), index, none, none, segment};
+
+    int32_t a = none;
+    int32_t b = none;
+    split(m_root, n, a, b);
+    m_root = merge(merge(a, n), b);
+
+    // The segments are normalized so that the second point is the one
+    // with the larger x coordinate.
+    m_expiry.emplace_back(segment.second().x(), n);
+    std::push_heap(m_expiry.begin(), m_expiry.end(), std::greater<std::pair<int32_t, int32_t>>{});
+}
+
+void check_segment_pair(std::size_t first, const osmium::UndirectedSegment& s1, std::size_t second, const osmium::UndirectedSegment& s2, std::vector<segment_finding>& findings) {
+    if (s1 == s2) {
+        findings.push_back(segment_finding{first, second, segment_finding::kind::overlap, osmium::Location{}, s1, s2});
+        return;
+    }
+
+    const osmium::Location i = intersection(s1, s2);
+    if (i) {
+        findings.push_back(segment_finding{first, second, segment_finding::kind::intersection, i, s1, s2});
+    }
+}
+
+void IntersectionSweep::check_batch(std::size_t index, const osmium::UndirectedSegment& segment) {
+    uint32_t hits[SegmentBatch::max_size];
+    const std::size_t num_hits = m_batch.test(segment, hits);
+    for (std::size_t h = 0; h < num_hits; ++h) {
+        check_segment_pair(m_batch.index(hits[h]), m_batch.segment(hits[h]), index, segment, m_findings);
+    }
+    m_batch.clear();
+}
+
+void IntersectionSweep::add(std::size_t index, const osmium::UndirectedSegment& segment) {
+    m_active.expire(segment.first().x());
+    m_active.for_each_overlapping(segment, [&](std::size_t other, const osmium::UndirectedSegment& other_segment) {
+        m_batch.add(other, other_segment);
+        if (m_batch.full()) {
+            check_batch(index, segment);
+        }
+    });
+    if (!m_batch.empty()) {
+        check_batch(index, segment);
+    }
+    m_active.insert(index, segment);
+}
+
+namespace {
+
+    /**
+     * Find intersections between the segments with index in [begin, end)
+     * and all segments before them. The segments before begin that could
+     * intersect with those segments must be in the crossing vector in
+     * order.
+     */
+    std::vector<segment_finding> find_intersections_in_slab(const std::vector<osmium::UndirectedSegment>& segments, const std::vector<std::size_t>& crossing, std::size_t begin, std::size_t end) {
+        IntersectionSweep sweep;
+
+        for (const auto n : crossing) {
+            sweep.add_crossing(n, segments[n]);
+        }
+
+        for (std::size_t n = begin; n < end; ++n) {
+            sweep.add(n, segments[n]);
+        }
+
+        return std::move(sweep.findings());
+    }
+
+} // anonymous namespace
+
+std::vector<segment_finding> find_intersections(const std::vector<osmium::UndirectedSegment>& segments, int num_threads) {
+    const std::size_t num_slabs = num_threads > 1 ? static_cast<std::size_t>(num_threads) * 4 : 1;
+
+    if (num_slabs == 1 || segments.size() < num_slabs * 1024) {
+        auto findings = find_intersections_in_slab(segments, {}, 0, segments.size());
+        std::sort(findings.begin(), findings.end());
+        return findings;
+    }
+
+    // Split the segments into vertical slabs with the same number of
+    // segments each. Each segment belongs to the slab where it starts.
+    std::vector<std::size_t> slab_begin;
+    std::vector<int32_t> slab_x;
+    for (std::size_t slab = 0; slab < num_slabs; ++slab) {
+        slab_begin.push_back(segments.size() * slab / num_slabs);
+        slab_x.push_back(segments[slab_begin.back()].first().x());
+    }
+    slab_begin.push_back(segments.size());
+
+    // Segments reaching into later slabs are replicated into those slabs.
+    // They are only added to the active set there, so each pair of
+    // segments is only checked in the slab of the segment starting later.
+    std::vector<std::vector<std::size_t>> crossing(num_slabs);
+    for (std::size_t slab = 0; slab < num_slabs - 1; ++slab) {
+        for (std::size_t n = slab_begin[slab]; n < slab_begin[slab + 1]; ++n) {
+            const int32_t x = segments[n].second().x();
+            for (std::size_t other = slab + 1; other < num_slabs && slab_x[other] <= x; ++other) {
+                crossing[other].push_back(n);
+            }
+        }
+    }
+
+    osmium::thread::Pool pool{num_threads};
+    std::vector<std::future<std::vector<segment_finding>>> results;
+    for (std::size_t slab = 0; slab < num_slabs; ++slab) {
+        const auto begin = slab_begin[slab];
+        const auto end = slab_begin[slab + 1];
+        const auto* slab_crossing = &crossing[slab];
+        results.push_back(pool.submit([&segments, slab_crossing, begin, end]() {
+            return find_intersections_in_slab(segments, *slab_crossing, begin, end);
+        }));
+    }
+
+    std::vector<segment_finding> findings;
+    for (auto& result : results) {
+        const auto slab_findings = result.get();
+        findings.insert(findings.end(), slab_findings.begin(), slab_findings.end());
+    }
+
+    std::sort(findings.begin(), findings.end());
+
+    return findings;
+}
@@ -0,0 +1,253 @@
+#ifndef SEGMENT_INTERSECTIONS_HPP
+#define SEGMENT_INTERSECTIONS_HPP
+
+/*
+
+  Copyright 2012-2021 Jochen Topf <jochen@topf.org>.
+
+  This file is part of OSMCoastline.
+
+  OSMCoastline is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  OSMCoastline is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with OSMCoastline.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include "segment_batch.hpp"
+
+#include <osmium/osm/location.hpp>
+#include <osmium/osm/segment.hpp>
+#include <osmium/osm/undirected_segment.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+/**
+ * Something found when checking two segments against each other.
+ */
+struct segment_finding {
+
+    enum class kind : uint8_t {
+        intersection = 0,
+        overlap      = 1
+    };
+
+    /// Index of the first segment (in the sorted vector of segments).
+    std::size_t first;
+
+    /// Index of the second segment, always larger than first.
+    std::size_t second;
+
+    kind type;
+
+    /// Location of the intersection (undefined for overlaps).
+    osmium::Location location;
+
+    /// The first segment, needed to report overlaps.
+    osmium::UndirectedSegment segment;
+
+    /// The second segment.
+    osmium::UndirectedSegment second_segment;
+
+    friend bool operator<(const segment_finding& lhs, const segment_finding& rhs) noexcept {
+        return std::make_pair(lhs.first, lhs.second) < std::make_pair(rhs.first, rhs.second);
+    }
+
+}; // struct segment_finding
+
+/**
+ * The orientation of the point r relative to the line from p to q: 1 if
+ * it is to the left (counterclockwise), -1 if it is to the right, 0 if it
+ * is on the line. This is calculated exactly on the fixed point coordinates.
+ */
+int orientation(const osmium::Location& p, const osmium::Location& q, const osmium::Location& r) noexcept;
+
+/**
+ * Calculate the intersection between two segments. Returns an undefined
+ * location if they don't intersect, if they share an end point or if they
+ * are on the same line.
+ *
+ * Whether the segments intersect is decided exactly using the orientation()
+ * function, so the result doesn't depend on floating point rounding.
+ */
+osmium::Location intersection(const osmium::Segment& s1, const osmium::Segment& s2);
+
+/**
+ * The set of segments currently crossed by the sweep line.
+ *
+ * The segments are kept in a treap (a randomized balanced binary search
+ * tree) ordered by the lower end of their y range. Every node also knows
+ * the largest upper end of the y ranges in its subtree, so all segments
+ * overlapping some y range can be found without looking at segments
+ * outside that range (an interval tree). A heap ordered by the largest x
+ * coordinate of the segments is used to remove segments once the sweep
+ * line has moved past them.
+ */
+class ActiveSegments {
+
+    static constexpr const int32_t none = -1;
+
+    struct node {
+        int32_t ylo;
+        int32_t yhi;
+        int32_t max_yhi;
+        uint32_t priority;
+        std::size_t index;
+        int32_t left;
+        int32_t right;
+        osmium::UndirectedSegment segment;
+    };
+
+    std::vector<node> m_nodes;
+    std::vector<int32_t> m_free_nodes;
+    int32_t m_root = none;
+
+    // Min-heap of (max x coordinate, node id) of all active segments.
+    std::vector<std::pair<int32_t, int32_t>> m_expiry;
+
+    // State of the random number generator for the node priorities. A
+    // fixed seed makes sure the results don't depend on the run.
+    uint32_t m_random = 2463534242U;
+
+    uint32_t next_random() noexcept {
+        m_random ^= m_random << 13U;
+        m_random ^= m_random >> 17U;
+        m_random ^= m_random << 5U;
+        return m_random;
+    }
+
+    bool less(int32_t a, int32_t b) const noexcept {
+        return std::make_pair(m_nodes[a].ylo, m_nodes[a].index) <
+               std::make_pair(m_nodes[b].ylo, m_nodes[b].index);
+    }
+
+    void update(int32_t n) noexcept;
+
+    int32_t merge(int32_t a, int32_t b) noexcept;
+
+    void split(int32_t t, int32_t key, int32_t& a, int32_t& b) noexcept;
+
+    int32_t erase(int32_t t, int32_t key) noexcept;
+
+    template <typename TFunc>
+    void query(int32_t t, int32_t ylo, int32_t yhi, TFunc&& func) const {
+        while (t != none && m_nodes[t].max_yhi >= ylo) {
+            const node& n = m_nodes[t];
+            query(n.left, ylo, yhi, func);
+            if (n.ylo > yhi) {
+                return;
+            }
+            if (n.yhi >= ylo) {
+                func(n.index, n.segment);
+            }
+            t = n.right;
+        }
+    }
+
+public:
+
+    /// The number of segments in the active set.
+    std::size_t size() const noexcept {
+        return m_nodes.size() - m_free_nodes.size();
+    }
+
+    /**
+     * Remove all segments that end before the sweep line position x.
+     */
+    void expire(int32_t x) noexcept;
+
+    /**
+     * Add the segment with the given index (in the sorted order of all
+     * segments) to the active set.
+     */
+    void insert(std::size_t index, const osmium::UndirectedSegment& segment);
+
+    /**
+     * Call func(index, segment) for all active segments whose y range
+     * overlaps the y range of the segment.
+     */
+    template <typename TFunc>
+    void for_each_overlapping(const osmium::UndirectedSegment& segment, TFunc&& func) const {
+        const int32_t y1 = segment.first().y();
+        const int32_t y2 = segment.second().y();
+        query(m_root, y1 < y2 ? y1 : y2, y1 < y2 ? y2 : y1, std::forward<TFunc>(func));
+    }
+
+}; // class ActiveSegments
+
+/**
+ * Check two segments with overlapping bounding boxes. If they are the same
+ * or intersect, a finding is added to the findings vector.
+ */
+void check_segment_pair(std::size_t first, const osmium::UndirectedSegment& s1, std::size_t second, const osmium::UndirectedSegment& s2, std::vector<segment_finding>& findings);
+
+/**
+ * A sweep line moving from west to east over segments which are added one
+ * by one in sorted order. Each segment is checked against all earlier
+ * segments whose bounding boxes overlap with it.
+ */
+class IntersectionSweep {
+
+    ActiveSegments m_active;
+
+    // Candidates are collected in a batch and tested all at once, only
+    // the hits are checked in detail.
+    SegmentBatch m_batch;
+
+    std::vector<segment_finding> m_findings;
+
+    void check_batch(std::size_t index, const osmium::UndirectedSegment& segment);
+
+public:
+
+    /**
+     * Add a segment to the active set without checking it against the
+     * other segments. This is used for segments from further west which
+     * reach into the area handled by this sweep.
+     */
+    void add_crossing(std::size_t index, const osmium::UndirectedSegment& segment) {
+        m_active.insert(index, segment);
+    }
+
+    /**
+     * Check the segment against all active segments and add it to the
+     * active set. The index is the position of the segment in the sorted
+     * order of all segments.
+     */
+    void add(std::size_t index, const osmium::UndirectedSegment& segment);
+
+    /// The findings so far (in no particular order).
+    std::vector<segment_finding>& findings() noexcept {
+        return m_findings;
+    }
+
+}; // class IntersectionSweep
+
+/**
+ * Find all intersections and overlaps between the segments. The segments
+ * must be sorted.
+ *
+ * This uses a sweep line moving from west to east over the segments. So
+ * only pairs of segments whose bounding boxes overlap are checked against
+ * each other.
+ *
+ * If more than one thread is used, the segments are split into vertical
+ * slabs with the same number of segments which are checked in parallel.
+ *
+ * The findings are returned sorted by the indexes of the segments, so
+ * the result is always the same regardless of the number of threads.
+ */
+std::vector<segment_finding> find_intersections(const std::vector<osmium::UndirectedSegment>& segments, int num_threads = 1);
+
+#endif // SEGMENT_INTERSECTIONS_HPP
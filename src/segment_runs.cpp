@@ -0,0 +1,186 @@
+/*
+
+  Copyright 2012-2021 Jochen Topf <jochen@topf.org>.
+
+  This file is part of OSMCoastline.
+
+  OSMCoastline is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  OSMCoastline is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with OSMCoastline.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include "segment_runs.hpp"
+#include "segment_sort.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <stdexcept>
+#include <system_error>
+
+namespace {
+
+    // Never use smaller buffers than this, even if the budget is tiny.
+    constexpr const std::size_t min_buffer_size = 1024;
+
+    // Never merge more runs than this at once, even if the budget is huge,
+    // so the number of open temporary files stays small.
+    constexpr const std::size_t max_merge_runs = 64;
+
+} // anonymous namespace
+
+void SegmentRuns::run::start(std::size_t buffer_size) {
+    std::rewind(m_file.get());
+    m_buffer.resize(std::min(buffer_size, m_remaining), entry{osmium::UndirectedSegment{osmium::Location{}, osmium::Location{}}, 0});
+    m_pos = m_buffer.size();
+}
+
+bool SegmentRuns::run::fill() {
+    if (m_pos < m_buffer.size()) {
+        return true;
+    }
+    if (m_remaining == 0) {
+        m_file.reset();
+        m_buffer = std::vector<entry>{};
+        return false;
+    }
+
+    const std::size_t count = std::min(m_buffer.size(), m_remaining);
+    if (std::fread(m_buffer.data(), sizeof(entry), count, m_file.get()) != count) {
+        throw std::runtime_error{"Error reading segments from temporary file"};
+    }
+    m_buffer.resize(count, m_buffer.front());
+    m_remaining -= count;
+    m_pos = 0;
+
+    return true;
+}
+
+SegmentRuns::SegmentRuns(std::size_t memory_budget, int num_threads) :
+    m_memory_budget(memory_budget),
+    // Sorting needs a second buffer of the same size.
+    m_run_size(std::max(memory_budget / (2 * (sizeof(osmium::UndirectedSegment) + sizeof(uint32_t))), min_buffer_size)),
+    // Merging while segments are added can only use the half of the budget
+    // not used by the segment buffer. Each run needs at least a minimum
+    // sized buffer then.
+    m_max_merge_runs(std::min(std::max(memory_budget / (2 * min_buffer_size * sizeof(entry)), static_cast<std::size_t>(2)), max_merge_runs)),
+    m_num_threads(num_threads) {
+    m_buffer.reserve(m_run_size);
+    m_sources.reserve(m_run_size);
+}
+
+SegmentRuns::file_ptr SegmentRuns::create_temporary_file() {
+    file_ptr file{std::tmpfile()};
+    if (!file) {
+        throw std::system_error{errno, std::system_category(), "Can't create temporary file for segments"};
+    }
+    return file;
+}
+
+void SegmentRuns::write_entries(std::FILE* file, const std::vector<entry>& entries) {
+    if (std::fwrite(entries.data(), sizeof(entry), entries.size(), file) != entries.size()) {
+        throw std::runtime_error{"Error writing segments to temporary file"};
+    }
+}
+
+void SegmentRuns::write_run() {
+    sort_segments(m_buffer, m_sources, m_num_threads);
+
+    file_ptr file = create_temporary_file();
+
+    std::vector<entry> entries;
+    entries.reserve(min_buffer_size);
+    for (std::size_t n = 0; n < m_buffer.size(); n += min_buffer_size) {
+        entries.clear();
+        for (std::size_t i = n; i < std::min(n + min_buffer_size, m_buffer.size()); ++i) {
+            entries.push_back(entry{m_buffer[i], m_sources[i]});
+        }
+        write_entries(file.get(), entries);
+    }
+
+    if (std::fflush(file.get()) != 0) {
+        throw std::runtime_error{"Error writing segments to temporary file"};
+    }
+
+    m_runs.emplace_back(std::move(file), m_buffer.size(), 0);
+    m_buffer.clear();
+    m_sources.clear();
+
+    // The runs have non-increasing levels and there are always less than
+    // m_max_merge_runs runs of each level. So if the last m_max_merge_runs
+    // runs start and end with the same level, they all have that level.
+    while (m_runs.size() >= m_max_merge_runs) {
+        const std::size_t first = m_runs.size() - m_max_merge_runs;
+        const unsigned int level = m_runs.back().level();
+        if (m_runs[first].level() != level) {
+            break;
+        }
+        combine_runs(first, level + 1);
+    }
+}
+
+void SegmentRuns::start_runs(std::size_t first, std::size_t memory_budget) {
+    const std::size_t num_runs = m_runs.size() - first;
+    const std::size_t buffer_size = std::max(memory_budget / (num_runs * sizeof(entry)), min_buffer_size);
+    for (std::size_t n = first; n < m_runs.size(); ++n) {
+        m_runs[n].start(buffer_size);
+    }
+}
+
+void SegmentRuns::combine_runs(std::size_t first, unsigned int level) {
+    file_ptr file = create_temporary_file();
+
+    // The segment buffer keeps its capacity while segments are added, so
+    // only the other half of the budget is available here.
+    start_runs(first, m_memory_budget / 2);
+
+    std::size_t size = 0;
+    std::vector<entry> entries;
+    entries.reserve(min_buffer_size);
+    merge_runs(first, [&](const entry& e) {
+        entries.push_back(e);
+        if (entries.size() == min_buffer_size) {
+            write_entries(file.get(), entries);
+            entries.clear();
+        }
+        ++size;
+    });
+    write_entries(file.get(), entries);
+
+    if (std::fflush(file.get()) != 0) {
+        throw std::runtime_error{"Error writing segments to temporary file"};
+    }
+
+    m_runs.emplace_back(std::move(file), size, level);
+}
+
+void SegmentRuns::prepare_merge() {
+    if (m_runs.empty()) {
+        sort_segments(m_buffer, m_sources, m_num_threads);
+        return;
+    }
+
+    if (!m_buffer.empty()) {
+        write_run();
+    }
+    m_buffer = std::vector<osmium::UndirectedSegment>{};
+    m_sources = std::vector<uint32_t>{};
+
+    // Merge the smallest runs at the end until few enough are left to
+    // merge them all at once.
+    while (m_runs.size() > m_max_merge_runs) {
+        const std::size_t first = m_runs.size() - std::min(m_max_merge_runs, m_runs.size() - m_max_merge_runs + 1);
+        combine_runs(first, m_runs[first].level() + 1);
+    }
+
+    start_runs(0, m_memory_budget);
+}
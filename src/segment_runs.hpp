@@ -0,0 +1,221 @@
+#ifndef SEGMENT_RUNS_HPP
+#define SEGMENT_RUNS_HPP
+
+/*
+
+  Copyright 2012-2021 Jochen Topf <jochen@topf.org>.
+
+  This file is part of OSMCoastline.
+
+  OSMCoastline is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  OSMCoastline is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with OSMCoastline.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include <osmium/osm/undirected_segment.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <queue>
+#include <utility>
+#include <vector>
+
+/**
+ * Sorts segments using a limited amount of memory.
+ *
+ * Segments are collected in memory until the budget is used up. They are
+ * then sorted and written to a temporary file as a sorted run. When all
+ * segments have been added, the runs are merged and the segments are
+ * handed to a callback in sorted order. If all segments fit into memory,
+ * no temporary files are used.
+ *
+ * Only a limited number of runs is merged at once, so that each of them
+ * gets a reasonably large read buffer within the memory budget. Whenever
+ * there are that many runs of the same level, they are merged into one
+ * run of the next level. This also keeps the number of open temporary
+ * files small for huge inputs.
+ *
+ * Each segment has a source (an arbitrary number) which is kept together
+ * with it. Segments which are the same are ordered by their source.
+ */
+class SegmentRuns {
+
+    struct file_closer {
+        void operator()(std::FILE* file) const noexcept {
+            std::fclose(file);
+        }
+    };
+
+    using file_ptr = std::unique_ptr<std::FILE, file_closer>;
+
+    /// A segment with its source as written to the temporary files.
+    struct entry {
+        osmium::UndirectedSegment segment;
+        uint32_t source;
+    };
+
+    /**
+     * A sorted run in a temporary file, read back through a buffer.
+     */
+    class run {
+
+        file_ptr m_file;
+        std::vector<entry> m_buffer;
+        std::size_t m_remaining;
+        std::size_t m_pos = 0;
+        unsigned int m_level;
+
+    public:
+
+        run(file_ptr&& file, std::size_t size, unsigned int level) :
+            m_file(std::move(file)),
+            m_remaining(size),
+            m_level(level) {
+        }
+
+        /// Runs written from memory have level 0, merged runs a higher one.
+        unsigned int level() const noexcept {
+            return m_level;
+        }
+
+        /// Rewind the file and prepare for reading with the given buffer size.
+        void start(std::size_t buffer_size);
+
+        /// Make sure the next segment is in the buffer. Returns false at the end.
+        bool fill();
+
+        const entry& current() const noexcept {
+            return m_buffer[m_pos];
+        }
+
+        void next() noexcept {
+            ++m_pos;
+        }
+
+    }; // class run
+
+    std::vector<osmium::UndirectedSegment> m_buffer;
+    std::vector<uint32_t> m_sources;
+    std::vector<run> m_runs;
+    std::size_t m_memory_budget;
+    std::size_t m_run_size;
+    std::size_t m_max_merge_runs;
+    std::size_t m_size = 0;
+    int m_num_threads;
+
+    static file_ptr create_temporary_file();
+
+    static void write_entries(std::FILE* file, const std::vector<entry>& entries);
+
+    void write_run();
+
+    /**
+     * Prepare the runs from first to the end for reading, sharing
+     * memory_budget bytes for their buffers.
+     */
+    void start_runs(std::size_t first, std::size_t memory_budget);
+
+    /**
+     * Merge the runs from first to the end into one new run with the
+     * given level.
+     */
+    void combine_runs(std::size_t first, unsigned int level);
+
+    void prepare_merge();
+
+    /**
+     * Call func(entry) for all segments in the runs from first to the end
+     * in sorted order. The runs must have been started. They are removed
+     * afterwards.
+     */
+    template <typename TFunc>
+    void merge_runs(std::size_t first, TFunc&& func) {
+        using queue_entry = std::pair<std::pair<osmium::UndirectedSegment, uint32_t>, std::size_t>;
+        std::priority_queue<queue_entry, std::vector<queue_entry>, std::greater<queue_entry>> queue;
+
+        const auto push = [&](std::size_t n) {
+            if (m_runs[n].fill()) {
+                const entry& e = m_runs[n].current();
+                queue.emplace(std::make_pair(e.segment, e.source), n);
+            }
+        };
+
+        for (std::size_t n = first; n < m_runs.size(); ++n) {
+            push(n);
+        }
+
+        while (!queue.empty()) {
+            const std::size_t n = queue.top().second;
+            std::forward<TFunc>(func)(m_runs[n].current());
+            queue.pop();
+            m_runs[n].next();
+            push(n);
+        }
+
+        m_runs.erase(m_runs.begin() + static_cast<std::ptrdiff_t>(first), m_runs.end());
+    }
+
+public:
+
+    /**
+     * Create an empty set of runs. Up to about memory_budget bytes are
+     * used to keep the segments in memory. Sorting is done on num_threads
+     * threads.
+     */
+    SegmentRuns(std::size_t memory_budget, int num_threads);
+
+    /// The number of segments added.
+    std::size_t size() const noexcept {
+        return m_size;
+    }
+
+    /// The number of runs on disk which are not merged yet.
+    std::size_t num_runs() const noexcept {
+        return m_runs.size();
+    }
+
+    void add(const osmium::UndirectedSegment& segment, uint32_t source = 0) {
+        m_buffer.push_back(segment);
+        m_sources.push_back(source);
+        ++m_size;
+        if (m_buffer.size() == m_run_size) {
+            write_run();
+        }
+    }
+
+    /**
+     * Call func(segment, source) for all segments in sorted order. This
+     * can only be called once after all segments have been added.
+     */
+    template <typename TFunc>
+    void merge(TFunc&& func) {
+        prepare_merge();
+
+        if (m_runs.empty()) {
+            for (std::size_t n = 0; n < m_buffer.size(); ++n) {
+                std::forward<TFunc>(func)(m_buffer[n], m_sources[n]);
+            }
+            return;
+        }
+
+        merge_runs(0, [&func](const entry& e) {
+            std::forward<TFunc>(func)(e.segment, e.source);
+        });
+    }
+
+}; // class SegmentRuns
+
+#endif // SEGMENT_RUNS_HPP
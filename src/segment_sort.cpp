@@ -0,0 +1,248 @@
+/*
+
+  Copyright 2012-2021 Jochen Topf <jochen@topf.org>.
+
+  This file is part of OSMCoastline.
+
+  OSMCoastline is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  OSMCoastline is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with OSMCoastline.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include "parallel.hpp"
+#include "segment_sort.hpp"
+
+#include <osmium/thread/pool.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+namespace {
+
+    // The number of high bits of the x coordinate used in the first pass.
+    constexpr const unsigned int bucket_bits = 16;
+    constexpr const std::size_t num_buckets = 1U << bucket_bits;
+
+    // Buckets smaller than this are sorted with std::sort.
+    constexpr const std::ptrdiff_t min_radix_sort_size = 256;
+
+    // The number of 8 bit digits used when sorting inside a bucket: four
+    // for the y coordinate and two for the rest of the x coordinate of the
+    // first location.
+    constexpr const unsigned int num_digits = 6;
+
+    // Map signed coordinates to unsigned ints with the same order.
+    uint32_t sort_key(int32_t value) noexcept {
+        return static_cast<uint32_t>(value) ^ 0x80000000U;
+    }
+
+    std::size_t bucket(const osmium::UndirectedSegment& segment) noexcept {
+        return sort_key(segment.first().x()) >> (32U - bucket_bits);
+    }
+
+    // Digits are numbered from the least significant one.
+    std::size_t digit(const osmium::UndirectedSegment& segment, unsigned int n) noexcept {
+        if (n < 4) {
+            return (sort_key(segment.first().y()) >> (n * 8U)) & 0xffU;
+        }
+        return (sort_key(segment.first().x()) >> ((n - 4) * 8U)) & 0xffU;
+    }
+
+    /**
+     * Pointers to segments and their sources which are always moved around
+     * together. The sources pointer is nullptr if there are no sources.
+     */
+    struct segment_array {
+        osmium::UndirectedSegment* segments;
+        uint32_t* sources;
+
+        segment_array operator+(std::ptrdiff_t offset) const noexcept {
+            return {segments + offset, sources ? sources + offset : nullptr};
+        }
+
+        void copy(std::ptrdiff_t from, const segment_array& to, std::ptrdiff_t to_index) const noexcept {
+            to.segments[to_index] = segments[from];
+            if (sources) {
+                to.sources[to_index] = sources[from];
+            }
+        }
+    };
+
+    /// Sort a small number of segments (and their sources) with std::sort.
+    void sort_small(const segment_array& data, std::ptrdiff_t size) {
+        if (!data.sources) {
+            std::sort(data.segments, data.segments + size);
+            return;
+        }
+
+        std::vector<std::pair<osmium::UndirectedSegment, uint32_t>> pairs;
+        pairs.reserve(static_cast<std::size_t>(size));
+        for (std::ptrdiff_t n = 0; n < size; ++n) {
+            pairs.emplace_back(data.segments[n], data.sources[n]);
+        }
+        std::sort(pairs.begin(), pairs.end());
+        for (std::ptrdiff_t n = 0; n < size; ++n) {
+            data.segments[n] = pairs[n].first;
+            data.sources[n] = pairs[n].second;
+        }
+    }
+
+    /**
+     * Sort the size segments in the input, which must all be in the same
+     * bucket, into out. The input is used as scratch space.
+     */
+    void sort_bucket(const segment_array& input, std::ptrdiff_t size, const segment_array& out) {
+        if (size < min_radix_sort_size) {
+            for (std::ptrdiff_t n = 0; n < size; ++n) {
+                input.copy(n, out, n);
+            }
+            sort_small(out, size);
+            return;
+        }
+
+        segment_array src = input;
+        segment_array dest = out;
+        for (unsigned int d = 0; d < num_digits; ++d) {
+            std::array<std::size_t, 256> counts{};
+            for (std::ptrdiff_t n = 0; n < size; ++n) {
+                ++counts[digit(src.segments[n], d)];
+            }
+
+            // Skip this digit if it is the same in all segments.
+            if (counts[digit(src.segments[0], d)] == static_cast<std::size_t>(size)) {
+                continue;
+            }
+
+            std::size_t offset = 0;
+            for (auto& count : counts) {
+                const auto c = count;
+                count = offset;
+                offset += c;
+            }
+
+            for (std::ptrdiff_t n = 0; n < size; ++n) {
+                src.copy(n, dest, static_cast<std::ptrdiff_t>(counts[digit(src.segments[n], d)]++));
+            }
+
+            std::swap(src, dest);
+        }
+
+        if (src.segments != out.segments) {
+            for (std::ptrdiff_t n = 0; n < size; ++n) {
+                src.copy(n, out, n);
+            }
+        }
+
+        // Segments with the same first location still have to be sorted
+        // by their second location.
+        std::ptrdiff_t run = 0;
+        while (run != size) {
+            std::ptrdiff_t run_end = run + 1;
+            while (run_end != size && out.segments[run_end].first() == out.segments[run].first()) {
+                ++run_end;
+            }
+            if (run_end - run > 1) {
+                sort_small(out + run, run_end - run);
+            }
+            run = run_end;
+        }
+    }
+
+    void sort_segment_array(std::vector<osmium::UndirectedSegment>& segments, uint32_t* sources, int num_threads) {
+        const segment_array data{segments.data(), sources};
+
+        if (segments.size() < num_buckets) {
+            sort_small(data, static_cast<std::ptrdiff_t>(segments.size()));
+            return;
+        }
+
+        std::unique_ptr<osmium::thread::Pool> pool;
+        if (num_threads > 1) {
+            pool.reset(new osmium::thread::Pool{num_threads});
+        }
+
+        // The input is split into chunks, one per thread, which are
+        // distributed into the buckets independently.
+        const std::size_t num_chunks = num_threads > 1 ? static_cast<std::size_t>(num_threads) : 1;
+        const auto chunk_begin = [&](std::size_t chunk) {
+            return segments.size() * chunk / num_chunks;
+        };
+
+        std::vector<std::vector<std::size_t>> positions(num_chunks, std::vector<std::size_t>(num_buckets));
+        run_tasks(pool.get(), num_chunks, [&](std::size_t chunk) {
+            auto& counts = positions[chunk];
+            for (std::size_t n = chunk_begin(chunk); n < chunk_begin(chunk + 1); ++n) {
+                ++counts[bucket(segments[n])];
+            }
+        });
+
+        std::vector<std::size_t> bucket_begin(num_buckets + 1);
+        std::size_t offset = 0;
+        for (std::size_t b = 0; b < num_buckets; ++b) {
+            bucket_begin[b] = offset;
+            for (auto& counts : positions) {
+                const auto count = counts[b];
+                counts[b] = offset;
+                offset += count;
+            }
+        }
+        bucket_begin[num_buckets] = offset;
+
+        std::vector<osmium::UndirectedSegment> segment_buffer(segments.size(), segments.front());
+        std::vector<uint32_t> source_buffer(sources ? segments.size() : 0);
+        const segment_array buffer{segment_buffer.data(), sources ? source_buffer.data() : nullptr};
+
+        run_tasks(pool.get(), num_chunks, [&](std::size_t chunk) {
+            auto& pos = positions[chunk];
+            for (std::size_t n = chunk_begin(chunk); n < chunk_begin(chunk + 1); ++n) {
+                const auto index = static_cast<std::ptrdiff_t>(n);
+                data.copy(index, buffer, static_cast<std::ptrdiff_t>(pos[bucket(segments[n])]++));
+            }
+        });
+
+        // Consecutive buckets are grouped into tasks of roughly the same
+        // size so the threads are kept busy even if the buckets differ a
+        // lot in size.
+        const std::size_t task_size = segments.size() / (num_chunks * 8) + 1;
+        std::vector<std::size_t> task_begin{0};
+        for (std::size_t b = 1; b < num_buckets; ++b) {
+            if (bucket_begin[b] - bucket_begin[task_begin.back()] >= task_size) {
+                task_begin.push_back(b);
+            }
+        }
+        task_begin.push_back(num_buckets);
+
+        run_tasks(pool.get(), task_begin.size() - 1, [&](std::size_t task) {
+            for (std::size_t b = task_begin[task]; b < task_begin[task + 1]; ++b) {
+                const auto begin = static_cast<std::ptrdiff_t>(bucket_begin[b]);
+                const auto size = static_cast<std::ptrdiff_t>(bucket_begin[b + 1]) - begin;
+                sort_bucket(buffer + begin, size, data + begin);
+            }
+        });
+    }
+
+} // anonymous namespace
+
+void sort_segments(std::vector<osmium::UndirectedSegment>& segments, int num_threads) {
+    sort_segment_array(segments, nullptr, num_threads);
+}
+
+void sort_segments(std::vector<osmium::UndirectedSegment>& segments, std::vector<uint32_t>& sources, int num_threads) {
+    assert(segments.size() == sources.size());
+    sort_segment_array(segments, sources.data(), num_threads);
+}
@@ -0,0 +1,51 @@
+#ifndef SEGMENT_SORT_HPP
+#define SEGMENT_SORT_HPP
+
+/*
+
+  Copyright 2012-2021 Jochen Topf <jochen@topf.org>.
+
+  This file is part of OSMCoastline.
+
+  OSMCoastline is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  OSMCoastline is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with OSMCoastline.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include <osmium/osm/undirected_segment.hpp>
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * Sort the segments into the same order as std::sort() with the operator<
+ * of osmium::UndirectedSegment would, ie. by x and y coordinate of the
+ * first location and then by x and y coordinate of the second location.
+ *
+ * This is a radix sort: In a first pass the segments are distributed into
+ * buckets by the high bits of the x coordinate of their first location.
+ * Those buckets are then sorted independently by the remaining bits of
+ * the first location. Segments with the same first location are finally
+ * sorted by their second location. The work is done on num_threads
+ * threads.
+ */
+void sort_segments(std::vector<osmium::UndirectedSegment>& segments, int num_threads);
+
+/**
+ * Sort the segments like above. The sources vector must have the same
+ * size as the segments vector, it is reordered together with the segments.
+ * Segments which are the same are ordered by their source.
+ */
+void sort_segments(std::vector<osmium::UndirectedSegment>& segments, std::vector<uint32_t>& sources, int num_threads);
+
+#endif // SEGMENT_SORT_HPP
@@ -19,11 +19,15 @@
 
 */
 
+#include "polygon.hpp"
 #include "srs.hpp"
 
 #include <ogr_core.h>
 #include <ogr_geometry.h>
 
+#include <algorithm>
+#include <vector>
+
 bool SRS::set_output(int epsg) {
     m_srs_out.importFromEPSG(epsg);
 
@@ -51,6 +55,19 @@ void SRS::transform(OGRGeometry* geometry) {
     }
 }
 
+void SRS::transform(Polygon& polygon) {
+    if (!m_transform || polygon.empty()) {
+        return;
+    }
+
+    const auto num_points = polygon.num_points();
+    std::vector<int> success(num_points);
+    if (!m_transform->Transform(static_cast<int>(num_points), polygon.x_data(), polygon.y_data(), nullptr, success.data()) ||
+        std::find(success.begin(), success.end(), FALSE) != success.end()) {
+        throw TransformationException{};
+    }
+}
+
 OGREnvelope SRS::max_extent() const {
     OGREnvelope envelope;
 
@@ -29,6 +29,7 @@
 
 class OGRGeometry;
 class OGREnvelope;
+class Polygon;
 
 class SRS {
 
@@ -87,6 +88,12 @@ public:
      */
     void transform(OGRGeometry* geometry);
 
+    /**
+     * Transform polygon, which must be in WGS84, to output SRS (if that is
+     * not WGS84).
+     */
+    void transform(Polygon& polygon);
+
     /**
      * Return max extent for output SRS.
      */
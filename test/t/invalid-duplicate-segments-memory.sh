@@ -0,0 +1,61 @@
+#!/bin/sh
+#-----------------------------------------------------------------------------
+#
+#  Correct coastline created from duplicate segments, with segments sorted
+#  in runs using limited memory.
+#
+#-----------------------------------------------------------------------------
+
+. $1/test/init.sh
+
+set -x
+
+#-----------------------------------------------------------------------------
+
+cat <<'OSM' >$INPUT
+n100 v1 x1.10 y1.06
+n101 v1 x1.30 y1.06
+n102 v1 x1.35 y1.05
+n103 v1 x1.30 y1.04
+n104 v1 x1.25 y1.04
+n105 v1 x1.20 y1.04
+n106 v1 x1.15 y1.04
+n107 v1 x1.10 y1.04
+n108 v1 x1.05 y1.05
+w200 v1 Tnatural=coastline Nn106,n105,n104
+w201 v1 Tnatural=coastline Nn106,n105,n104
+w202 v1 Tnatural=coastline Nn104,n103,n102,n101,n100,n108,n107,n106
+OSM
+
+#-----------------------------------------------------------------------------
+
+SEGMENTS1=${BIN_DIR}/test/${TEST_ID}.1.segments
+SEGMENTS2=${BIN_DIR}/test/${TEST_ID}.2.segments
+rm -f $SEGMENTS1 $SEGMENTS2
+
+$OSMC --verbose --overwrite --write-segments=$SEGMENTS1 --output-database=$DB $INPUT >$LOG 2>&1
+RC=$?
+
+test $RC -eq 1
+
+$OSMC --verbose --overwrite --segments-memory=1 --write-segments=$SEGMENTS2 --output-database=$DB $INPUT >$LOG 2>&1
+RC=$?
+set -e
+
+test $RC -eq 1
+
+cmp $SEGMENTS1 $SEGMENTS2
+
+grep '^There were 3 warnings.$' $LOG
+grep '^There were 0 errors.$' $LOG
+
+check_count land_polygons 1;
+check_count error_points 0;
+check_count error_lines 3;
+
+echo "SELECT AsText(geometry), osm_id, error FROM error_lines;" | $SQL >$DUMP
+
+grep -F 'LINESTRING(1.15 1.04, 1.2 1.04)|0|overlap' $DUMP
+grep -F 'LINESTRING(1.2 1.04, 1.25 1.04)|0|overlap' $DUMP
+
+#-----------------------------------------------------------------------------
@@ -0,0 +1,106 @@
+#!/bin/sh
+#-----------------------------------------------------------------------------
+#
+#  Self-intersection found with an incremental check against the segments
+#  file of a previous run. The result must be the same as from a full check.
+#
+#-----------------------------------------------------------------------------
+
+. $1/test/init.sh
+
+set -x
+
+#-----------------------------------------------------------------------------
+
+INPUT2=${BIN_DIR}/test/${TEST_ID}.2.opl
+
+${BIN_DIR}/src/nodegrid2opl << 'NODES' >$INPUT
+    0         8
+         4
+       5  3
+      2  6    7
+    1
+NODES
+
+cp $INPUT $INPUT2
+
+cat <<'OSM' >>$INPUT
+n300 v1 x1.50 y1.50
+n301 v1 x1.52 y1.50
+n302 v1 x1.52 y1.52
+w200 v1 Tnatural=coastline Nn103,n104,n105,n106,n107,n108
+w200 v1 Tnatural=coastline Nn108,n100,n101,n102,n103
+w400 v1 Tnatural=coastline Nn300,n301,n302,n300
+OSM
+
+cat <<'OSM' >>$INPUT2
+n300 v1 x1.50 y1.50
+n301 v1 x1.52 y1.50
+n302 v2 x1.53 y1.52
+w200 v1 Tnatural=coastline Nn103,n104,n105,n106,n107,n108
+w200 v1 Tnatural=coastline Nn108,n100,n101,n102,n103
+w400 v1 Tnatural=coastline Nn300,n301,n302,n300
+OSM
+
+#-----------------------------------------------------------------------------
+
+SEGMENTS1=${BIN_DIR}/test/${TEST_ID}.1.segments
+SEGMENTS2=${BIN_DIR}/test/${TEST_ID}.2.segments
+SEGMENTS3=${BIN_DIR}/test/${TEST_ID}.3.segments
+SEGMENTS4=${BIN_DIR}/test/${TEST_ID}.4.segments
+rm -f $SEGMENTS1 $SEGMENTS2 $SEGMENTS3 $SEGMENTS4
+
+$OSMC --verbose --overwrite --write-segments=$SEGMENTS1 --output-database=$DB $INPUT >$LOG 2>&1
+RC=$?
+
+test $RC -eq 1
+
+$OSMC --verbose --overwrite --write-segments=$SEGMENTS3 --output-database=$DB $INPUT2 >$LOG 2>&1
+RC=$?
+
+test $RC -eq 1
+
+$OSMC --verbose --overwrite --previous-segments=$SEGMENTS1 --write-segments=$SEGMENTS2 --output-database=$DB $INPUT2 >$LOG 2>&1
+RC=$?
+set -e
+
+test $RC -eq 1
+
+cmp $SEGMENTS2 $SEGMENTS3
+
+grep 'Self-intersection at or near point' $LOG
+
+# Update the segments file in place
+cp $SEGMENTS1 $SEGMENTS4
+
+set +e
+$OSMC --verbose --overwrite --previous-segments=$SEGMENTS4 --write-segments=$SEGMENTS4 --output-database=$DB $INPUT2 >$LOG 2>&1
+RC=$?
+set -e
+
+test $RC -eq 1
+
+cmp $SEGMENTS4 $SEGMENTS3
+test ! -e $SEGMENTS4.tmp
+
+grep '^There were 1 warnings.$' $LOG
+grep '^There were 0 errors.$' $LOG
+
+check_count error_points 1;
+check_count error_lines 0;
+
+echo "SELECT AsText(geometry), osm_id, error FROM error_points;" | $SQL \
+    | grep -F 'POINT(1.09 1.975)|0|intersection'
+
+# A missing previous segments file is fatal and leaves no temporary file
+set +e
+$OSMC --verbose --overwrite --previous-segments=$SEGMENTS4.missing --write-segments=$SEGMENTS4 --output-database=$DB $INPUT2 >$LOG 2>&1
+RC=$?
+set -e
+
+test $RC -eq 3
+
+cmp $SEGMENTS4 $SEGMENTS3
+test ! -e $SEGMENTS4.tmp
+
+#-----------------------------------------------------------------------------
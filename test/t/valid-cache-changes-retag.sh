@@ -0,0 +1,90 @@
+#!/bin/sh
+#-----------------------------------------------------------------------------
+#
+#  Valid "islands" written to a cache file, then updated from a change file
+#  in which a way becomes a coastline way only because of a changed tag. The
+#  locations of its nodes are not in the change file or the cache.
+#
+#-----------------------------------------------------------------------------
+
+. $1/test/init.sh
+
+set -x
+
+#-----------------------------------------------------------------------------
+
+cat <<'OSM' >$INPUT
+n100 v1 x1.01 y1.01
+n101 v1 x1.04 y1.01
+n102 v1 x1.04 y1.04
+n103 v1 x1.01 y1.04
+n110 v1 x1.01 y1.11
+n111 v1 x1.04 y1.11
+n112 v1 x1.04 y1.14
+n113 v1 x1.01 y1.14
+w200 v1 Tnatural=coastline Nn100,n101,n102,n103,n100
+w210 v1 Tnatural=water Nn110,n111,n112,n113,n110
+OSM
+
+CACHE=${BIN_DIR}/test/${TEST_ID}.cache
+NEW_CACHE=${BIN_DIR}/test/${TEST_ID}-new.cache
+CHANGES=${BIN_DIR}/test/${TEST_ID}-changes.opl
+SEGMENTS=${BIN_DIR}/test/${TEST_ID}.segments
+
+cat <<'OSM' >$CHANGES
+w210 v2 Tnatural=coastline Nn110,n111,n112,n113,n110
+OSM
+
+#-----------------------------------------------------------------------------
+
+set -e
+
+$OSMC --verbose --overwrite --write-cache=$CACHE --output-database=$DB $INPUT >$LOG 2>&1
+
+test $? -eq 0
+
+check_count land_polygons 1;
+
+# Without the OSM file the locations are missing, no new cache and no
+# segments file are written.
+rm -f $NEW_CACHE $SEGMENTS
+
+set +e
+$OSMC --verbose --overwrite --read-cache=$CACHE --apply-changes=$CHANGES --write-cache=$NEW_CACHE --write-segments=$SEGMENTS --output-database=$DB >$LOG 2>&1
+RC=$?
+set -e
+
+test $RC -eq 2
+
+grep 'There are 5 node locations missing after applying the changes' $LOG
+test ! -e $NEW_CACHE
+test ! -e $NEW_CACHE.tmp
+test ! -e $SEGMENTS
+test ! -e $SEGMENTS.tmp
+
+# With the OSM file the missing locations are read from there.
+$OSMC --verbose --overwrite --read-cache=$CACHE --apply-changes=$CHANGES --write-cache=$NEW_CACHE --output-database=$DB $INPUT >$LOG 2>&1
+
+test $? -eq 0
+
+grep 'Reading 5 missing node locations from file' $LOG
+grep 'There are 2 coastline rings (2 from a single closed way and 0 others).$' $LOG
+
+grep '^There were 0 warnings.$' $LOG
+grep '^There were 0 errors.$' $LOG
+
+check_count land_polygons 2;
+
+echo "SELECT AsText(geometry) FROM land_polygons;" | $SQL >$DUMP
+grep -F 'POLYGON((1.01 1.11, 1.01 1.14, 1.04 1.14, 1.04 1.11, 1.01 1.11))' $DUMP
+
+test -s $NEW_CACHE
+
+# The new cache contains all locations.
+$OSMC --verbose --overwrite --read-cache=$NEW_CACHE --output-database=$DB >$LOG 2>&1
+
+test $? -eq 0
+
+check_count land_polygons 2;
+
+#-----------------------------------------------------------------------------
@@ -0,0 +1,63 @@
+#!/bin/sh
+#-----------------------------------------------------------------------------
+#
+#  Valid "islands" written to a cache file, then updated from a change file.
+#
+#-----------------------------------------------------------------------------
+
+. $1/test/init.sh
+
+set -x
+
+#-----------------------------------------------------------------------------
+
+cat <<'OSM' >$INPUT
+n100 v1 x1.01 y1.01
+n101 v1 x1.04 y1.01
+n102 v1 x1.04 y1.04
+n103 v1 x1.01 y1.04
+n110 v1 x1.01 y1.11
+n111 v1 x1.04 y1.11
+n112 v1 x1.04 y1.14
+n113 v1 x1.01 y1.14
+w200 v1 Tnatural=coastline Nn100,n101
+w201 v1 Tnatural=coastline Nn101,n102,n103
+w202 v1 Tnatural=coastline Nn103,n100
+w210 v1 Tnatural=coastline Nn110,n111,n112,n113,n110
+OSM
+
+CACHE=${BIN_DIR}/test/${TEST_ID}.cache
+CHANGES=${BIN_DIR}/test/${TEST_ID}-changes.opl
+
+cat <<'OSM' >$CHANGES
+n101 v2 dV x1.05 y1.01
+w210 v2 dD
+OSM
+
+#-----------------------------------------------------------------------------
+
+set -e
+
+$OSMC --verbose --overwrite --write-cache=$CACHE --output-database=$DB $INPUT >$LOG 2>&1
+
+test $? -eq 0
+
+check_count land_polygons 2;
+
+$OSMC --verbose --overwrite --read-cache=$CACHE --apply-changes=$CHANGES --output-database=$DB >$LOG 2>&1
+
+test $? -eq 0
+
+grep 'There are 1 coastline rings (0 from a single closed way and 1 others).$' $LOG
+
+grep '^There were 0 warnings.$' $LOG
+grep '^There were 0 errors.$' $LOG
+
+check_count land_polygons 1;
+check_count error_points 0;
+check_count error_lines 0;
+
+echo "SELECT AsText(geometry) FROM land_polygons;" | $SQL >$DUMP
+grep -F 'POLYGON((1.01 1.01, 1.01 1.04, 1.04 1.04, 1.05 1.01, 1.01 1.01))' $DUMP
+
+#-----------------------------------------------------------------------------
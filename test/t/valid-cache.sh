@@ -0,0 +1,59 @@
+#!/bin/sh
+#-----------------------------------------------------------------------------
+#
+#  Valid "islands" made up from several ways, written to and read back from a cache file.
+#
+#-----------------------------------------------------------------------------
+
+. $1/test/init.sh
+
+set -x
+
+#-----------------------------------------------------------------------------
+
+cat <<'OSM' >$INPUT
+n100 v1 x1.01 y1.01
+n101 v1 x1.04 y1.01
+n102 v1 x1.04 y1.04
+n103 v1 x1.01 y1.04
+n110 v1 x1.01 y1.11
+n111 v1 x1.04 y1.11
+n112 v1 x1.04 y1.14
+n113 v1 x1.01 y1.14
+w200 v1 Tnatural=coastline Nn100,n101
+w201 v1 Tnatural=coastline Nn101,n102,n103
+w202 v1 Tnatural=coastline Nn103,n100
+w203 v1 Tnatural=water Nn110,n113
+w210 v1 Tnatural=coastline Nn110,n111,n112,n113,n110
+OSM
+
+#-----------------------------------------------------------------------------
+
+set -e
+
+CACHE=${BIN_DIR}/test/${TEST_ID}.cache
+
+$OSMC --verbose --overwrite --write-cache=$CACHE --output-database=$DB $INPUT >$LOG 2>&1
+
+test $? -eq 0
+
+test -s $CACHE
+
+$OSMC --verbose --overwrite --read-cache=$CACHE --output-database=$DB >$LOG 2>&1
+
+test $? -eq 0
+
+grep 'There are 2 coastline rings (1 from a single closed way and 1 others).$' $LOG
+
+grep '^There were 0 warnings.$' $LOG
+grep '^There were 0 errors.$' $LOG
+
+check_count land_polygons 2;
+check_count error_points 0;
+check_count error_lines 0;
+
+echo "SELECT AsText(geometry) FROM land_polygons;" | $SQL >$DUMP
+grep -F 'POLYGON((1.01 1.01, 1.01 1.04, 1.04 1.04, 1.04 1.01, 1.01 1.01))' $DUMP
+grep -F 'POLYGON((1.01 1.11, 1.01 1.14, 1.04 1.14, 1.04 1.11, 1.01 1.11))' $DUMP
+
+#-----------------------------------------------------------------------------
@@ -0,0 +1,54 @@
+#!/bin/sh
+#-----------------------------------------------------------------------------
+#
+#  Valid island with an "inland sea" and an island in that, nested on
+#  several threads.
+#
+#-----------------------------------------------------------------------------
+
+. $1/test/init.sh
+
+set -x
+
+#-----------------------------------------------------------------------------
+
+cat <<'OSM' >$INPUT
+n100 v1 x1.00 y1.00
+n101 v1 x1.10 y1.00
+n102 v1 x1.10 y1.10
+n103 v1 x1.00 y1.10
+n110 v1 x1.03 y1.03
+n111 v1 x1.03 y1.07
+n112 v1 x1.07 y1.07
+n113 v1 x1.07 y1.03
+n120 v1 x1.04 y1.04
+n121 v1 x1.06 y1.04
+n122 v1 x1.06 y1.06
+n123 v1 x1.04 y1.06
+w200 v1 Tnatural=coastline Nn100,n101,n102,n103,n100
+w201 v1 Tnatural=coastline Nn110,n111,n112,n113,n110
+w202 v1 Tnatural=coastline Nn120,n121,n122,n123,n120
+OSM
+
+#-----------------------------------------------------------------------------
+
+set -e
+
+$OSMC --verbose --overwrite --threads=2 --output-database=$DB $INPUT >$LOG 2>&1
+
+test $? -eq 0
+
+grep 'There are 3 coastline rings (3 from a single closed way and 0 others).$' $LOG
+
+grep '^There were 0 warnings.$' $LOG
+grep '^There were 0 errors.$' $LOG
+
+check_count land_polygons 2;
+check_count error_points 0;
+check_count error_lines 0;
+
+echo "SELECT NumInteriorRings(geometry) FROM land_polygons ORDER BY Area(geometry) DESC;" | $SQL >$DUMP
+test "`cat $DUMP`" = "1
+0"
+
+#-----------------------------------------------------------------------------
@@ -0,0 +1,86 @@
+#!/bin/sh
+#-----------------------------------------------------------------------------
+#
+#  Valid "islands" read from a file with node locations on ways (in one
+#  pass) and from STDIN. The result must be the same as when reading the
+#  file without locations on ways (in two passes).
+#
+#  Needs the osmium command line tool to create the input file, the test
+#  is skipped if it is not available.
+#
+#-----------------------------------------------------------------------------
+
+. $1/test/init.sh
+
+set -x
+
+command -v osmium || exit 77
+
+#-----------------------------------------------------------------------------
+
+cat <<'OSM' >$INPUT
+n100 v1 x1.01 y1.01
+n101 v1 x1.04 y1.01
+n102 v1 x1.04 y1.04
+n103 v1 x1.01 y1.04
+n104 v1 x1.02 y1.02 Tnatural=coastline
+n110 v1 x1.01 y1.11
+n111 v1 x1.04 y1.11
+n112 v1 x1.04 y1.14
+n113 v1 x1.01 y1.14
+w200 v1 Tnatural=coastline Nn100,n101
+w201 v1 Tnatural=coastline Nn101,n102,n103
+w202 v1 Tnatural=coastline Nn103,n100
+w203 v1 Tnatural=water Nn110,n113
+w210 v1 Tnatural=coastline Nn110,n111,n112,n113,n110
+OSM
+
+#-----------------------------------------------------------------------------
+
+set -e
+
+PBF=${BIN_DIR}/test/${TEST_ID}.osm.pbf
+TWO_PASS=${BIN_DIR}/test/${TEST_ID}.two-pass.dump
+
+osmium add-locations-to-ways --overwrite --output=$PBF $INPUT
+
+# Reference run on the file without locations on ways
+$OSMC --verbose --overwrite --output-database=$DB $INPUT >$LOG 2>&1
+
+test $? -eq 0
+
+grep 'Reading nodes (2nd pass through input file)' $LOG
+
+echo "SELECT AsText(geometry) FROM land_polygons ORDER BY AsText(geometry); SELECT osm_id, error, AsText(geometry) FROM error_points;" | $SQL >$TWO_PASS
+test -s $TWO_PASS
+
+# Single pass on the file with locations on ways
+$OSMC --verbose --overwrite --output-database=$DB $PBF >$LOG 2>&1
+
+test $? -eq 0
+
+grep 'only one pass needed' $LOG
+if grep 'Reading nodes (2nd pass through input file)' $LOG; then
+    false
+fi
+
+grep 'There are 2 coastline rings (1 from a single closed way and 1 others).$' $LOG
+
+check_count land_polygons 2;
+check_count error_points 1;
+check_count error_lines 0;
+
+echo "SELECT AsText(geometry) FROM land_polygons ORDER BY AsText(geometry); SELECT osm_id, error, AsText(geometry) FROM error_points;" | $SQL >$DUMP
+cmp $TWO_PASS $DUMP
+
+# Single pass reading from STDIN
+$OSMC --verbose --overwrite --input-format=pbf --output-database=$DB - <$PBF >$LOG 2>&1
+
+test $? -eq 0
+
+grep 'only one pass needed' $LOG
+
+echo "SELECT AsText(geometry) FROM land_polygons ORDER BY AsText(geometry); SELECT osm_id, error, AsText(geometry) FROM error_points;" | $SQL >$DUMP
+cmp $TWO_PASS $DUMP
+
+#-----------------------------------------------------------------------------
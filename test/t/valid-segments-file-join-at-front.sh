@@ -0,0 +1,71 @@
+#!/bin/sh
+#-----------------------------------------------------------------------------
+#
+#  Ring from five ways where the two-node way 201 is added at the front of
+#  way 200 and this partial ring is then joined to another one. The changed
+#  segment of way 201 must be reported with the ID of way 201.
+#
+#-----------------------------------------------------------------------------
+
+. $1/test/init.sh
+
+set -x
+
+#-----------------------------------------------------------------------------
+
+INPUT2=${BIN_DIR}/test/${TEST_ID}.2.opl
+
+cat <<'OSM' >$INPUT
+n100 v1 x1.01 y1.01
+n101 v1 x1.02 y1.01
+n102 v1 x1.03 y1.02
+n103 v1 x1.04 y1.02
+n104 v1 x1.05 y1.03
+n105 v1 x1.01 y1.03
+w200 v1 Tnatural=coastline Nn102,n103,n104
+w201 v1 Tnatural=coastline Nn101,n102
+w202 v1 Tnatural=coastline Nn105,n100
+w203 v1 Tnatural=coastline Nn100,n101
+w204 v1 Tnatural=coastline Nn104,n105
+OSM
+
+cat <<'OSM' >$INPUT2
+n100 v1 x1.01 y1.01
+n101 v2 x1.02 y1.005
+n102 v1 x1.03 y1.02
+n103 v1 x1.04 y1.02
+n104 v1 x1.05 y1.03
+n105 v1 x1.01 y1.03
+w200 v1 Tnatural=coastline Nn102,n103,n104
+w201 v1 Tnatural=coastline Nn101,n102
+w202 v1 Tnatural=coastline Nn105,n100
+w203 v1 Tnatural=coastline Nn100,n101
+w204 v1 Tnatural=coastline Nn104,n105
+OSM
+
+#-----------------------------------------------------------------------------
+
+SEGMENTS1=${BIN_DIR}/test/${TEST_ID}.1.segments
+SEGMENTS2=${BIN_DIR}/test/${TEST_ID}.2.segments
+rm -f $SEGMENTS1 $SEGMENTS2
+
+set -e
+
+$OSMC --verbose --overwrite --write-segments=$SEGMENTS1 --output-database=$DB $INPUT >$LOG 2>&1
+$OSMC --verbose --overwrite --write-segments=$SEGMENTS2 --output-database=$DB $INPUT2 >$LOG 2>&1
+
+grep 'There are 1 coastline rings (0 from a single closed way and 1 others).$' $LOG
+
+set +e
+${BIN_DIR}/src/osmcoastline_segments --dump $SEGMENTS1 $SEGMENTS2 >$DUMP
+RC=$?
+set -e
+
+test $RC -eq 1
+
+# node 101 moved, so the segments of ways 201 and 203 changed
+test `grep -c ' way 201 ring 200$' $DUMP` -eq 2
+test `grep -c ' way 203 ring 200$' $DUMP` -eq 2
+test `grep -c ' way 200 ' $DUMP` -eq 0
+
+#-----------------------------------------------------------------------------
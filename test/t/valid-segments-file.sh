@@ -0,0 +1,62 @@
+#!/bin/sh
+#-----------------------------------------------------------------------------
+#
+#  Compare segment files from two runs where one way was changed. The
+#  changed segments must be reported with the IDs of their way and ring.
+#
+#-----------------------------------------------------------------------------
+
+. $1/test/init.sh
+
+set -x
+
+#-----------------------------------------------------------------------------
+
+INPUT2=${BIN_DIR}/test/${TEST_ID}.2.opl
+
+cat <<'OSM' >$INPUT
+n100 v1 x1.01 y1.01
+n101 v1 x1.02 y1.01
+n102 v1 x1.03 y1.02
+n103 v1 x1.04 y1.02
+n104 v1 x1.05 y1.03
+n105 v1 x1.01 y1.03
+w200 v1 Tnatural=coastline Nn100,n101,n102
+w201 v1 Tnatural=coastline Nn102,n103,n104,n105,n100
+OSM
+
+cat <<'OSM' >$INPUT2
+n100 v1 x1.01 y1.01
+n101 v1 x1.02 y1.01
+n102 v1 x1.03 y1.02
+n103 v1 x1.04 y1.02
+n104 v2 x1.06 y1.03
+n105 v1 x1.01 y1.03
+w200 v1 Tnatural=coastline Nn100,n101,n102
+w201 v1 Tnatural=coastline Nn102,n103,n104,n105,n100
+OSM
+
+#-----------------------------------------------------------------------------
+
+SEGMENTS1=${BIN_DIR}/test/${TEST_ID}.1.segments
+SEGMENTS2=${BIN_DIR}/test/${TEST_ID}.2.segments
+rm -f $SEGMENTS1 $SEGMENTS2
+
+set -e
+
+$OSMC --verbose --overwrite --write-segments=$SEGMENTS1 --output-database=$DB $INPUT >$LOG 2>&1
+$OSMC --verbose --overwrite --write-segments=$SEGMENTS2 --output-database=$DB $INPUT2 >$LOG 2>&1
+
+${BIN_DIR}/src/osmcoastline_segments --dump $SEGMENTS1 $SEGMENTS1 >$DUMP
+
+set +e
+${BIN_DIR}/src/osmcoastline_segments --dump $SEGMENTS1 $SEGMENTS2 >$DUMP
+RC=$?
+set -e
+
+test $RC -eq 1
+
+test `grep -c ' way 201 ring 200$' $DUMP` -eq 4
+test `grep -c ' way 200 ' $DUMP` -eq 0
+
+#-----------------------------------------------------------------------------
@@ -0,0 +1,79 @@
+#!/bin/sh
+#-----------------------------------------------------------------------------
+#
+#  Valid island with an "inland sea" split into the tiles of zoom level 4.
+#  The island and the inland sea are both cut into four tiles.
+#
+#-----------------------------------------------------------------------------
+
+. $1/test/init.sh
+
+set -x
+
+#-----------------------------------------------------------------------------
+
+cat <<'OSM' >$INPUT
+n100 v1 x20.00 y20.00
+n101 v1 x25.00 y20.00
+n102 v1 x25.00 y24.00
+n103 v1 x20.00 y24.00
+n110 v1 x22.00 y21.00
+n111 v1 x22.00 y23.00
+n112 v1 x23.00 y23.00
+n113 v1 x23.00 y21.00
+w200 v1 Tnatural=coastline Nn100,n101,n102,n103,n100
+w201 v1 Tnatural=coastline Nn110,n111,n112,n113,n110
+OSM
+
+#-----------------------------------------------------------------------------
+
+set -e
+
+$OSMC --verbose --overwrite --srs=3857 --split-grid=4 --output-polygons=both --threads=2 --output-database=$DB $INPUT >$LOG 2>&1
+
+test $? -eq 0
+
+grep 'There are 2 coastline rings (2 from a single closed way and 0 others).$' $LOG
+
+grep '^There were 0 warnings.$' $LOG
+grep '^There were 0 errors.$' $LOG
+
+check_count error_points 0;
+check_count error_lines 0;
+
+# one piece of land in each of the four tiles
+check_count land_polygons 4;
+
+echo "SELECT count(*) FROM land_polygons WHERE NumInteriorRings(geometry) > 0;" | $SQL >$DUMP
+test "`cat $DUMP`" = "0"
+
+echo "SELECT x, y FROM land_polygons ORDER BY x, y;" | $SQL >$DUMP
+test "`cat $DUMP | tr '\n' ' '`" = "8|6 8|7 9|6 9|7 "
+
+# land at 20.5/20.5 is in tile 8/7
+echo "SELECT x, y FROM land_polygons WHERE Contains(geometry, MakePoint(2282049.6, 2332357.8));" | $SQL >$DUMP
+test "`cat $DUMP`" = "8|7"
+
+# land at 24.5/23.5 is in tile 9/6
+echo "SELECT x, y FROM land_polygons WHERE Contains(geometry, MakePoint(2727327.5, 2692598.2));" | $SQL >$DUMP
+test "`cat $DUMP`" = "9|6"
+
+# every tile has water, tiles with land have the sea and a part of the
+# inland sea
+check_count water_polygons 260;
+
+echo "SELECT count(*) FROM water_polygons WHERE x=8 AND y=7;" | $SQL >$DUMP
+test "`cat $DUMP`" = "2"
+
+# inland sea at 22.2/21.5 is in tile 8/7
+echo "SELECT count(*) FROM land_polygons WHERE Contains(geometry, MakePoint(2471292.7, 2451599.1));" | $SQL >$DUMP
+test "`cat $DUMP`" = "0"
+
+echo "SELECT x, y FROM water_polygons WHERE Contains(geometry, MakePoint(2471292.7, 2451599.1));" | $SQL >$DUMP
+test "`cat $DUMP`" = "8|7"
+
+# sea at 10/10 is in tile 8/7, too
+echo "SELECT x, y FROM water_polygons WHERE Contains(geometry, MakePoint(1113194.9, 1118890.0));" | $SQL >$DUMP
+test "`cat $DUMP`" = "8|7"
+
+#-----------------------------------------------------------------------------
@@ -0,0 +1,83 @@
+#!/bin/sh
+#-----------------------------------------------------------------------------
+#
+#  Valid island with an "inland sea" which is split into four polygons.
+#  The first split goes through the inland sea. All splits are done by the
+#  axis-aligned clipper, GEOS is never needed.
+#
+#-----------------------------------------------------------------------------
+
+. $1/test/init.sh
+
+set -x
+
+#-----------------------------------------------------------------------------
+
+cat <<'OSM' >$INPUT
+n100 v1 x1.00 y1.00
+n101 v1 x1.04 y1.00
+n102 v1 x1.08 y1.00
+n103 v1 x1.12 y1.00
+n104 v1 x1.16 y1.00
+n105 v1 x1.20 y1.00
+n106 v1 x1.20 y1.10
+n107 v1 x1.16 y1.10
+n108 v1 x1.12 y1.10
+n109 v1 x1.08 y1.10
+n110 v1 x1.04 y1.10
+n111 v1 x1.00 y1.10
+n120 v1 x1.08 y1.03
+n121 v1 x1.08 y1.07
+n122 v1 x1.12 y1.07
+n123 v1 x1.12 y1.03
+w200 v1 Tnatural=coastline Nn100,n101,n102,n103,n104,n105,n106,n107,n108,n109,n110,n111,n100
+w201 v1 Tnatural=coastline Nn120,n121,n122,n123,n120
+OSM
+
+#-----------------------------------------------------------------------------
+
+set -e
+
+$OSMC --verbose --debug --overwrite --max-points=12 --threads=2 --output-database=$DB $INPUT >$LOG 2>&1
+
+test $? -eq 0
+
+grep 'There are 2 coastline rings (2 from a single closed way and 0 others).$' $LOG
+
+grep '^There were 0 warnings.$' $LOG
+grep '^There were 0 errors.$' $LOG
+
+check_count error_points 0;
+check_count error_lines 0;
+
+# split at 1.10 first, then both halves in the middle again
+test `grep -c 'split_polygon(): depth=0 ' $LOG` -eq 1
+test `grep -c 'split_polygon(): depth=1 ' $LOG` -eq 2
+test `grep -c 'split_polygon(): depth=2 ' $LOG` -eq 0
+
+# the clipper handled every split
+test `grep -c 'using GEOS' $LOG` -eq 0
+test `grep -c 'was not successful' $LOG` -eq 0
+
+check_count land_polygons 4;
+
+echo "SELECT count(*) FROM land_polygons WHERE NumInteriorRings(geometry) > 0;" | $SQL >$DUMP
+test "`cat $DUMP`" = "0"
+
+# the pieces overlap by twice the default overlap of 0.0001
+echo "SELECT printf('%.5f %.5f %.5f %.5f', MbrMinX(geometry), MbrMinY(geometry), MbrMaxX(geometry), MbrMaxY(geometry)) FROM land_polygons ORDER BY 1;" | $SQL >$DUMP
+test "`cat $DUMP | tr '\n' ','`" = "1.00000 1.00000 1.05015 1.10000,1.04995 1.00000 1.10010 1.10000,1.09990 1.00000 1.15005 1.10000,1.14985 1.00000 1.20000 1.10000,"
+
+echo "SELECT count(*) FROM land_polygons WHERE Contains(geometry, MakePoint(1.10, 1.05));" | $SQL >$DUMP
+test "`cat $DUMP`" = "0"
+
+echo "SELECT count(*) FROM land_polygons WHERE Contains(geometry, MakePoint(1.01, 1.02));" | $SQL >$DUMP
+test "`cat $DUMP`" = "1"
+
+echo "SELECT count(*) FROM land_polygons WHERE Contains(geometry, MakePoint(1.09, 1.02));" | $SQL >$DUMP
+test "`cat $DUMP`" = "1"
+
+echo "SELECT count(*) FROM land_polygons WHERE Contains(geometry, MakePoint(1.19, 1.05));" | $SQL >$DUMP
+test "`cat $DUMP`" = "1"
+
+#-----------------------------------------------------------------------------
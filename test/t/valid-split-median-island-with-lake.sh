@@ -0,0 +1,81 @@
+#!/bin/sh
+#-----------------------------------------------------------------------------
+#
+#  Valid island with an "inland sea" which is split at the median of the
+#  coordinates. Most points of the outer ring are on the west side, so the
+#  first cut is at 1.035 and not in the middle at 1.10. It goes through the
+#  inland sea. Splitting in the middle would need six pieces.
+#
+#-----------------------------------------------------------------------------
+
+. $1/test/init.sh
+
+set -x
+
+#-----------------------------------------------------------------------------
+
+cat <<'OSM' >$INPUT
+n100 v1 x1.00 y1.00
+n101 v1 x1.01 y1.00
+n102 v1 x1.02 y1.00
+n103 v1 x1.03 y1.00
+n104 v1 x1.04 y1.00
+n105 v1 x1.20 y1.00
+n106 v1 x1.20 y1.10
+n107 v1 x1.04 y1.10
+n108 v1 x1.03 y1.10
+n109 v1 x1.02 y1.10
+n110 v1 x1.01 y1.10
+n111 v1 x1.00 y1.10
+n120 v1 x1.02 y1.03
+n121 v1 x1.02 y1.07
+n122 v1 x1.05 y1.07
+n123 v1 x1.05 y1.03
+w200 v1 Tnatural=coastline Nn100,n101,n102,n103,n104,n105,n106,n107,n108,n109,n110,n111,n100
+w201 v1 Tnatural=coastline Nn120,n121,n122,n123,n120
+OSM
+
+#-----------------------------------------------------------------------------
+
+set -e
+
+$OSMC --verbose --debug --overwrite --max-points=12 --split-method=median --threads=2 --output-database=$DB $INPUT >$LOG 2>&1
+
+test $? -eq 0
+
+grep 'There are 2 coastline rings (2 from a single closed way and 0 others).$' $LOG
+
+grep '^There were 0 warnings.$' $LOG
+grep '^There were 0 errors.$' $LOG
+
+check_count error_points 0;
+check_count error_lines 0;
+
+# split at the median x coordinate, then the western piece at the median
+# y coordinate
+test `grep -c 'split_polygon(): depth=0 ' $LOG` -eq 1
+test `grep -c 'split_polygon(): depth=1 ' $LOG` -eq 1
+test `grep -c 'split_polygon(): depth=2 ' $LOG` -eq 0
+
+check_count land_polygons 3;
+
+echo "SELECT count(*) FROM land_polygons WHERE NumInteriorRings(geometry) > 0;" | $SQL >$DUMP
+test "`cat $DUMP`" = "0"
+
+# the pieces overlap by twice the default overlap of 0.0001
+echo "SELECT printf('%.5f %.5f %.5f %.5f', MbrMinX(geometry), MbrMinY(geometry), MbrMaxX(geometry), MbrMaxY(geometry)) FROM land_polygons ORDER BY 1;" | $SQL >$DUMP
+test "`cat $DUMP | tr '\n' ','`" = "1.00000 1.00000 1.03510 1.08510,1.00000 1.08490 1.03510 1.10000,1.03490 1.00000 1.20000 1.10000,"
+
+echo "SELECT count(*) FROM land_polygons WHERE Contains(geometry, MakePoint(1.04, 1.05));" | $SQL >$DUMP
+test "`cat $DUMP`" = "0"
+
+echo "SELECT count(*) FROM land_polygons WHERE Contains(geometry, MakePoint(1.01, 1.02));" | $SQL >$DUMP
+test "`cat $DUMP`" = "1"
+
+echo "SELECT count(*) FROM land_polygons WHERE Contains(geometry, MakePoint(1.01, 1.095));" | $SQL >$DUMP
+test "`cat $DUMP`" = "1"
+
+echo "SELECT count(*) FROM land_polygons WHERE Contains(geometry, MakePoint(1.19, 1.05));" | $SQL >$DUMP
+test "`cat $DUMP`" = "1"
+
+#-----------------------------------------------------------------------------